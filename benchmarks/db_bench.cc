@@ -4,17 +4,25 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -33,12 +41,24 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, in MultiGet batches
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
+//      readhotwhilescanning -- 1 thread scans the DB over and over while N
+//                      threads do readhot
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      cachelookup   -- N lookups per thread in a block cache of N entries
+//      filterbuild   -- repeated construction of a filter of N keys
+//      filterlookup  -- N lookups in a filter of N keys, half of them missing
+//      snappycomp    -- repeated snappy compression of a block
+//      snappyuncomp  -- repeated snappy uncompression of a block
+//      zstdcomp      -- repeated zstd compression of a block
+//      zstduncomp    -- repeated zstd uncompression of a block
+//      lz4comp       -- repeated lz4 compression of a block
+//      lz4uncomp     -- repeated lz4 uncompression of a block
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -60,7 +80,11 @@ static const char* FLAGS_benchmarks =
     "fill100K,"
     "crc32c,"
     "snappycomp,"
-    "snappyuncomp,";
+    "snappyuncomp,"
+    "zstdcomp,"
+    "zstduncomp,"
+    "lz4comp,"
+    "lz4uncomp,";
 
 // Number of key/values to place in database
 static int FLAGS_num = 1000000;
@@ -71,6 +95,9 @@ static int FLAGS_reads = -1;
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
+// Number of keys looked up by each MultiGet() call in multireadrandom.
+static int FLAGS_multiget_batch = 100;
+
 // Size of each value
 static int FLAGS_value_size = 100;
 
@@ -78,6 +105,19 @@ static int FLAGS_value_size = 100;
 // their original size after compression
 static double FLAGS_compression_ratio = 0.5;
 
+// Block compression: "snappy", "zstd", "lz4" or "none".
+static const char* FLAGS_compression = "snappy";
+
+// Comma-separated compression of each level, e.g. "lz4,lz4,zstd".  If
+// empty, --compression is used for all levels.
+static const char* FLAGS_compression_per_level = "";
+
+// Compression level for zstd.
+static int FLAGS_zstd_compression_level = 1;
+
+// If non-zero, train a zstd dictionary of up to this many bytes per table.
+static int FLAGS_zstd_max_dict_bytes = 0;
+
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
@@ -96,17 +136,69 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// Number of keys between restart points in blocks.
+// (initialized to default value by "main")
+static int FLAGS_block_restart_interval = 0;
+
+// If true, data blocks end with a hash index of their user keys.
+static bool FLAGS_data_block_hash_index = false;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Number of bytes to use as a cache of compressed blocks.
+// Zero means no compressed block cache.
+static int FLAGS_compressed_cache_size = 0;
+
+// Block cache implementation: "lru", "scan_resistant" or "clock".
+static const char* FLAGS_cache_type = "lru";
+
+// If false, copy what is read from mmap-ed files into the read buffer, as a
+// pread() would, so that uncompressed blocks go through the block cache.
+static bool FLAGS_mmap_read = true;
+
+// If true, readseq and multireadrandom read blocks with asynchronous reads
+// (see ReadOptions::async_io).
+static bool FLAGS_async_io = false;
+
+// Readahead size of readseq, or 0 for adaptive readahead (see
+// ReadOptions::readahead_size).
+static int FLAGS_readahead_size = 0;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// If true, keep the open tables in a CLOCK cache.
+static bool FLAGS_clock_table_cache = false;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Filter implementation: "standard", "cache_local" or "ribbon".
+static const char* FLAGS_bloom_type = "standard";
+
+// Comma-separated filter implementation of each level, e.g.
+// "standard,standard,ribbon", or "none" for no filters.  If empty,
+// --bloom_type is used for all levels.  Requires --bloom_bits.
+static const char* FLAGS_bloom_type_per_level = "";
+
+// If true, build one filter per table instead of one per 2KB of data.
+static bool FLAGS_full_table_filter = false;
+
+// If true, partition the index and filters of each table.
+static bool FLAGS_partition_index_and_filters = false;
+
+// Approximate size of an index partition.
+static int FLAGS_index_partition_size = 4 * 1024;
+
+// If true, keep index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, pin the index and filter blocks of level-0 and level-1 tables.
+static bool FLAGS_pin_l0_l1_index_and_filter_blocks = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -118,6 +210,23 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, compaction reads and table and log writes use direct I/O.
+static bool FLAGS_use_direct_io = false;
+
+// If positive, flushes and compactions are limited to this many MB/s.
+static int FLAGS_rate_limit_mb = 0;
+
+// If true, overlap log writes with memtable inserts of the previous write.
+static bool FLAGS_pipelined_write = false;
+
+// If true, the writers of a group insert into the memtable in parallel.
+// Combine with --threads, e.g. fillrandom, to measure insert scaling.
+static bool FLAGS_concurrent_memtable_write = false;
+
+// Memtable representation: "skiplist", "hash_skiplist" (hashing the first
+// 8 bytes of each key) or "vector" (sorted at flush, for bulk loads).
+static const char* FLAGS_memtablerep = "skiplist";
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -126,6 +235,40 @@ namespace leveldb {
 namespace {
 leveldb::Env* g_env = nullptr;
 
+// An Env whose random access files return what they read in the buffer
+// supplied by the caller (see FLAGS_mmap_read).
+class CopyingReadEnv : public EnvWrapper {
+ public:
+  explicit CopyingReadEnv(Env* target) : EnvWrapper(target) {}
+
+  Status NewRandomAccessFile(const std::string& fname,
+                             RandomAccessFile** result) override {
+    class CopyingFile : public RandomAccessFile {
+     public:
+      explicit CopyingFile(RandomAccessFile* target) : target_(target) {}
+      ~CopyingFile() override { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const override {
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+
+     private:
+      RandomAccessFile* const target_;
+    };
+
+    Status s = target()->NewRandomAccessFile(fname, result);
+    if (s.ok()) {
+      *result = new CopyingFile(*result);
+    }
+    return s;
+  }
+};
+
 class CountComparator : public Comparator {
  public:
   CountComparator(const Comparator* wrapped) : wrapped_(wrapped) {}
@@ -369,7 +512,12 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  Cache* lookup_cache_;  // Shared by the threads of "cachelookup"
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> filter_policies_per_level_;
+  const MemTableRepFactory* memtable_factory_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -460,10 +608,19 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size >= 0 ? NewBlockCache(FLAGS_cache_size,
+                                                   FLAGS_block_size)
+                                     : nullptr),
+        compressed_cache_(FLAGS_compressed_cache_size > 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        lookup_cache_(nullptr),
+        filter_policy_(nullptr),
+        memtable_factory_(nullptr),
+        rate_limiter_(FLAGS_rate_limit_mb > 0
+                          ? NewGenericRateLimiter(
+                                int64_t{FLAGS_rate_limit_mb} << 20)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -482,12 +639,38 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_bloom_bits >= 0) {
+      filter_policy_ = NewFilterPolicy(FLAGS_bloom_type);
+      for (const char* p = FLAGS_bloom_type_per_level; *p != '\0';) {
+        const char* end = std::strchr(p, ',');
+        if (end == nullptr) end = p + std::strlen(p);
+        const std::string type(p, end - p);
+        filter_policies_per_level_.push_back(
+            type == "none" ? nullptr : NewFilterPolicy(type));
+        p = (*end == ',') ? end + 1 : end;
+      }
+    }
+    if (strcmp(FLAGS_memtablerep, "hash_skiplist") == 0) {
+      memtable_factory_ = NewHashSkipListRepFactory(8);
+    } else if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+      memtable_factory_ = NewVectorRepFactory();
+    } else if (strcmp(FLAGS_memtablerep, "skiplist") != 0) {
+      std::fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+      std::exit(1);
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete lookup_cache_;
     delete filter_policy_;
+    for (const FilterPolicy* policy : filter_policies_per_level_) {
+      delete policy;
+    }
+    delete memtable_factory_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -550,6 +733,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -568,14 +753,31 @@ class Benchmark {
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
+      } else if (name == Slice("readhotwhilescanning")) {
+        num_threads++;  // Add extra thread for scanning
+        method = &Benchmark::ReadHotWhileScanning;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("cachelookup")) {
+        method = &Benchmark::CacheLookup;
+      } else if (name == Slice("filterbuild")) {
+        method = &Benchmark::FilterBuild;
+      } else if (name == Slice("filterlookup")) {
+        method = &Benchmark::FilterLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
         method = &Benchmark::SnappyUncompress;
+      } else if (name == Slice("zstdcomp")) {
+        method = &Benchmark::ZstdCompress;
+      } else if (name == Slice("zstduncomp")) {
+        method = &Benchmark::ZstdUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::LZ4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::LZ4Uncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
@@ -709,7 +911,87 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
-  void SnappyCompress(ThreadState* thread) {
+  void FilterBuild(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(requires --bloom_bits)");
+      return;
+    }
+    KeyBuffer key;
+    const size_t key_size = key.slice().size();
+    std::string keys;
+    std::vector<Slice> key_slices;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      keys.append(key.slice().data(), key_size);
+    }
+    for (int i = 0; i < num_; i++) {
+      key_slices.push_back(Slice(keys.data() + i * key_size, key_size));
+    }
+
+    // Build filters over about 10M keys in total.
+    const int rounds = std::max(1, 10000000 / std::max(num_, 1));
+    thread->stats.Start();
+    const uint64_t start = g_env->NowMicros();
+    std::string filter;
+    for (int i = 0; i < rounds; i++) {
+      filter.clear();
+      filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+      thread->stats.FinishedSingleOp();
+    }
+    const uint64_t micros = g_env->NowMicros() - start;
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d keys, %.1f ns/key, %.2f bits/key)",
+                  num_, num_ > 0 ? micros * 1e3 / rounds / num_ : 0.0,
+                  num_ > 0 ? filter.size() * 8.0 / num_ : 0.0);
+    thread->stats.AddMessage(msg);
+  }
+
+  void FilterLookup(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(requires --bloom_bits)");
+      return;
+    }
+    KeyBuffer key;
+    const size_t key_size = key.slice().size();
+    std::string keys;
+    std::vector<Slice> key_slices;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      keys.append(key.slice().data(), key_size);
+    }
+    for (int i = 0; i < num_; i++) {
+      key_slices.push_back(Slice(keys.data() + i * key_size, key_size));
+    }
+    std::string filter;
+    filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+
+    // Every other lookup is for a missing key.  Generate all of them
+    // upfront so that only the lookups are timed.
+    std::string lookups;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(num_);
+      key.Set(i % 2 == 0 ? k : num_ + k);
+      lookups.append(key.slice().data(), key_size);
+    }
+    thread->stats.Start();
+    int false_positives = 0;
+    for (int i = 0; i < reads_; i++) {
+      Slice k(lookups.data() + i * key_size, key_size);
+      if (filter_policy_->KeyMayMatch(k, filter) && i % 2 != 0) {
+        false_positives++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.2f%% false positives, %d bytes)",
+                  reads_ > 1 ? 100.0 * false_positives / (reads_ / 2) : 0.0,
+                  static_cast<int>(filter.size()));
+    thread->stats.AddMessage(msg);
+  }
+
+  void Compress(
+      ThreadState* thread, std::string name,
+      std::function<bool(const char*, size_t, std::string*)> compress_func) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     int64_t bytes = 0;
@@ -717,14 +999,14 @@ class Benchmark {
     bool ok = true;
     std::string compressed;
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+      ok = compress_func(input.data(), input.size(), &compressed);
       produced += compressed.size();
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      thread->stats.AddMessage("(" + name + " failure)");
     } else {
       char buf[100];
       std::snprintf(buf, sizeof(buf), "(output: %.1f%%)",
@@ -734,43 +1016,185 @@ class Benchmark {
     }
   }
 
-  void SnappyUncompress(ThreadState* thread) {
+  void Uncompress(
+      ThreadState* thread, std::string name,
+      std::function<bool(const char*, size_t, std::string*)> compress_func,
+      std::function<bool(const char*, size_t, char*)> uncompress_func) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     std::string compressed;
-    bool ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+    bool ok = compress_func(input.data(), input.size(), &compressed);
     int64_t bytes = 0;
     char* uncompressed = new char[input.size()];
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Uncompress(compressed.data(), compressed.size(),
-                                   uncompressed);
+      ok = uncompress_func(compressed.data(), compressed.size(), uncompressed);
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
     delete[] uncompressed;
 
     if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+      thread->stats.AddMessage("(" + name + " failure)");
     } else {
       thread->stats.AddBytes(bytes);
     }
   }
 
+  static bool ZstdCompressWithLevel(const char* input, size_t length,
+                                    std::string* output) {
+    return port::Zstd_Compress(FLAGS_zstd_compression_level, input, length,
+                               output);
+  }
+
+  static bool ZstdUncompressWithoutDict(const char* input, size_t length,
+                                        char* output) {
+    return port::Zstd_Uncompress(input, length, output);
+  }
+
+  static Cache* NewBlockCache(size_t capacity, size_t entry_charge) {
+    if (strcmp(FLAGS_cache_type, "scan_resistant") == 0) {
+      return NewScanResistantLRUCache(capacity);
+    } else if (strcmp(FLAGS_cache_type, "clock") == 0) {
+      return NewClockCache(capacity, entry_charge);
+    } else if (strcmp(FLAGS_cache_type, "lru") == 0) {
+      return NewLRUCache(capacity);
+    } else {
+      std::fprintf(stderr, "unknown cache type '%s'\n", FLAGS_cache_type);
+      std::exit(1);
+    }
+  }
+
+  void CacheLookup(ThreadState* thread) {
+    // Every thread looks up random keys in a cache shared by all of them,
+    // which holds all num_ keys, so that only the cost of the lookups and
+    // releases (and their contention) is measured.
+    {
+      MutexLock l(&thread->shared->mu);
+      if (lookup_cache_ == nullptr) {
+        lookup_cache_ = NewBlockCache(num_, 1);
+        for (int i = 0; i < num_; i++) {
+          char key[8];
+          EncodeFixed64(key, i);
+          lookup_cache_->Release(
+              lookup_cache_->Insert(Slice(key, sizeof(key)), nullptr, 1,
+                                    [](const Slice& key, void* value) {}));
+        }
+      }
+    }
+    Cache* const cache = lookup_cache_;
+    thread->stats.Start();
+
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[8];
+      EncodeFixed64(key, thread->rand.Uniform(num_));
+      Cache::Handle* handle = cache->Lookup(Slice(key, sizeof(key)));
+      if (handle != nullptr) {
+        cache->Release(handle);
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void SnappyCompress(ThreadState* thread) {
+    Compress(thread, "snappy", &port::Snappy_Compress);
+  }
+
+  void SnappyUncompress(ThreadState* thread) {
+    Uncompress(thread, "snappy", &port::Snappy_Compress,
+               &port::Snappy_Uncompress);
+  }
+
+  void ZstdCompress(ThreadState* thread) {
+    Compress(thread, "zstd", &ZstdCompressWithLevel);
+  }
+
+  void ZstdUncompress(ThreadState* thread) {
+    Uncompress(thread, "zstd", &ZstdCompressWithLevel,
+               &ZstdUncompressWithoutDict);
+  }
+
+  void LZ4Compress(ThreadState* thread) {
+    Compress(thread, "lz4", &port::LZ4_Compress);
+  }
+
+  void LZ4Uncompress(ThreadState* thread) {
+    Uncompress(thread, "lz4", &port::LZ4_Compress, &port::LZ4_Uncompress);
+  }
+
+  static const FilterPolicy* NewFilterPolicy(const std::string& type) {
+    if (type == "standard") {
+      return NewBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (type == "cache_local") {
+      return NewCacheLocalBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (type == "ribbon") {
+      return NewRibbonFilterPolicy(FLAGS_bloom_bits);
+    }
+    std::fprintf(stderr, "unknown bloom_type '%s'\n", type.c_str());
+    std::exit(1);
+  }
+
+  static CompressionType ParseCompression(const std::string& name) {
+    if (name == "snappy") {
+      return kSnappyCompression;
+    } else if (name == "zstd") {
+      return kZstdCompression;
+    } else if (name == "lz4") {
+      return kLZ4Compression;
+    } else if (name == "none") {
+      return kNoCompression;
+    }
+    std::fprintf(stderr, "unknown compression '%s'\n", name.c_str());
+    std::exit(1);
+  }
+
   void Open() {
     assert(db_ == nullptr);
     Options options;
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.compressed_block_cache = compressed_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.block_restart_interval = FLAGS_block_restart_interval;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
+    options.clock_table_cache = FLAGS_clock_table_cache;
     options.filter_policy = filter_policy_;
+    options.filter_policy_per_level = filter_policies_per_level_;
+    options.full_table_filter = FLAGS_full_table_filter;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.pin_l0_l1_index_and_filter_blocks =
+        FLAGS_pin_l0_l1_index_and_filter_blocks;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.use_direct_io_for_compaction_reads = FLAGS_use_direct_io;
+    options.use_direct_writes = FLAGS_use_direct_io;
+    options.rate_limiter = rate_limiter_;
+    options.enable_pipelined_write = FLAGS_pipelined_write;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
+    options.memtable_factory = memtable_factory_;
+    options.compression = ParseCompression(FLAGS_compression);
+    options.zstd_compression_level = FLAGS_zstd_compression_level;
+    options.zstd_max_dict_bytes = FLAGS_zstd_max_dict_bytes;
+    for (const char* p = FLAGS_compression_per_level; *p != '\0';) {
+      const char* end = std::strchr(p, ',');
+      if (end == nullptr) end = p + std::strlen(p);
+      options.compression_per_level.push_back(
+          ParseCompression(std::string(p, end - p)));
+      p = (*end == ',') ? end + 1 : end;
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -821,7 +1245,10 @@ class Benchmark {
   }
 
   void ReadSequential(ThreadState* thread) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
+    ReadOptions options;
+    options.async_io = FLAGS_async_io;
+    options.readahead_size = FLAGS_readahead_size;
+    Iterator* iter = db_->NewIterator(options);
     int i = 0;
     int64_t bytes = 0;
     for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
@@ -864,6 +1291,35 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    options.async_io = FLAGS_async_io;
+    std::vector<std::string> key_storage(FLAGS_multiget_batch);
+    std::vector<Slice> keys(FLAGS_multiget_batch);
+    std::vector<std::string> values;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i += FLAGS_multiget_batch) {
+      const int n = std::min(FLAGS_multiget_batch, reads_ - i);
+      keys.resize(n);
+      for (int j = 0; j < n; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        key_storage[j] = key.slice().ToString();
+        keys[j] = key_storage[j];
+      }
+      std::vector<Status> statuses = db_->MultiGet(options, keys, &values);
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -983,6 +1439,33 @@ class Benchmark {
     }
   }
 
+  void ReadHotWhileScanning(ThreadState* thread) {
+    if (thread->tid > 0) {
+      ReadHot(thread);
+    } else {
+      // Special thread that keeps scanning the DB until other threads are
+      // done, pushing every block through the block cache.
+      bool done = false;
+      while (!done) {
+        Iterator* iter = db_->NewIterator(ReadOptions());
+        int i = 0;
+        for (iter->SeekToFirst(); iter->Valid() && !done; iter->Next()) {
+          if (++i % 1000 == 0) {
+            MutexLock l(&thread->shared->mu);
+            done = thread->shared->num_done + 1 >=
+                   thread->shared->num_initialized;
+          }
+        }
+        delete iter;
+        MutexLock l(&thread->shared->mu);
+        done = thread->shared->num_done + 1 >= thread->shared->num_initialized;
+      }
+
+      // Do not count any of the preceding work/delay in stats.
+      thread->stats.Start();
+    }
+  }
+
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
   void PrintStats(const char* key) {
@@ -1022,6 +1505,7 @@ int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
+  FLAGS_block_restart_interval = leveldb::Options().block_restart_interval;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
 
@@ -1045,12 +1529,46 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--use_direct_io=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_direct_io = n;
+    } else if (sscanf(argv[i], "--rate_limit_mb=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_rate_limit_mb = n;
+    } else if (sscanf(argv[i], "--full_table_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_table_filter = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--pin_l0_l1_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_l0_l1_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--multiget_batch=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_batch = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
@@ -1059,14 +1577,53 @@ int main(int argc, char** argv) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--block_restart_interval=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_block_restart_interval = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--mmap_read=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_mmap_read = n;
+    } else if (sscanf(argv[i], "--async_io=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_async_io = n;
+    } else if (sscanf(argv[i], "--readahead_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_readahead_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--bloom_type=", 13) == 0) {
+      FLAGS_bloom_type = argv[i] + 13;
+    } else if (strncmp(argv[i], "--bloom_type_per_level=", 23) == 0) {
+      FLAGS_bloom_type_per_level = argv[i] + 23;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--clock_table_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_table_cache = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
+    } else if (sscanf(argv[i], "--zstd_compression_level=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_zstd_compression_level = n;
+    } else if (sscanf(argv[i], "--zstd_max_dict_bytes=%d%c", &n, &junk) == 1) {
+      FLAGS_zstd_max_dict_bytes = n;
+    } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+      FLAGS_memtablerep = argv[i] + 14;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -1076,6 +1633,10 @@ int main(int argc, char** argv) {
   }
 
   leveldb::g_env = leveldb::Env::Default();
+  if (!FLAGS_mmap_read) {
+    static leveldb::CopyingReadEnv copying_read_env(leveldb::g_env);
+    leveldb::g_env = &copying_read_env;
+  }
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == nullptr) {
@@ -11,6 +11,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
@@ -26,10 +27,15 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   std::string fname = TableFileName(dbname, meta->number);
   if (iter->Valid()) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    s = (options.use_direct_writes ? env->NewDirectWritableFile(fname, &file)
+                                   : env->NewWritableFile(fname, &file));
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != nullptr) {
+      file = new RateLimitedWritableFile(file, options.rate_limiter,
+                                         Env::kHigh);
+    }
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
@@ -61,9 +67,11 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     file = nullptr;
 
     if (s.ok()) {
-      // Verify that the table is usable
+      // Verify that the table is usable.  New tables are opened as level-0
+      // tables; TableCache opens them again if they end up at a level
+      // whose tables are not pinned.
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, 0);
       s = it->status();
       delete it;
     }
@@ -24,6 +24,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -34,6 +35,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
@@ -42,15 +44,38 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr), sync(false), done(false), group(nullptr), cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  WriteGroup* group;  // Set when the writer must apply its own batch
   port::CondVar cv;
 };
 
+// A group of writes that has been logged by its leader and is waiting for
+// its turn to be applied to the memtable (pipelined writes only).
+struct DBImpl::WriteGroup {
+  explicit WriteGroup(Writer* leader)
+      : leader(leader),
+        batch(nullptr),
+        last_sequence(0),
+        mem(nullptr),
+        pending(0) {}
+
+  Writer* const leader;
+  std::vector<Writer*> writers;  // All writers of the group, leader included
+  WriteBatch* batch;             // Contents of the group
+  WriteBatch scratch;            // Backing store of batch if merged
+  SequenceNumber last_sequence;  // Sequence number of the last entry
+
+  // Used by concurrent memtable writes only.
+  MemTable* mem;   // Memtable the group is applied to
+  size_t pending;  // Number of writers still inserting
+  Status status;   // First insert error of the group
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
@@ -64,9 +89,12 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        has_begin(false),
+        has_end(false),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        imm_micros(0) {}
 
   Compaction* const compaction;
 
@@ -76,6 +104,14 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // User key range [begin, end) handled by this state when the compaction
+  // is split into subcompactions.  A missing bound is unbounded.
+  bool has_begin;
+  bool has_end;
+  std::string begin;
+  std::string end;
+  Compaction::Cursor cursor;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -83,25 +119,120 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
 };
 
+// Subcompactions of one compaction that run on their own threads.
+struct DBImpl::SubcompactionGroup {
+  struct Job {
+    SubcompactionGroup* group;
+    CompactionState* state;
+    Iterator* input;
+    Status status;
+  };
+
+  explicit SubcompactionGroup(DBImpl* db) : db(db), cv(&mu), remaining(0) {}
+
+  DBImpl* const db;
+  std::vector<Job> jobs;
+
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  int remaining GUARDED_BY(mu);  // Jobs that have not finished yet
+};
+
+// The memtables and version that a read looks at, referenced as a unit so
+// that readers can pin all of them without holding mutex_.
+struct DBImpl::SuperVersion {
+  SuperVersion(port::Mutex* mu, MemTable* mem, MemTable* imm,
+               Version* current, uint64_t number)
+      : mu(mu), mem(mem), imm(imm), current(current), number(number),
+        refs(1) {
+    mem->Ref();
+    if (imm != nullptr) imm->Ref();
+    current->Ref();
+  }
+
+  SuperVersion* Ref() {
+    refs.fetch_add(1, std::memory_order_relaxed);
+    return this;
+  }
+
+  // Returns true if the last reference was dropped, in which case the
+  // caller must call Cleanup() and delete the SuperVersion.
+  bool Unref() { return refs.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+  // Drop the references to the memtables and version.
+  void Cleanup() EXCLUSIVE_LOCKS_REQUIRED(mu) {
+    mem->Unref();
+    if (imm != nullptr) imm->Unref();
+    current->Unref();
+  }
+
+  port::Mutex* const mu;  // DBImpl::mutex_
+  MemTable* const mem;
+  MemTable* const imm;
+  Version* const current;
+  const uint64_t number;
+  std::atomic<int> refs;
+};
+
+namespace {
+
+// Values of DBImpl::local_super_version_ other than a SuperVersion.  A
+// slot is "in use" while its thread reads from the SuperVersion it held,
+// and "obsolete" (nullptr) once InstallSuperVersion() took it away.
+char super_version_in_use;
+void* const kSuperVersionInUse = &super_version_in_use;
+void* const kSuperVersionObsolete = nullptr;
+
+}  // namespace
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
   if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
-Options SanitizeOptions(const std::string& dbname,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src) {
+Options SanitizeOptions(
+    const std::string& dbname, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy, const Options& src,
+    const std::vector<InternalFilterPolicy>* ipolicies_per_level) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  if (ipolicies_per_level == nullptr) {
+    result.filter_policy_per_level.clear();
+  }
+  for (size_t i = 0; i < result.filter_policy_per_level.size(); i++) {
+    if (src.filter_policy_per_level[i] != nullptr) {
+      result.filter_policy_per_level[i] = &(*ipolicies_per_level)[i];
+    }
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  // Writes must not stop before level-0 compactions start.
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              config::kL0_CompactionTrigger, 1 << 20);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1 << 20);
+  if (result.hard_pending_compaction_bytes_limit > 0 &&
+      result.soft_pending_compaction_bytes_limit >
+          result.hard_pending_compaction_bytes_limit) {
+    result.soft_pending_compaction_bytes_limit =
+        result.hard_pending_compaction_bytes_limit;
+  }
+  if (result.delayed_write_rate == 0) {
+    result.delayed_write_rate = Options().delayed_write_rate;
+  }
+  if (result.memtable_factory != nullptr &&
+      !result.memtable_factory->IsInsertConcurrentlySupported()) {
+    result.allow_concurrent_memtable_write = false;
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,6 +249,36 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+// Return the compression of the tables written to "level".
+static CompressionType CompressionForLevel(const Options& options, int level) {
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (per_level.empty()) {
+    return options.compression;
+  }
+  return per_level[std::min<size_t>(level, per_level.size() - 1)];
+}
+
+// Return the filter policy of the tables written to "level".
+static const FilterPolicy* FilterPolicyForLevel(const Options& options,
+                                                int level) {
+  const std::vector<const FilterPolicy*>& per_level =
+      options.filter_policy_per_level;
+  if (per_level.empty()) {
+    return options.filter_policy;
+  }
+  return per_level[std::min<size_t>(level, per_level.size() - 1)];
+}
+
+static std::vector<InternalFilterPolicy> WrapFilterPolicies(
+    const std::vector<const FilterPolicy*>& policies,
+    const SliceTransform* prefix_extractor) {
+  std::vector<InternalFilterPolicy> result;
+  for (const FilterPolicy* policy : policies) {
+    result.emplace_back(policy, prefix_extractor);
+  }
+  return result;
+}
+
 static int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
@@ -126,9 +287,14 @@ static int TableCacheSize(const Options& sanitized_options) {
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
+      internal_filter_policies_per_level_(
+          WrapFilterPolicies(raw_options.filter_policy_per_level,
+                             raw_options.prefix_extractor)),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_, raw_options,
+                               &internal_filter_policies_per_level_)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -144,18 +310,43 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      last_allocated_sequence_(0),
+      background_compaction_scheduled_(0),
+      background_flush_scheduled_(false),
+      flush_in_progress_(false),
+      manifest_write_in_progress_(false),
       manual_compaction_(nullptr),
+      super_version_(nullptr),
+      super_version_number_(0),
+      local_super_version_(&DBImpl::UnrefLocalSuperVersion),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      write_controller_(options_),
+      write_delay_micros_(0),
+      write_stop_micros_(0) {
+  env_->IncBackgroundThreadsIfNeeded(options_.max_background_compactions,
+                                     Env::kLow);
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compaction_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
+  // Release the SuperVersions before the memtables and versions go away.
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, kSuperVersionObsolete);
+  for (void* ptr : cached) {
+    if (ptr != kSuperVersionInUse) {
+      UnrefSuperVersion(static_cast<SuperVersion*>(ptr));
+    }
+  }
+  if (super_version_ != nullptr) {
+    UnrefSuperVersion(super_version_);
+    super_version_ = nullptr;
+  }
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
@@ -240,6 +431,7 @@ void DBImpl::RemoveObsoleteFiles() {
   uint64_t number;
   FileType type;
   std::vector<std::string> files_to_delete;
+  std::vector<uint64_t> numbers_to_delete;
   for (std::string& filename : filenames) {
     if (ParseFileName(filename, &number, &type)) {
       bool keep = true;
@@ -268,8 +460,9 @@ void DBImpl::RemoveObsoleteFiles() {
           break;
       }
 
-      if (!keep) {
+      if (!keep && files_being_deleted_.insert(number).second) {
         files_to_delete.push_back(std::move(filename));
+        numbers_to_delete.push_back(number);
         if (type == kTableFile) {
           table_cache_->Evict(number);
         }
@@ -287,6 +480,9 @@ void DBImpl::RemoveObsoleteFiles() {
     env_->RemoveFile(dbname_ + "/" + filename);
   }
   mutex_.Lock();
+  for (uint64_t n : numbers_to_delete) {
+    files_being_deleted_.erase(n);
+  }
 }
 
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
@@ -438,7 +634,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_.memtable_factory);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -455,7 +651,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t file_number;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_number);
+      pending_outputs_.erase(file_number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -484,7 +682,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_.memtable_factory);
         mem_->Ref();
       }
     }
@@ -494,7 +692,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t file_number;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_number);
+      pending_outputs_.erase(file_number);
     }
     mem->Unref();
   }
@@ -503,21 +703,26 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
+  *file_number = meta.number;
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
+  Options table_options = options_;
+  table_options.compression = CompressionForLevel(options_, 0);
+  table_options.filter_policy = FilterPolicyForLevel(options_, 0);
+
   Status s;
   {
     mutex_.Unlock();
     /* 1. 根据 Immutable MemTable 构建 SSTable */
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, table_options, table_cache_, iter, &meta);
     mutex_.Lock();
   }
 
@@ -525,7 +730,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -536,6 +740,9 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != nullptr) {
       /* 2. 决定将 New SSTable 推送到哪一层 */
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      // Keep compactions picked before *edit is installed from writing
+      // into the range of the new file.
+      versions_->SetPendingFlushOutput(level, meta.smallest, meta.largest);
     }
     /* 新增了一个 SSTable，因此需要更新 VersionSet::new_files_ 字段 */
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
@@ -556,13 +763,16 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!flush_in_progress_.load(std::memory_order_relaxed));
+  flush_in_progress_.store(true, std::memory_order_release);
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
   /* 生成新的 SSTable，并将其推送至某一个 level */
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -575,14 +785,18 @@ void DBImpl::CompactMemTable() {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     /* 将最新的 VersionEdit 应用于 VersionSet 中 */
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  versions_->ClearPendingFlushOutput();
+  pending_outputs_.erase(file_number);
+  flush_in_progress_.store(false, std::memory_order_release);
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -669,22 +883,130 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // VersionSet::LogAndApply() releases the mutex while writing the
+  // MANIFEST, so concurrent background threads take turns here.
+  while (manifest_write_in_progress_) {
+    background_work_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  background_work_finished_signal_.SignalAll();
+  return s;
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  if (mem_ == nullptr) {
+    // Still recovering; DB::Open() installs the first SuperVersion.
+    return;
+  }
+  SuperVersion* old = super_version_;
+  const uint64_t number =
+      super_version_number_.load(std::memory_order_relaxed) + 1;
+  super_version_ =
+      new SuperVersion(&mutex_, mem_, imm_, versions_->current(), number);
+  super_version_number_.store(number, std::memory_order_release);
+
+  // Take away the SuperVersions cached by reader threads.  Threads that
+  // are in the middle of a read drop theirs in ReturnSuperVersion().
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, kSuperVersionObsolete);
+  for (void* ptr : cached) {
+    if (ptr != kSuperVersionInUse) {
+      UnrefSuperVersion(static_cast<SuperVersion*>(ptr));
+    }
+  }
+  if (old != nullptr) {
+    UnrefSuperVersion(old);
+  }
+}
+
+DBImpl::SuperVersion* DBImpl::GetAndRefSuperVersion() {
+  // The thread's slot owns one reference to the SuperVersion in it.  Mark
+  // the slot in use for the duration of the read so that a concurrent
+  // InstallSuperVersion() leaves that reference to us.
+  void* ptr = local_super_version_.Swap(kSuperVersionInUse);
+  assert(ptr != kSuperVersionInUse);
+  SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+  if (sv == kSuperVersionObsolete ||
+      sv->number != super_version_number_.load(std::memory_order_acquire)) {
+    MutexLock l(&mutex_);
+    if (sv != kSuperVersionObsolete) {
+      UnrefSuperVersion(sv);
+    }
+    sv = super_version_->Ref();
+  }
+  return sv;
+}
+
+void DBImpl::ReturnSuperVersion(SuperVersion* sv) {
+  void* expected = kSuperVersionInUse;
+  if (local_super_version_.CompareAndSwap(sv, expected)) {
+    return;  // Cached for the next read of this thread
+  }
+  // A new SuperVersion was installed while we were reading.
+  assert(expected == kSuperVersionObsolete);
+  if (sv->Unref()) {
+    MutexLock l(&mutex_);
+    sv->Cleanup();
+    delete sv;
+  }
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  if (sv->Unref()) {
+    sv->Cleanup();
+    delete sv;
+  }
+}
+
+void DBImpl::UnrefLocalSuperVersion(void* ptr) {
+  // Called when a reader thread exits, never while it is reading.  The DB
+  // drops its own reference to a SuperVersion only after Scrape() took it
+  // out of every slot, and Scrape() waits for exiting threads to run this
+  // handler, so the reference of the slot is never the last one.  That
+  // matters since the handler may not take mutex_, which is held across
+  // Scrape().
+  assert(ptr != kSuperVersionInUse);
+  SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+  const bool last = sv->Unref();
+  assert(!last);
+  (void)last;
+}
+
 /* Compaction 入口函数 */
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+    return;
+  }
+
+  /* Minor Compaction 拥有独立的高优先级线程池，不会排在耗时的 Major Compaction 之后 */
+  if (imm_ != nullptr && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGFlushWork, this, Env::kHigh);
+  }
+
+  if (background_compaction_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled as many compactions as allowed
+  } else if (manual_compaction_ == nullptr && !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    /* 设置 background_compaction_scheduled_ 标志位，并将 BGWork 方法加入线程池中 */
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    /* 增加 background_compaction_scheduled_ 计数，并将 BGWork 方法加入线程池中 */
+    background_compaction_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::kLow);
   }
 }
 
@@ -692,35 +1014,56 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compaction_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compaction_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A thread that found
+  // nothing to do does not reschedule: the compactions that kept it
+  // idle will do so when they finish.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
-  mutex_.AssertHeld();
-
-  /* 当 Immutable MemTable 不为空时，属于 Minor Compaction，即将 Immutable MemTable
-   * 写入至 level-0 或 level-1 或 level-2 中 */
-  if (imm_ != nullptr) {
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr &&
+             !flush_in_progress_.load(std::memory_order_relaxed)) {
     CompactMemTable();
-    return;
   }
 
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
+bool DBImpl::BackgroundCompaction() {
+  mutex_.AssertHeld();
+
   Compaction* c;
 
   /* 判断是否执行 Manual Compaction，由 DBImpl::CompactRange 触发 */
@@ -728,6 +1071,12 @@ void DBImpl::BackgroundCompaction() {
   InternalKey manual_end;
 
   if (is_manual) {
+    if (versions_->NumCompactionsInProgress() > 0 ||
+        flush_in_progress_.load(std::memory_order_relaxed)) {
+      // Manual compactions run alone; the work in progress reschedules
+      // us when it finishes.
+      return false;
+    }
     /* 手动对 SSTable 执行 Compaction，可能会造成 DB 的较大抖动 */
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
@@ -743,6 +1092,12 @@ void DBImpl::BackgroundCompaction() {
   } else {
     /* Size Compaction 或者是 Seek Compaction */
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
+    // Let another thread look for compaction work that does not
+    // overlap with this one.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -755,7 +1110,7 @@ void DBImpl::BackgroundCompaction() {
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
                        f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -764,12 +1119,14 @@ void DBImpl::BackgroundCompaction() {
         static_cast<unsigned long long>(f->number), c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
+    versions_->ReleaseCompaction(c);
   } else {
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
+    versions_->ReleaseCompaction(c);
     CleanupCompaction(compact);
     c->ReleaseInputs();
     RemoveObsoleteFiles();
@@ -797,6 +1154,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -834,9 +1192,20 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = (options_.use_direct_writes
+                  ? env_->NewDirectWritableFile(fname, &compact->outfile)
+                  : env_->NewWritableFile(fname, &compact->outfile));
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    if (options_.rate_limiter != nullptr) {
+      compact->outfile = new RateLimitedWritableFile(
+          compact->outfile, options_.rate_limiter, Env::kLow);
+    }
+    Options table_options = options_;
+    table_options.compression =
+        CompressionForLevel(options_, compact->compaction->level() + 1);
+    table_options.filter_policy =
+        FilterPolicyForLevel(options_, compact->compaction->level() + 1);
+    compact->builder = new TableBuilder(table_options, compact->outfile);
   }
   return s;
 }
@@ -877,7 +1246,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
     Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes,
+                                  compact->compaction->level() + 1);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -905,19 +1275,21 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
                                          out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+  Compaction* const c = compact->compaction;
 
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+  std::vector<std::string> boundaries;
+  c->GetSubcompactionBoundaries(options_.max_subcompactions, &boundaries);
+
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files in %d key ranges",
+      c->num_input_files(0), c->level(), c->num_input_files(1),
+      c->level() + 1, static_cast<int>(boundaries.size() + 1));
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(versions_->NumLevelFiles(c->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
   if (snapshots_.empty()) {
@@ -926,33 +1298,141 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  Status status;
+  if (boundaries.empty()) {
+    Iterator* input = versions_->MakeInputIterator(c);
 
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
+    // Release mutex while we're actually doing the compaction work
+    mutex_.Unlock();
+    status = CompactKeyRange(compact, input);
+    delete input;
+    mutex_.Lock();
+  } else {
+    // Every key range gets its own state and input iterator; all but the
+    // first range run on threads of their own.
+    SubcompactionGroup group(this);
+    group.jobs.resize(boundaries.size() + 1);
+    for (size_t i = 0; i < group.jobs.size(); i++) {
+      CompactionState* sub = new CompactionState(c);
+      sub->smallest_snapshot = compact->smallest_snapshot;
+      if (i > 0) {
+        sub->has_begin = true;
+        sub->begin = boundaries[i - 1];
+      }
+      if (i < boundaries.size()) {
+        sub->has_end = true;
+        sub->end = boundaries[i];
+      }
+      group.jobs[i].group = &group;
+      group.jobs[i].state = sub;
+      group.jobs[i].input = versions_->MakeInputIterator(c);
+    }
+
+    mutex_.Unlock();
+    group.mu.Lock();
+    group.remaining = static_cast<int>(group.jobs.size()) - 1;
+    group.mu.Unlock();
+    for (size_t i = 1; i < group.jobs.size(); i++) {
+      env_->StartThread(&DBImpl::BGSubcompactionWork, &group.jobs[i]);
+    }
+    SubcompactionGroup::Job* first = &group.jobs[0];
+    first->status = CompactKeyRange(first->state, first->input);
+    group.mu.Lock();
+    while (group.remaining > 0) {
+      group.cv.Wait();
+    }
+    group.mu.Unlock();
+    mutex_.Lock();
+
+    // Hand the outputs over in key order so that they are installed by a
+    // single edit, then drop the per-range states.
+    for (size_t i = 0; i < group.jobs.size(); i++) {
+      SubcompactionGroup::Job* job = &group.jobs[i];
+      CompactionState* sub = job->state;
+      if (status.ok()) {
+        status = job->status;
+      }
+      compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                              sub->outputs.end());
+      sub->outputs.clear();
+      compact->total_bytes += sub->total_bytes;
+      compact->imm_micros += sub->imm_micros;
+      delete job->input;
+      CleanupCompaction(sub);
+    }
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      stats.bytes_read += c->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[c->level() + 1].Add(stats);
 
-  input->SeekToFirst();
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  SubcompactionGroup::Job* job =
+      reinterpret_cast<SubcompactionGroup::Job*>(arg);
+  SubcompactionGroup* group = job->group;
+  job->status = group->db->CompactKeyRange(job->state, job->input);
+  MutexLock l(&group->mu);
+  group->remaining--;
+  group->cv.SignalAll();
+}
+
+Status DBImpl::CompactKeyRange(CompactionState* compact, Iterator* input) {
+  if (compact->has_begin) {
+    InternalKey begin(compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(begin.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    // Prioritize immutable compaction work.  Normally the kHigh pool
+    // takes care of it, but an Env that ignores priorities may have
+    // queued the memtable compaction behind this thread.
+    if (has_imm_.load(std::memory_order_relaxed) &&
+        !flush_in_progress_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr &&
+          !flush_in_progress_.load(std::memory_order_relaxed)) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      compact->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, compact->end) >= 0) {
+      // The rest belongs to the next key range
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -982,7 +1462,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -1041,31 +1522,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1134,7 +1590,9 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
-  MutexLock l(&mutex_);
+  SuperVersion* sv = GetAndRefSuperVersion();
+  // Pick the sequence number after pinning sv: everything up to it was
+  // written to sv->mem or to older memtables and tables.
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1143,39 +1601,117 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
+  // First look in the memtable, then in the immutable memtable (if any).
+  LookupKey lkey(key, snapshot);
+  if (sv->mem->Get(lkey, value, &s)) {
+    // Done
+  } else if (sv->imm != nullptr && sv->imm->Get(lkey, value, &s)) {
+    // Done
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats);
+    have_stat_update = true;
+  }
+
+  // Only reads that had to look at more than one file charge a seek to a
+  // file, and only those need mutex_.
+  if (have_stat_update && stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
+  return s;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const int n = static_cast<int>(keys.size());
+  std::vector<Status> statuses(n);
+  values->resize(n);
+
+  SuperVersion* sv = GetAndRefSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  // Lookup state of the keys missing from the memtables, in key order
+  std::vector<const LookupKey*> pending_keys;
+  std::vector<std::string*> pending_values;
+  std::vector<Status*> pending_statuses;
+  std::vector<Version::GetStats> stats;
+
+  // Visit the keys in sorted order so that neighbouring lookups touch
+  // the same memtable nodes, tables and blocks.
+  const Comparator* ucmp = user_comparator();
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  });
+
+  std::vector<LookupKey*> lkeys(n);
+  for (int i : order) {
+    lkeys[i] = new LookupKey(keys[i], snapshot);
+    std::string* value = &(*values)[i];
+    Status* s = &statuses[i];
     // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    if (sv->mem->Get(*lkeys[i], value, s)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (sv->imm != nullptr && sv->imm->Get(*lkeys[i], value, s)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      pending_keys.push_back(lkeys[i]);
+      pending_values.push_back(value);
+      pending_statuses.push_back(s);
     }
-    mutex_.Lock();
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (!pending_keys.empty()) {
+    const int num_pending = static_cast<int>(pending_keys.size());
+    std::vector<Status> results(num_pending);
+    stats.resize(num_pending);
+    sv->current->MultiGet(options, num_pending, pending_keys.data(),
+                          pending_values.data(), results.data(),
+                          stats.data());
+    for (int i = 0; i < num_pending; i++) {
+      *pending_statuses[i] = results[i];
+    }
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+  for (int i = 0; i < n; i++) {
+    delete lkeys[i];
+  }
+
+  bool need_stat_update = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (stats[i].seek_file != nullptr) {
+      need_stat_update = true;
+    }
+  }
+  if (need_stat_update) {
+    MutexLock l(&mutex_);
+    bool schedule = false;
+    for (size_t i = 0; i < stats.size(); i++) {
+      if (sv->current->UpdateStats(stats[i])) {
+        schedule = true;
+      }
+    }
+    if (schedule) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReturnSuperVersion(sv);
+  return statuses;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
@@ -1187,7 +1723,11 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed,
+                       options.prefix_same_as_start ? options_.prefix_extractor
+                                                    : nullptr,
+                       options.iterate_lower_bound,
+                       options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1224,6 +1764,11 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
  * 4. 更新 Sequence Number
  * */
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write ||
+      options_.allow_concurrent_memtable_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1239,18 +1784,23 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     return w.status;
   }
 
-  /* 确定写入策略，写入策略与 Level-0 的 SSTable 数量有关，具体的枚举值定义在 dbformat.h 中
+  /* 确定写入策略，写入策略与 Level-0 的 SSTable 数量以及待 Compaction 的数据量有关，
+   * 阈值定义在 Options 中
    *
-   * - 当 Level-0 的文件数量达到阈值 kL0_SlowdownWritesTrigger = 8 时，会延迟 1ms 写入，
-   *   等待 Level-0 向下 Compaction。本质上就是 sleep 1 毫秒。
-   * - 当 Level-0 的文件数量达到阈值 kL0_StopWritesTrigger = 12 时，将会停止写入，等待
+   * - 当 Level-0 的文件数量达到 level0_slowdown_writes_trigger 时，按照 write_controller_
+   *   计算出的速率延迟写入，该速率随 Level-0 文件数和待 Compaction 数据量的增加而降低。
+   * - 当 Level-0 的文件数量达到 level0_stop_writes_trigger 时，将会停止写入，等待
    *   Level-0 向下 Compaction */
   Status status = MakeRoomForWrite(updates == nullptr);
   /* 获取最后的 Sequence Number */
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(write_batch));
+    }
     /* 将 last_sequence + 1 写入至 write_batch.rep_ 的前 8 个字节 */
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
@@ -1308,9 +1858,179 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  // Writers that were taken into a group have left writers_ already.
+  while (!w.done && w.group == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
+    w.cv.Wait();
+  }
+  if (w.group != nullptr) {
+    // A leader made us part of a concurrently applied group.
+    ApplyWriterBatch(&w, w.group);
+    while (!w.done) {
+      w.cv.Wait();
+    }
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // Stage 1: as the head of writers_, log a group of writes.  Memtable
+  // switches wait in MakeRoomForWrite() until the groups of the second
+  // stage are done with mem_.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  WriteGroup group(&w);
+  Writer* last_writer = &w;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    group.batch = BuildBatchGroup(&last_writer, &group.scratch);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(group.batch));
+    }
+    WriteBatchInternal::SetSequence(group.batch, last_allocated_sequence_ + 1);
+    last_allocated_sequence_ += WriteBatchInternal::Count(group.batch);
+    group.last_sequence = last_allocated_sequence_;
+
+    // We can release the lock while logging since &w is the only
+    // thread that touches log_.
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(group.batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+
+  // Hand the log over to the next group.  Entering memtable_writers_ in
+  // the same critical section keeps the next leader from switching mem_
+  // under us.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.writers.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  const bool apply = status.ok() && updates != nullptr;
+  const bool concurrent = options_.allow_concurrent_memtable_write;
+  if (apply) {
+    memtable_writers_.push_back(&group);
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Stage 2 with concurrent memtable writes: every writer of the group
+  // inserts its own batch, without waiting for the groups before it.
+  if (apply && concurrent) {
+    group.mem = mem_;
+    group.pending = group.writers.size();
+    SequenceNumber sequence = WriteBatchInternal::Sequence(group.batch);
+    for (Writer* writer : group.writers) {
+      if (writer->batch != nullptr) {
+        WriteBatchInternal::SetSequence(writer->batch, sequence);
+        sequence += WriteBatchInternal::Count(writer->batch);
+      }
+      writer->group = &group;
+      if (writer != &w) {
+        writer->cv.Signal();
+      }
+    }
+    assert(sequence == group.last_sequence + 1);
+    ApplyWriterBatch(&w, &group);
+    while (!w.done) {
+      w.cv.Wait();
+    }
+    return w.status;
+  }
+
+  // Stage 2: apply the group to the memtable once the groups logged
+  // before it are done, so that sequence numbers become visible in order.
+  if (apply) {
+    while (memtable_writers_.front() != &group) {
+      w.cv.Wait();
+    }
+    MemTable* mem = mem_;
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(group.batch, mem);
+    mutex_.Lock();
+    versions_->SetLastSequence(group.last_sequence);
+    memtable_writers_.pop_front();
+    if (!memtable_writers_.empty()) {
+      memtable_writers_.front()->leader->cv.Signal();
+    } else {
+      // MakeRoomForWrite() may be waiting for the memtable to be idle.
+      background_work_finished_signal_.SignalAll();
+    }
+  }
+
+  for (Writer* ready : group.writers) {
+    if (ready != &w) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  return status;
+}
+
+void DBImpl::ApplyWriterBatch(Writer* w, WriteGroup* group) {
+  mutex_.AssertHeld();
+  Status s;
+  if (w->batch != nullptr) {
+    mutex_.Unlock();
+    s = WriteBatchInternal::InsertInto(w->batch, group->mem, true);
+    mutex_.Lock();
+  }
+  if (!s.ok() && group->status.ok()) {
+    group->status = s;
+  }
+  assert(group->pending > 0);
+  if (--group->pending > 0) {
+    return;
+  }
+
+  // Groups may finish out of order; make their sequence numbers visible
+  // in order by only publishing finished groups at the head of the queue.
+  while (!memtable_writers_.empty() &&
+         memtable_writers_.front()->pending == 0) {
+    WriteGroup* done_group = memtable_writers_.front();
+    memtable_writers_.pop_front();
+    versions_->SetLastSequence(done_group->last_sequence);
+    for (Writer* writer : done_group->writers) {
+      writer->status = done_group->status;
+      writer->done = true;
+      writer->cv.Signal();
+    }
+  }
+  if (memtable_writers_.empty()) {
+    // MakeRoomForWrite() may be waiting for the memtable to be idle.
+    background_work_finished_signal_.SignalAll();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+// REQUIRES: "scratch" is empty and not used by another write group.
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* scratch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1347,7 +2067,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = scratch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1366,26 +2086,36 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   bool allow_delay = !force;
   Status s;
   while (true) {
+    write_controller_.Update(versions_->NumLevelFiles(0),
+                             versions_->EstimatedPendingCompactionBytes());
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && write_controller_.IsDelayed()) {
 
-      /* 当 Level-0 的文件数达到阈值 kL0_SlowdownWritesTrigger = 8 时，延迟 1 毫秒写入 */
+      /* 当 Level-0 的文件数达到 level0_slowdown_writes_trigger，或者待 Compaction 的
+       * 数据量达到 soft_pending_compaction_bytes_limit 时，按照 write_controller_
+       * 给出的速率延迟写入 */
 
       // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
+      // L0 files or on the backlog of compactions.  Rather than delaying
+      // a single write by several seconds when we hit the hard limit,
+      // pace writes to a rate that drops as the limit gets closer, which
+      // also hands over some CPU to the compaction threads in case they
+      // share the same cores as the writers.  Sleep in short steps so
+      // that the pace follows the compactions.
+      const uint64_t now = env_->NowMicros();
+      const uint64_t delay = write_controller_.GetDelay(now);
+      if (delay == 0) {
+        allow_delay = false;  // This write is within the rate
+        continue;
+      }
       mutex_.Unlock();
-      /* Microseconds 和 Milliseconds 傻傻分不清，这里将睡眠 1 毫秒 */
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
+      env_->SleepForMicroseconds(
+          static_cast<int>(std::min<uint64_t>(delay, 1000)));
       mutex_.Lock();
+      write_delay_micros_ += env_->NowMicros() - now;
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1396,11 +2126,21 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       /* 等待 Immutable MemTable 刷盘 */
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
+      background_work_finished_signal_.Wait();
+      write_stop_micros_ += env_->NowMicros() - start_micros;
+    } else if (write_controller_.IsStopped()) {
+      // There are too many level-0 files or too many bytes to compact.
+      /* 当 Level-0 的文件数达到 level0_stop_writes_trigger，或者待 Compaction 的
+       * 数据量达到 hard_pending_compaction_bytes_limit 时，将停止写入 */
+      Log(options_.info_log,
+          "Too many L0 files or bytes to compact; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
-      // There are too many level-0 files.
-      /* 当 Level-0 的文件数达到阈值 kL0_StopWritesTrigger = 12 时，将停止写入 */
-      Log(options_.info_log, "Too many L0 files; waiting...\n");
+      write_stop_micros_ += env_->NowMicros() - start_micros;
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined writes that were logged to the current log are still
+      // being applied to mem_; let them finish before switching.
       background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
@@ -1414,7 +2154,10 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       WritableFile* lfile = nullptr;
 
       /* 生成新的预写日志文件 */
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      const std::string fname = LogFileName(dbname_, new_log_number);
+      s = (options_.use_direct_writes
+               ? env_->NewDirectWritableFile(fname, &lfile)
+               : env_->NewWritableFile(fname, &lfile));
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1428,10 +2171,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 
       /* 将 MemTable 转换成 Immutable MemTable */
       imm_ = mem_;
+      imm_->MarkReadOnly();
       has_imm_.store(true, std::memory_order_release);
       /* 初始化一个新的 MemTable */
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_, options_.memtable_factory);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
 
       /* 主动触发 Compaction */
@@ -1481,12 +2226,19 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
         value->append(buf);
       }
     }
+    std::snprintf(buf, sizeof(buf),
+                  "Write stall(sec): delayed %.3f stopped %.3f\n",
+                  write_delay_micros_ / 1e6, write_stop_micros_ / 1e6);
+    value->append(buf);
     return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
+    if (options_.compressed_block_cache != nullptr) {
+      total_usage += options_.compressed_block_cache->TotalCharge();
+    }
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
@@ -1498,6 +2250,42 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "delayed-write-rate") {
+    write_controller_.Update(versions_->NumLevelFiles(0),
+                             versions_->EstimatedPendingCompactionBytes());
+    char buf[50];
+    std::snprintf(
+        buf, sizeof(buf), "%llu",
+        static_cast<unsigned long long>(write_controller_.delayed_write_rate()));
+    value->append(buf);
+    return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      versions_->EstimatedPendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "rate-limiter") {
+    RateLimiter* const limiter = options_.rate_limiter;
+    if (limiter == nullptr) {
+      return false;
+    }
+    char buf[200];
+    std::snprintf(
+        buf, sizeof(buf),
+        "Rate(bytes/s) %lld\n"
+        "Priority  Bytes(MB) Wait(sec)\n"
+        "-----------------------------\n"
+        "flush     %9.0f %9.3f\n"
+        "compact   %9.0f %9.3f\n",
+        static_cast<long long>(limiter->GetBytesPerSecond()),
+        limiter->GetTotalBytesThrough(Env::kHigh) / 1048576.0,
+        limiter->GetTotalWaitMicros(Env::kHigh) / 1e6,
+        limiter->GetTotalBytesThrough(Env::kLow) / 1048576.0,
+        limiter->GetTotalWaitMicros(Env::kLow) / 1e6);
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1535,6 +2323,17 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses[i] = Get(options, keys[i], &(*values)[i]);
+  }
+  return statuses;
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1550,14 +2349,17 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    const std::string fname = LogFileName(dbname, new_log_number);
+    s = (options.use_direct_writes
+             ? options.env->NewDirectWritableFile(fname, &lfile)
+             : options.env->NewWritableFile(fname, &lfile));
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                 impl->options_.memtable_factory);
       impl->mem_->Ref();
     }
   }
@@ -1567,6 +2369,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->last_allocated_sequence_ = impl->versions_->LastSequence();
+    impl->InstallSuperVersion();
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
@@ -9,14 +9,17 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
@@ -42,6 +45,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  std::vector<Status> MultiGet(const ReadOptions& options,
+                               const std::vector<Slice>& keys,
+                               std::vector<std::string>* values) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -74,7 +80,10 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionGroup;
+  struct SuperVersion;
   struct Writer;
+  struct WriteGroup;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -127,24 +136,62 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Publish the current mem_, imm_ and version to readers as a new
+  // SuperVersion.  Must be called whenever one of them changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a referenced SuperVersion to read from.  Usually served from a
+  // per-thread cache without taking mutex_.  Hand it back with
+  // ReturnSuperVersion() once the read is done.
+  SuperVersion* GetAndRefSuperVersion() LOCKS_EXCLUDED(mutex_);
+  void ReturnSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+  void UnrefSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // UnrefHandler of local_super_version_.
+  static void UnrefLocalSuperVersion(void* ptr);
+
+  // Build a table from the contents of *mem and record it in *edit.  The
+  // number of the new table is stored in *file_number; it is left in
+  // pending_outputs_ so that the caller can install *edit before releasing it.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* file_number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Apply *edit to the current version.  Unlike VersionSet::LogAndApply(),
+  // may be called concurrently from several background threads.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write() when options_.enable_pipelined_write is set: the log append of
+  // a write group overlaps with the memtable insert of the previous group.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+  // With options_.allow_concurrent_memtable_write: insert w->batch into
+  // group->mem in parallel with the other writers, and publish the groups
+  // at the head of memtable_writers_ once all their writers are done.
+  void ApplyWriterBatch(Writer* w, WriteGroup* group)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlushWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Returns false if there was nothing this thread could compact.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the entries of "input" that fall in the key range of "compact"
+  // into new output files.  Runs without holding mutex_.
+  Status CompactKeyRange(CompactionState* compact, Iterator* input);
+  static void BGSubcompactionWork(void* arg);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -159,6 +206,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const std::vector<InternalFilterPolicy> internal_filter_policies_per_level_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -186,31 +234,73 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // With pipelined writes: groups that have been logged and are waiting
+  // to be, or are being, applied to mem_, in sequence number order.
+  std::deque<WriteGroup*> memtable_writers_ GUARDED_BY(mutex_);
+  // Last sequence number handed out to a write group.  May run ahead of
+  // versions_->LastSequence() while groups are in memtable_writers_.
+  SequenceNumber last_allocated_sequence_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Numbers of the files that a RemoveObsoleteFiles() call is deleting
+  // with mutex_ released.  Concurrent background work may call it again
+  // before they are gone.
+  std::set<uint64_t> files_being_deleted_ GUARDED_BY(mutex_);
+
+  // Number of background compactions that are scheduled or running.
+  int background_compaction_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a background memtable compaction been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is CompactMemTable() running?  Read without the lock by compaction
+  // threads to decide whether they should flush imm_ themselves.
+  std::atomic<bool> flush_in_progress_;
+
+  // Is a thread inside VersionSet::LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // What reads see: mem_, imm_ and the current version, referenced
+  // together.  super_version_number_ is bumped by every install.
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+  std::atomic<uint64_t> super_version_number_;
+
+  // Each reader thread caches a reference to the SuperVersion it last
+  // used.  InstallSuperVersion() scrapes these so that stale ones are
+  // released.
+  ThreadLocalPtr local_super_version_;
+
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Paces writes while compactions fall behind.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+
+  // Time that writes spent delayed by write_controller_, and waiting for
+  // a new memtable because the previous one or level-0 was full.
+  uint64_t write_delay_micros_ GUARDED_BY(mutex_);
+  uint64_t write_stop_micros_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
-Options SanitizeOptions(const std::string& db,
-                        const InternalKeyComparator* icmp,
-                        const InternalFilterPolicy* ipolicy,
-                        const Options& src);
+// it is not equal to src.info_log.  If ipolicies_per_level is null,
+// src.filter_policy_per_level is dropped; otherwise it must hold one
+// wrapper per entry of src.filter_policy_per_level.
+Options SanitizeOptions(
+    const std::string& db, const InternalKeyComparator* icmp,
+    const InternalFilterPolicy* ipolicy, const Options& src,
+    const std::vector<InternalFilterPolicy>* ipolicies_per_level = nullptr);
 
 }  // namespace leveldb
 
@@ -46,7 +46,8 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor,
+         const Slice* lower_bound, const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
@@ -54,7 +55,11 @@ class DBIter : public Iterator {
         direction_(kForward),
         valid_(false),
         rnd_(seed),
-        bytes_until_read_sampling_(RandomCompactionPeriod()) {}
+        bytes_until_read_sampling_(RandomCompactionPeriod()),
+        prefix_extractor_(prefix_extractor),
+        prefix_bounded_(false),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
@@ -101,6 +106,45 @@ class DBIter : public Iterator {
     }
   }
 
+  // Whether "user_key" may be returned under the prefix of the last Seek().
+  bool InPrefix(const Slice& user_key) const {
+    return !prefix_bounded_ || (prefix_extractor_->InDomain(user_key) &&
+                                prefix_extractor_->Transform(user_key) ==
+                                    Slice(prefix_));
+  }
+
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+
+  bool AtOrPastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // Positions iter_ at the first entry of "user_key" visible to this
+  // iterator, or the first entry after it.
+  void SeekInternal(const Slice& user_key) {
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(user_key, sequence_,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+  }
+
+  // Makes the iterator invalid if it is in prefix mode, where moving
+  // backwards is not supported.  Returns true if it did.
+  bool RejectReverseInPrefixMode() {
+    if (prefix_extractor_ == nullptr) {
+      return false;
+    }
+    status_ = Status::NotSupported("Prev() or SeekToLast() in prefix mode");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return true;
+  }
+
   // Picks the number of bytes that can be read until a compaction is scheduled.
   size_t RandomCompactionPeriod() {
     return rnd_.Uniform(2 * config::kReadBytesPeriod);
@@ -117,6 +161,16 @@ class DBIter : public Iterator {
   bool valid_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
+
+  // Non-null in prefix mode, where the iterator stops at the first key
+  // without prefix_ if prefix_bounded_ is set.
+  const SliceTransform* const prefix_extractor_;
+  std::string prefix_;
+  bool prefix_bounded_;
+
+  // ReadOptions::iterate_lower_bound and iterate_upper_bound.
+  const Slice* const lower_bound_;
+  const Slice* const upper_bound_;
 };
 
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
@@ -180,7 +234,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed &&
+        (!InPrefix(ikey.user_key) || AtOrPastUpperBound(ikey.user_key))) {
+      break;  // Past the keys with the prefix of the last Seek(), or the bound
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -208,6 +267,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 
 void DBIter::Prev() {
   assert(valid_);
+  if (RejectReverseInPrefixMode()) {
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
@@ -240,7 +302,11 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      const bool parsed = ParseKey(&ikey);
+      if (parsed && BeforeLowerBound(ikey.user_key)) {
+        break;  // iter_ is just before the entries of saved_key_, if any
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
@@ -278,10 +344,13 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
-  saved_key_.clear();
-  AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
+  SeekInternal(BeforeLowerBound(target) ? *lower_bound_ : target);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -292,7 +361,12 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  prefix_bounded_ = false;
+  if (lower_bound_ != nullptr) {
+    SeekInternal(*lower_bound_);
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -301,9 +375,26 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  if (RejectReverseInPrefixMode()) {
+    return;
+  }
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Step back from the first entry at or past the bound.
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+                      ParsedInternalKey(*upper_bound_, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +402,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor, lower_bound, upper_bound);
 }
 
 }  // namespace leveldb
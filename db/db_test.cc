@@ -6,7 +6,10 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstdio>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "benchmark/benchmark.h"
@@ -14,9 +17,13 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -130,7 +137,39 @@ class SpecialEnv : public EnvWrapper {
         non_writable_(false),
         manifest_sync_error_(false),
         manifest_write_error_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        hold_compactions_(false) {}
+
+  // Low priority (compaction) jobs scheduled after this call are queued
+  // until ReleaseCompactions() is called.  Flushes still run.
+  void HoldCompactions() {
+    MutexLock l(&hold_mu_);
+    hold_compactions_ = true;
+  }
+
+  void ReleaseCompactions() {
+    std::vector<std::pair<void (*)(void*), void*>> held;
+    {
+      MutexLock l(&hold_mu_);
+      hold_compactions_ = false;
+      held.swap(held_compactions_);
+    }
+    for (const auto& job : held) {
+      target()->Schedule(job.first, job.second, kLow);
+    }
+  }
+
+  void Schedule(void (*function)(void*), void* arg, Priority pri) override {
+    if (pri == kLow) {
+      MutexLock l(&hold_mu_);
+      if (hold_compactions_) {
+        held_compactions_.emplace_back(function, arg);
+        return;
+      }
+    }
+    target()->Schedule(function, arg, pri);
+  }
+  using EnvWrapper::Schedule;
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -226,6 +265,12 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+
+ private:
+  port::Mutex hold_mu_;
+  bool hold_compactions_ GUARDED_BY(hold_mu_);
+  std::vector<std::pair<void (*)(void*), void*>> held_compactions_
+      GUARDED_BY(hold_mu_);
 };
 
 class DBTest : public testing::Test {
@@ -238,6 +283,9 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    hash_skiplist_factory_ = NewHashSkipListRepFactory(4);
+    vector_factory_ = NewVectorRepFactory();
+    clock_cache_ = NewClockCache(8 << 20, 4096);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -249,6 +297,9 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete hash_skiplist_factory_;
+    delete vector_factory_;
+    delete clock_cache_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -274,9 +325,45 @@ class DBTest : public testing::Test {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFullFilter:
+        options.filter_policy = filter_policy_;
+        options.full_table_filter = true;
+        break;
+      case kPartitionedIndex:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.index_partition_size = 256;
+        break;
+      case kCachedIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.pin_l0_l1_index_and_filter_blocks = true;
+        break;
+      case kClockCache:
+        options.filter_policy = filter_policy_;
+        options.block_cache = clock_cache_;
+        options.cache_index_and_filter_blocks = true;
+        options.clock_table_cache = true;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        options.block_restart_interval = 4;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kHashSkipListRep:
+        options.memtable_factory = hash_skiplist_factory_;
+        break;
+      case kVectorRep:
+        options.memtable_factory = vector_factory_;
+        break;
       default:
         break;
     }
@@ -533,9 +620,27 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kFullFilter,
+    kPartitionedIndex,
+    kCachedIndexAndFilter,
+    kClockCache,
+    kDataBlockHashIndex,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kHashSkipListRep,
+    kVectorRep,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const MemTableRepFactory* hash_skiplist_factory_;
+  const MemTableRepFactory* vector_factory_;
+  Cache* clock_cache_;
   int option_config_;
 };
 
@@ -616,6 +721,23 @@ TEST_F(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetAfterMemTableSwitch) {
+  do {
+    // The first Get() caches the memtables and version of this thread;
+    // later reads must notice that they were replaced.
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_EQ("v1", Get("foo"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("foo", "v2"));
+    ASSERT_EQ("v2", Get("foo"));
+    Compact("a", "z");
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_LEVELDB_OK(Delete("foo"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("NOT_FOUND", Get("foo"));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetMemUsage) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -736,6 +858,74 @@ TEST_F(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over several levels, level-0 and the memtable.
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("k", "vk"));
+    Compact("a", "k");
+    ASSERT_LEVELDB_OK(Put("x", "vx"));
+    Compact("x", "y");
+    ASSERT_LEVELDB_OK(Put("f", "vf"));
+    ASSERT_LEVELDB_OK(Put("k", "vk2"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("m", "vm"));
+    ASSERT_LEVELDB_OK(Delete("x"));
+
+    std::vector<Slice> keys = {"x", "k", "missing", "a", "f", "m", "a", ""};
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db_->MultiGet(ReadOptions(), keys, &values);
+    ASSERT_EQ(keys.size(), statuses.size());
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_LEVELDB_OK(statuses[1]);
+    ASSERT_EQ("vk2", values[1]);
+    ASSERT_TRUE(statuses[2].IsNotFound());
+    ASSERT_LEVELDB_OK(statuses[3]);
+    ASSERT_EQ("va", values[3]);
+    ASSERT_LEVELDB_OK(statuses[4]);
+    ASSERT_EQ("vf", values[4]);
+    ASSERT_LEVELDB_OK(statuses[5]);
+    ASSERT_EQ("vm", values[5]);
+    ASSERT_LEVELDB_OK(statuses[6]);
+    ASSERT_EQ("va", values[6]);
+    ASSERT_TRUE(statuses[7].IsNotFound());
+
+    // Reads through a snapshot see neither the deletion nor the new key.
+    ReadOptions options;
+    options.snapshot = snapshot;
+    statuses = db_->MultiGet(options, keys, &values);
+    ASSERT_LEVELDB_OK(statuses[0]);
+    ASSERT_EQ("vx", values[0]);
+    ASSERT_TRUE(statuses[5].IsNotFound());
+    db_->ReleaseSnapshot(snapshot);
+
+    // Agree with Get() for many keys sharing tables and blocks.
+    std::vector<std::string> key_storage;
+    for (int i = 0; i < 1000; i += 7) {
+      char buf[100];
+      std::snprintf(buf, sizeof(buf), "key%06d", i);
+      key_storage.push_back(buf);
+      if (i % 3 == 0) {
+        ASSERT_LEVELDB_OK(Put(buf, std::string(buf) + "v"));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+    keys.assign(key_storage.begin(), key_storage.end());
+    statuses = db_->MultiGet(ReadOptions(), keys, &values);
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::string expected = Get(key_storage[i]);
+      if (expected == "NOT_FOUND") {
+        ASSERT_TRUE(statuses[i].IsNotFound());
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(expected, values[i]);
+      }
+    }
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -985,6 +1175,83 @@ TEST_F(DBTest, IterMultiWithDeleteAndCompaction) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, IterateBounds) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    ASSERT_LEVELDB_OK(Put("g", "vg"));
+    ASSERT_LEVELDB_OK(Put("h", "vh"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Delete("d"));
+    ASSERT_LEVELDB_OK(Put("f", "vf"));
+    ASSERT_LEVELDB_OK(Put("g", "vg2"));
+
+    const Slice lower("bb");
+    const Slice upper("g");
+    ReadOptions ro;
+    ro.iterate_lower_bound = &lower;
+    ro.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(ro);
+
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "e->ve");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "f->vf");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "f->vf");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "e->ve");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    // Seeks outside the bounds, and changes of direction near them.
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("ff");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("f");
+    ASSERT_EQ(IterStatus(iter), "f->vf");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->Seek("e");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "e->ve");
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    // A single bound.
+    ro.iterate_lower_bound = nullptr;
+    iter = db_->NewIterator(ro);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "a->va");
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "f->vf");
+    delete iter;
+    ro.iterate_lower_bound = &lower;
+    ro.iterate_upper_bound = nullptr;
+    iter = db_->NewIterator(ro);
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "h->vh");
+    iter->Seek("b");
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, Recover) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1125,6 +1392,143 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, CompressionPerLevel) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;  // Large write buffer
+  // Codecs that are not built in fall back to storing blocks uncompressed,
+  // so this runs whatever the build supports.
+  options.compression_per_level = {kLZ4Compression, kZstdCompression,
+                                   kSnappyCompression};
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 80; i++) {
+    // Compressible values so that every codec gets to compress blocks.
+    std::string v;
+    test::CompressibleString(&rnd, 0.25, 100000, &v);
+    values.push_back(v);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+
+  // Reopening moves updates to level-0
+  Reopen(&options);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 1);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+  for (int i = 0; i < 80; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST_F(DBTest, CompressionDictionary) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.compression = kZstdCompression;
+  options.zstd_max_dict_bytes = 4096;
+  options.zstd_max_train_bytes = 32 * 1024;
+  options.block_size = 512;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Without zstd in the build the blocks are stored uncompressed, but the
+  // buffering of blocks for training still has to preserve the index and
+  // filter entries of every block.
+  const int kNumKeys = 5000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "{\"id\":" + std::to_string(i) +
+                                      ",\"state\":\"ok\"}"));
+  }
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ("{\"id\":" + std::to_string(i) + ",\"state\":\"ok\"}",
+              Get(Key(i)));
+  }
+
+  // The filters of the buffered blocks were built as well.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), 3 * kNumKeys / 100);
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+// Return a compression type supported by this build, or kNoCompression.
+static CompressionType SupportedCompression() {
+  std::string out;
+  const char in[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  if (port::Snappy_Compress(in, sizeof(in), &out)) {
+    return kSnappyCompression;
+  }
+  if (port::LZ4_Compress(in, sizeof(in), &out)) {
+    return kLZ4Compression;
+  }
+  if (port::Zstd_Compress(1, in, sizeof(in), &out)) {
+    return kZstdCompression;
+  }
+  return kNoCompression;
+}
+
+TEST_F(DBTest, CompressedBlockCache) {
+  const CompressionType type = SupportedCompression();
+  if (type == kNoCompression) {
+    GTEST_SKIP() << "skipping compressed block cache test";
+  }
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = type;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  const int N = 1000;
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < N; i++) {
+    std::string v;
+    test::CompressibleString(&rnd, 0.25, 500, &v);
+    values.push_back(v);
+    ASSERT_LEVELDB_OK(Put(Key(i), v));
+  }
+  Compact("a", "z");
+
+  // The first pass reads every block from the file once.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  ASSERT_GT(env_->random_read_counter_.Read(), 0);
+  const size_t charge = options.compressed_block_cache->TotalCharge();
+  ASSERT_GT(charge, 0);
+  ASSERT_LT(charge, N * 500 / 2);
+
+  // The second pass only uncompresses cached blocks.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  Close();
+  delete options.block_cache;
+  delete options.compressed_block_cache;
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1132,8 +1536,9 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles =
+      config::kNumLevels + Options().level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1144,6 +1549,101 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
   }
 }
 
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Write enough data to keep several levels busy at once.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 150000; i++) {
+    std::string key = Key(rnd.Uniform(100000));
+    if (rnd.OneIn(10)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      model.erase(key);
+    } else {
+      std::string value = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+  }
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    for (const auto& kv : model) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(kv.first, iter->key().ToString());
+      ASSERT_EQ(kv.second, iter->value().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.max_file_size = 1 << 20;
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Spread the data over several files of one level.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 6000; i++) {
+    std::string value = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+    model[Key(i)] = value;
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 2);
+
+  // Overwrite and delete keys across the whole range and merge them into
+  // those files, keeping a snapshot of the old state alive.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  const std::map<std::string, std::string> old_model = model;
+  for (int i = 0; i < 6000; i += 3) {
+    if (i % 2 == 0) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+      model.erase(Key(i));
+    } else {
+      std::string value = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+      model[Key(i)] = value;
+    }
+  }
+  db_->CompactRange(nullptr, nullptr);
+
+  for (const auto& kv : old_model) {
+    ASSERT_EQ(kv.second, Get(kv.first, snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(nullptr, nullptr);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    for (const auto& kv : model) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(kv.first, iter->key().ToString());
+      ASSERT_EQ(kv.second, iter->value().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    Reopen(&options);
+  }
+}
+
 TEST_F(DBTest, SparseMerge) {
   Options options = CurrentOptions();
   options.compression = kNoCompression;
@@ -1942,6 +2442,581 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, FullTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Populate a lower level with 2KB-granular filters and, after switching
+  // formats, a small level-0 table with a full filter on top of it.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.full_table_filter = true;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(8 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.index_partition_size = 256;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys, which also loads the partitions into the cache.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  std::vector<Slice> keys;
+  std::vector<std::string> key_strings;
+  for (int i = 0; i < 100; i++) {
+    key_strings.push_back(Key(i * 97));
+  }
+  for (const std::string& k : key_strings) {
+    keys.push_back(k);
+  }
+  std::vector<std::string> values;
+  std::vector<Status> statuses =
+      db_->MultiGet(ReadOptions(), keys, &values);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_LEVELDB_OK(statuses[i]);
+    ASSERT_EQ(key_strings[i], values[i]);
+  }
+
+  // Lookup missing keys.  The filter partitions reject almost all of them
+  // without reading index partitions or data blocks.  Blocks of mmap-ed
+  // files are not cached, so each lookup reads one filter partition per
+  // sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2 * N + 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static std::string PrefixKey(int tenant, int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "t%03d/obj%04d", tenant, i);
+  return std::string(buf);
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  const int kTenants = 30;
+  const int kKeysPerTenant = 20;
+  for (int format = 0; format < 3; format++) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.prefix_extractor = NewFixedPrefixTransform(4);
+    options.create_if_missing = true;
+    options.full_table_filter = (format == 1);
+    options.partition_index_and_filters = (format == 2);
+    DestroyAndReopen(&options);
+
+    // Three tables whose key ranges all overlap but which hold disjoint
+    // sets of prefixes, one per level.
+    for (int group = 0; group < 3; group++) {
+      for (int t = group; t < kTenants; t += 3) {
+        for (int i = 0; i < kKeysPerTenant; i++) {
+          ASSERT_LEVELDB_OK(Put(PrefixKey(t, i), "v"));
+        }
+      }
+      dbfull()->TEST_CompactMemTable();
+    }
+    ASSERT_EQ("1,1,1", FilesPerLevel());
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+
+    ReadOptions ro;
+    ro.prefix_same_as_start = true;
+    env_->random_read_counter_.Reset();
+    for (int t = 0; t < kTenants; t++) {
+      Iterator* iter = db_->NewIterator(ro);
+      int count = 0;
+      for (iter->Seek(PrefixKey(t, 5)); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(PrefixKey(t, 5 + count), iter->key().ToString());
+        count++;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      ASSERT_EQ(kKeysPerTenant - 5, count);
+      delete iter;
+    }
+    const int prefix_reads = env_->random_read_counter_.Read();
+
+    // Without prefix mode every table has to be positioned.
+    env_->random_read_counter_.Reset();
+    for (int t = 0; t < kTenants; t++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      iter->Seek(PrefixKey(t, 5));
+      ASSERT_EQ(PrefixKey(t, 5), iter->key().ToString());
+      delete iter;
+    }
+    const int total_reads = env_->random_read_counter_.Read();
+    std::fprintf(stderr, "format %d: %d prefix seeks => %d vs %d reads\n",
+                 format, kTenants, prefix_reads, total_reads);
+    ASSERT_LT(prefix_reads, total_reads);
+
+    // Absent prefixes and reverse iteration.
+    Iterator* iter = db_->NewIterator(ro);
+    iter->Seek("t999/");
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    iter->Seek(PrefixKey(3, 0));
+    ASSERT_TRUE(iter->Valid());
+    iter->Prev();
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_TRUE(iter->status().IsNotSupportedError());
+    delete iter;
+
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+    delete options.prefix_extractor;
+  }
+}
+
+TEST_F(DBTest, IterateBoundsSkipTables) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  // Three tables with disjoint key ranges.
+  for (int t = 0; t < 3; t++) {
+    for (int i = t * 100; i < (t + 1) * 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  const std::string lower_key = Key(100);
+  const std::string upper_key = Key(200);
+  const Slice lower(lower_key);
+  const Slice upper(upper_key);
+  ReadOptions ro;
+  ro.iterate_lower_bound = &lower;
+  ro.iterate_upper_bound = &upper;
+
+  // Forward scans.  Without bounds, the scan has to read the first block
+  // of the next table to see that it is done.
+  env_->random_read_counter_.Reset();
+  Iterator* iter = db_->NewIterator(ro);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  delete iter;
+  const int bounded_reads = env_->random_read_counter_.Read();
+
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ReadOptions());
+  for (iter->Seek(lower); iter->Valid() && iter->key().compare(upper) < 0;
+       iter->Next()) {
+  }
+  delete iter;
+  const int unbounded_reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "forward scan: %d reads, %d without bounds\n",
+               bounded_reads, unbounded_reads);
+  ASSERT_LT(bounded_reads, unbounded_reads);
+
+  // Backward scans, which would read the last block of the previous table.
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ro);
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  delete iter;
+  const int bounded_reverse_reads = env_->random_read_counter_.Read();
+
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek(upper);
+  for (iter->Prev(); iter->Valid() && iter->key().compare(lower) >= 0;
+       iter->Prev()) {
+  }
+  delete iter;
+  const int unbounded_reverse_reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "backward scan: %d reads, %d without bounds\n",
+               bounded_reverse_reads, unbounded_reverse_reads);
+  ASSERT_LT(bounded_reverse_reads, unbounded_reverse_reads);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, AsyncIO) {
+  // Tables in a memory env are read into heap buffers, which can be cached.
+  std::unique_ptr<Env> mem_env(NewMemEnv(Env::Default()));
+  Options options = CurrentOptions();
+  options.env = mem_env.get();
+  options.create_if_missing = true;
+  options.block_size = 256;
+  options.block_cache = NewLRUCache(8 << 20);
+  const std::string dbname = "/async_io_db";
+  DestroyDB(dbname, options);
+  DB* db = nullptr;
+  ASSERT_LEVELDB_OK(DB::Open(options, dbname, &db));
+
+  // Two tables, with every other key.
+  const int N = 2000;
+  for (int t = 0; t < 2; t++) {
+    for (int i = t; i < N; i += 4) {
+      ASSERT_LEVELDB_OK(db->Put(WriteOptions(), Key(i), Key(i)));
+    }
+    ASSERT_LEVELDB_OK(reinterpret_cast<DBImpl*>(db)->TEST_CompactMemTable());
+  }
+
+  ReadOptions async_options;
+  async_options.async_io = true;
+  for (int round = 0; round < 2; round++) {
+    options.block_cache->Prune();
+    std::vector<std::string> key_storage;
+    for (int i = 0; i < N; i += 3) {
+      key_storage.push_back(Key(i));
+    }
+    std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db->MultiGet(async_options, keys, &values);
+    for (size_t i = 0; i < keys.size(); i++) {
+      if ((i * 3) % 4 < 2) {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(key_storage[i], values[i]);
+      } else {
+        ASSERT_TRUE(statuses[i].IsNotFound());
+      }
+    }
+
+    options.block_cache->Prune();
+    Iterator* iter = db->NewIterator(async_options);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(Key(count / 2 * 4 + count % 2), iter->key().ToString());
+      count++;
+    }
+    ASSERT_EQ(N / 2, count);
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    // Again with the tables merged into one.
+    db->CompactRange(nullptr, nullptr);
+  }
+
+  delete db;
+  DestroyDB(dbname, options);
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, DirectIO) {
+  Options options = CurrentOptions();
+  options.use_direct_io_for_compaction_reads = true;
+  options.compaction_readahead_size = 64 * 1024;
+  options.use_direct_writes = true;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Enough data for several flushes and compactions.
+  const int N = 20000;
+  Random rnd(301);
+  std::vector<std::string> values(N);
+  for (int i = 0; i < N; i++) {
+    values[i] = RandomString(&rnd, 100);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+
+  // The last writes are only in the log.
+  ASSERT_LEVELDB_OK(Put(Key(0), "v0"));
+  Reopen(&options);
+  ASSERT_EQ("v0", Get(Key(0)));
+  for (int i = 1; i < N; i++) {
+    ASSERT_EQ(i % 2 == 0 ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, WriteStall) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.level0_slowdown_writes_trigger = 4;
+  // Far enough above the slowdown trigger that the held compactions below
+  // never stop writes.
+  options.level0_stop_writes_trigger = 20;
+  options.delayed_write_rate = 100 << 10;
+  Reopen(&options);
+
+  // With compactions held back, flushes of the same keys pile up in
+  // level-0 until writes must be paced.
+  env_->HoldCompactions();
+  std::string property;
+  uint64_t delayed_rate = 0;
+  bool ok = true;
+  Random rnd(301);
+  int i = 0;
+  for (; ok && delayed_rate == 0 && i < 10000; i++) {
+    ok = Put(Key(i % 1000), RandomString(&rnd, 100)).ok() &&
+         db_->GetProperty("leveldb.delayed-write-rate", &property);
+    if (ok) delayed_rate = std::stoull(property);
+  }
+  // Keep writing while delayed, so that the writer actually sleeps.
+  for (int j = 0; ok && j < 100; j++, i++) {
+    ok = Put(Key(i % 1000), RandomString(&rnd, 100)).ok();
+  }
+  env_->ReleaseCompactions();
+
+  ASSERT_TRUE(ok);
+  ASSERT_GT(delayed_rate, 0);
+  ASSERT_LE(delayed_rate, options.delayed_write_rate);
+  for (int k = 0; k < 1000; k++) {
+    ASSERT_EQ(100, Get(Key(k)).size());
+  }
+
+  double delayed = 0, stopped = 0;
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &property));
+  const size_t pos = property.find("Write stall(sec): ");
+  ASSERT_NE(pos, std::string::npos);
+  ASSERT_EQ(2, std::sscanf(property.c_str() + pos,
+                           "Write stall(sec): delayed %lf stopped %lf",
+                           &delayed, &stopped));
+  ASSERT_GT(delayed, 0);
+
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &property));
+  ASSERT_EQ("0", property);
+}
+
+TEST_F(DBTest, RateLimiter) {
+  std::string property;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.rate-limiter", &property));
+
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(100 << 20, 10 * 1000));
+  Options options = CurrentOptions();
+  options.rate_limiter = limiter.get();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Keys in random order, so that compactions merge tables rather than
+  // move them.
+  const int N = 10000;
+  Random rnd(301);
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(rnd.Uniform(N)), RandomString(&rnd, 100)));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+
+  // Flushes wrote at least the values, and compactions read them back.
+  ASSERT_GE(limiter->GetTotalBytesThrough(Env::kHigh), N * 100);
+  ASSERT_GE(limiter->GetTotalBytesThrough(Env::kLow), N * 100);
+  ASSERT_TRUE(db_->GetProperty("leveldb.rate-limiter", &property));
+  ASSERT_NE(property.find("Rate(bytes/s) 104857600"), std::string::npos);
+  Close();
+}
+
+TEST_F(DBTest, PinL0L1IndexAndFilterBlocks) {
+  // Tables in a memory env are read into heap buffers, which can be cached,
+  // unlike the blocks of mmap-ed files.
+  std::unique_ptr<Env> mem_env(NewMemEnv(Env::Default()));
+  for (bool pin : {false, true}) {
+    Options options = CurrentOptions();
+    options.env = mem_env.get();
+    options.create_if_missing = true;
+    options.block_cache = NewLRUCache(8 << 20);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.cache_index_and_filter_blocks = true;
+    options.pin_l0_l1_index_and_filter_blocks = pin;
+    const std::string dbname = "/pin_db";
+    DestroyDB(dbname, options);
+    DB* db = nullptr;
+    ASSERT_LEVELDB_OK(DB::Open(options, dbname, &db));
+    DBImpl* dbi = reinterpret_cast<DBImpl*>(db);
+    auto files_at_level = [db](int level) {
+      std::string property;
+      EXPECT_TRUE(db->GetProperty(
+          "leveldb.num-files-at-level" + NumberToString(level), &property));
+      return std::stoi(property);
+    };
+
+    const int N = 1000;
+    std::string value;
+    auto put_and_flush = [&]() {
+      for (int i = 0; i < N; i++) {
+        ASSERT_LEVELDB_OK(db->Put(WriteOptions(), Key(i), Key(i)));
+      }
+      ASSERT_LEVELDB_OK(dbi->TEST_CompactMemTable());
+      for (int i = 0; i < N; i++) {
+        ASSERT_LEVELDB_OK(db->Get(ReadOptions(), Key(i), &value));
+        ASSERT_EQ(Key(i), value);
+      }
+    };
+
+    // The first table is pushed past level 1, so although the flush opened
+    // it as a level-0 table, its blocks are not pinned once it is read.
+    put_and_flush();
+    ASSERT_EQ(1, files_at_level(config::kMaxMemCompactLevel));
+    options.block_cache->Prune();
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+
+    // The next one overlaps it and stays at level 1, where the index and
+    // filter survive a full eviction if they are pinned.
+    put_and_flush();
+    ASSERT_EQ(1, files_at_level(1));
+    options.block_cache->Prune();
+    if (pin) {
+      ASSERT_GT(options.block_cache->TotalCharge(), N * 10 / 8);
+    } else {
+      ASSERT_EQ(0, options.block_cache->TotalCharge());
+    }
+
+    // Compaction replaces the table with one that is not pinned.
+    dbi->TEST_CompactRange(1, nullptr, nullptr);
+    ASSERT_EQ(0, files_at_level(1));
+    options.block_cache->Prune();
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(db->Get(ReadOptions(), Key(i), &value));
+      ASSERT_EQ(Key(i), value);
+    }
+
+    delete db;
+    DestroyDB(dbname, options);
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
+TEST_F(DBTest, FilterPolicyPerLevel) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const FilterPolicy* ribbon = NewRibbonFilterPolicy(10);
+  options.filter_policy_per_level = {bloom, bloom, ribbon};
+  Reopen(&options);
+
+  // Populate level 3 with ribbon filters, and flush a small table with
+  // bloom filters on top of it.  Memtable flushes go to level 2 at most.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(NumTableFilesAtLevel(2), 1);
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(3), 0);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete bloom;
+  delete ribbon;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2039,6 +3114,102 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct PipelinedWriterState {
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+void PipelinedWriterBody(void* arg) {
+  PipelinedWriterState* state = reinterpret_cast<PipelinedWriterState*>(arg);
+  Random rnd(301 + state->id);
+  for (int i = 0; i < 2000; i++) {
+    char key[100];
+    std::snprintf(key, sizeof(key), "%d.%06d", state->id, i);
+    WriteOptions options;
+    options.sync = rnd.OneIn(50);
+    ASSERT_LEVELDB_OK(state->db->Put(options, key, std::string(1000, 'v')));
+  }
+  state->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, PipelinedWriteAcrossMemTableSwitches) {
+  Options options = CurrentOptions();
+  options.enable_pipelined_write = true;
+  options.write_buffer_size = 64 << 10;  // Switch memtables often
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  PipelinedWriterState state[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    state[id].db = db_;
+    state[id].id = id;
+    state[id].done.store(false, std::memory_order_release);
+    env_->StartThread(PipelinedWriterBody, &state[id]);
+  }
+  for (int id = 0; id < kNumThreads; id++) {
+    while (!state[id].done.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int id = 0; id < kNumThreads; id++) {
+      for (int i = 0; i < 2000; i++) {
+        char key[100];
+        std::snprintf(key, sizeof(key), "%d.%06d", id, i);
+        ASSERT_EQ(std::string(1000, 'v'), Get(key));
+      }
+    }
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, ConcurrentMemTableWrite) {
+  Options options = CurrentOptions();
+  options.allow_concurrent_memtable_write = true;
+  options.write_buffer_size = 64 << 10;  // Switch memtables often
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  PipelinedWriterState state[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    state[id].db = db_;
+    state[id].id = id;
+    state[id].done.store(false, std::memory_order_release);
+    env_->StartThread(PipelinedWriterBody, &state[id]);
+  }
+  for (int id = 0; id < kNumThreads; id++) {
+    while (!state[id].done.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+
+  // Every write is visible, in a single pass over the DB as well.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(std::string(1000, 'v'), iter->value().ToString());
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(kNumThreads * 2000, count);
+
+  Reopen(&options);
+  for (int id = 0; id < kNumThreads; id++) {
+    for (int i = 0; i < 2000; i++) {
+      char key[100];
+      std::snprintf(key, sizeof(key), "%d.%06d", id, i);
+      ASSERT_EQ(std::string(1000, 'v'), Get(key));
+    }
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -111,7 +112,28 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == nullptr) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Add the prefix of each run of user keys that share one, which are
+  // adjacent since the keys are sorted.
+  std::vector<Slice> keys_and_prefixes(keys, keys + n);
+  Slice last_prefix;
+  bool has_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_prefix || prefix != last_prefix) {
+        keys_and_prefixes.push_back(prefix);
+        last_prefix = prefix;
+        has_prefix = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(keys_and_prefixes.data(),
+                             static_cast<int>(keys_and_prefixes.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -28,15 +29,11 @@ static const int kNumLevels = 7;
 /* 当 Level-0 存在 4 个 SSTable 时将会触发 Level-0 向其它 level 的 Compaction */
 static const int kL0_CompactionTrigger = 4;
 
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-/* 当 Level-0 的 SSTable 数量达到 8 时，将会减缓 leveldb 的写入速率，其实就是睡眠 1 秒。
+// The limits on level-0 files at which writes slow down and stop are
+// Options::level0_slowdown_writes_trigger and
+// Options::level0_stop_writes_trigger.
+/* Level-0 减缓写入与停止写入的阈值可通过 Options 配置，
  * 具体的代码逻辑可参考 db_impl.cc/MakeRoomForWrite() 方法 */
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-/* Level-0 最多只能有 12 个 SSTable，一旦达到该阈值，将会停止外部写入，等到 Level-0 向下
- * Compaction 的完成 */
-static const int kL0_StopWritesTrigger = 12;
 
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
@@ -163,9 +160,15 @@ class InternalKeyComparator : public Comparator {
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
 
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+  // If prefix_extractor is non-null, the filters also hold the prefixes of
+  // the user keys, which can be checked by passing an internal key whose
+  // user key is the prefix to KeyMayMatch().
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                const SliceTransform* prefix_extractor = nullptr)
+      : user_policy_(p), prefix_extractor_(prefix_extractor) {}
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
@@ -4,6 +4,7 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/skiplist.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -19,12 +20,79 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 /* MemTable 在初始化时 refs_ 为 0 */
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+namespace {
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+// The default representation: a skiplist that keeps entries sorted.
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableRep::KeyComparator& cmp, Arena* arena)
+      : list_(Comparator(&cmp), arena) {}
+
+  void Insert(const char* entry) override { list_.Insert(entry); }
+
+  bool IsInsertConcurrentlySupported() const override { return true; }
+
+  void InsertConcurrently(const char* entry) override {
+    list_.InsertConcurrently(entry);
+  }
+
+  const char* Lookup(const char* target) const override {
+    List::Iterator iter(&list_);
+    iter.Seek(target);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  MemTableRep::Iterator* NewIterator() const override {
+    return new Iterator(&list_);
+  }
+
+ private:
+  struct Comparator {
+    explicit Comparator(const MemTableRep::KeyComparator* c) : cmp(c) {}
+    int operator()(const char* a, const char* b) const { return (*cmp)(a, b); }
+
+    const MemTableRep::KeyComparator* cmp;
+  };
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+  typedef SkipList<const char*, Comparator> List;
+
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    explicit Iterator(const List* list) : iter_(list) {}
+
+    bool Valid() const override { return iter_.Valid(); }
+    const char* key() const override { return iter_.key(); }
+    void Next() override { iter_.Next(); }
+    void Prev() override { iter_.Prev(); }
+    void Seek(const char* target) override { iter_.Seek(target); }
+    void SeekToFirst() override { iter_.SeekToFirst(); }
+    void SeekToLast() override { iter_.SeekToLast(); }
+
+   private:
+    List::Iterator iter_;
+  };
+
+  List list_;
+};
+
+}  // namespace
+
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const MemTableRepFactory* factory)
+    : comparator_(comparator),
+      refs_(0),
+      table_(factory != nullptr
+                 ? factory->CreateMemTableRep(comparator_, &arena_)
+                 : new SkipListRep(comparator_, &arena_)) {}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete table_;
+}
+
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage();
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr,
                                         const char* bptr) const {
@@ -46,36 +114,37 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator : public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+  explicit MemTableIterator(MemTableRep* table)
+      : iter_(table->NewIterator()) {}
 
   MemTableIterator(const MemTableIterator&) = delete;
   MemTableIterator& operator=(const MemTableIterator&) = delete;
 
-  ~MemTableIterator() override = default;
+  ~MemTableIterator() override { delete iter_; }
 
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
   Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   Status status() const override { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* const iter_;
   std::string tmp_;  // For passing to EncodeKey
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() { return new MemTableIterator(table_); }
 
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+                   const Slice& value, bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -87,7 +156,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -96,14 +166,17 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (concurrent) {
+    table_->InsertConcurrently(buf);
+  } else {
+    table_->Insert(buf);
+  }
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  const char* entry = table_->Lookup(memkey.data());
+  if (entry != nullptr) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -113,7 +186,6 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     // Check that it belongs to same user key.  We do not check the
     // sequence number since the Seek() call above should have skipped
     // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
@@ -8,8 +8,8 @@
 #include <string>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "leveldb/memtablerep.h"
 #include "util/arena.h"
 
 namespace leveldb {
@@ -26,7 +26,11 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // Entries are kept in a representation created by "factory", or in a
+  // skiplist if "factory" is null.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    const MemTableRepFactory* factory = nullptr);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -58,10 +62,13 @@ class MemTable {
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  //
+  // If "concurrent" is true, Add() may run in several threads at once, but
+  // not at the same time as a non-concurrent Add().
   /* 注意 MemTable 并没有实现 update 和 delete 方法，而是使用 Add() 方法去做追加，并且
    * 删除的 Key 会被打上 `kTypeDeletion` 的标记 */
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
-           const Slice& value);
+           const Slice& value, bool concurrent = false);
 
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
@@ -69,19 +76,19 @@ class MemTable {
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
+  // Called when the memtable becomes immutable; no Add() may follow.
+  void MarkReadOnly() { table_->MarkReadOnly(); }
+
  private:
   friend class MemTableIterator;
   friend class MemTableBackwardIterator;
 
-  struct KeyComparator {
+  struct KeyComparator : public MemTableRep::KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
+    int operator()(const char* a, const char* b) const override;
   };
 
-  /* 使用 Skip List 来实现 MemTable */
-  typedef SkipList<const char*, KeyComparator> Table;
-
   ~MemTable();  // Private since only Unref() should be used to delete it
 
   /* 比较器 */
@@ -92,7 +99,8 @@ class MemTable {
 
   /* 分配 MemTable 的内存分配器，arena_ 的工作原理也比较简单 */
   Arena arena_;
-  Table table_;
+  /* 默认使用 Skip List 来实现 MemTable */
+  MemTableRep* const table_;
 };
 
 }  // namespace leveldb
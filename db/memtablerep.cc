@@ -0,0 +1,302 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+MemTableRep::KeyComparator::~KeyComparator() = default;
+
+MemTableRep::Iterator::~Iterator() = default;
+
+MemTableRep::~MemTableRep() = default;
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  assert(false);  // Only reps that support it may be used concurrently
+  Insert(entry);
+}
+
+Slice MemTableRep::UserKey(const char* entry) {
+  uint32_t len;
+  const char* p = GetVarint32Ptr(entry, entry + 5, &len);
+  return ExtractUserKey(Slice(p, len));
+}
+
+MemTableRepFactory::~MemTableRepFactory() = default;
+
+namespace {
+
+typedef std::vector<const char*> EntryVector;
+
+// Orders entries for the std algorithms.
+struct EntryLess {
+  explicit EntryLess(const MemTableRep::KeyComparator* c) : cmp(c) {}
+  bool operator()(const char* a, const char* b) const {
+    return (*cmp)(a, b) < 0;
+  }
+
+  const MemTableRep::KeyComparator* cmp;
+};
+
+// Iterates over a sorted vector of entries that it shares ownership of.
+class SortedVectorIterator : public MemTableRep::Iterator {
+ public:
+  SortedVectorIterator(std::shared_ptr<const EntryVector> entries,
+                       const MemTableRep::KeyComparator* cmp)
+      : entries_(std::move(entries)), cmp_(cmp), pos_(entries_->size()) {}
+
+  bool Valid() const override { return pos_ < entries_->size(); }
+
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+
+  void Seek(const char* target) override {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            EntryLess(cmp_)) -
+           entries_->begin();
+  }
+
+  void SeekToFirst() override { pos_ = 0; }
+
+  void SeekToLast() override {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const std::shared_ptr<const EntryVector> entries_;
+  const MemTableRep::KeyComparator* const cmp_;
+  size_t pos_;  // entries_->size() if not valid
+};
+
+// Hashes a fixed-length prefix of the user key into buckets that are
+// skiplists of their own.  Buckets are created on first use from the arena.
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableRep::KeyComparator& cmp, Arena* arena,
+                  size_t prefix_length, size_t bucket_count)
+      : cmp_(&cmp),
+        arena_(arena),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(new std::atomic<Bucket*>[bucket_count]) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~HashSkipListRep() override {
+    // The buckets live in the arena and own no other memory.
+    delete[] buckets_;
+  }
+
+  void Insert(const char* entry) override {
+    std::atomic<Bucket*>* slot = &buckets_[BucketIndex(entry)];
+    Bucket* bucket = slot->load(std::memory_order_relaxed);
+    if (bucket == nullptr) {
+      char* mem = arena_->AllocateAligned(sizeof(Bucket));
+      bucket = new (mem) Bucket(Comparator(cmp_), arena_);
+      // Publish the empty bucket with a 'release store' so that readers
+      // observe a fully initialized skiplist.
+      slot->store(bucket, std::memory_order_release);
+    }
+    bucket->Insert(entry);
+  }
+
+  const char* Lookup(const char* target) const override {
+    // All entries of a user key share a bucket, so the other buckets need
+    // not be searched.
+    Bucket* bucket =
+        buckets_[BucketIndex(target)].load(std::memory_order_acquire);
+    if (bucket == nullptr) {
+      return nullptr;
+    }
+    Bucket::Iterator iter(bucket);
+    iter.Seek(target);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  MemTableRep::Iterator* NewIterator() const override {
+    // Collect the entries of all buckets into a single sorted run.
+    std::shared_ptr<EntryVector> entries = std::make_shared<EntryVector>();
+    for (size_t i = 0; i < bucket_count_; i++) {
+      Bucket* bucket = buckets_[i].load(std::memory_order_acquire);
+      if (bucket != nullptr) {
+        Bucket::Iterator iter(bucket);
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+          entries->push_back(iter.key());
+        }
+      }
+    }
+    std::sort(entries->begin(), entries->end(), EntryLess(cmp_));
+    return new SortedVectorIterator(std::move(entries), cmp_);
+  }
+
+ private:
+  struct Comparator {
+    explicit Comparator(const MemTableRep::KeyComparator* c) : cmp(c) {}
+    int operator()(const char* a, const char* b) const { return (*cmp)(a, b); }
+
+    const MemTableRep::KeyComparator* cmp;
+  };
+
+  typedef SkipList<const char*, Comparator> Bucket;
+
+  size_t BucketIndex(const char* entry) const {
+    Slice user_key = UserKey(entry);
+    const size_t n = std::min(user_key.size(), prefix_length_);
+    return Hash(user_key.data(), n, 0) % bucket_count_;
+  }
+
+  const MemTableRep::KeyComparator* const cmp_;
+  Arena* const arena_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  std::atomic<Bucket*>* const buckets_;
+};
+
+// Appends entries in insertion order and sorts them when they are read.
+// The sorted order is cached until the next insert, and becomes permanent
+// once the rep is read-only.
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const MemTableRep::KeyComparator& cmp, size_t reserve)
+      : cmp_(&cmp), read_only_(false) {
+    entries_.reserve(reserve);
+  }
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mutex_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    sorted_.reset();
+  }
+
+  // Inserts only hold mutex_ for a push_back.
+  bool IsInsertConcurrentlySupported() const override { return true; }
+
+  void InsertConcurrently(const char* entry) override { Insert(entry); }
+
+  const char* Lookup(const char* target) const override {
+    std::shared_ptr<const EntryVector> sorted = Sorted();
+    EntryVector::const_iterator iter = std::lower_bound(
+        sorted->begin(), sorted->end(), target, EntryLess(cmp_));
+    return iter == sorted->end() ? nullptr : *iter;
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mutex_);
+    if (!read_only_) {
+      std::sort(entries_.begin(), entries_.end(), EntryLess(cmp_));
+      sorted_ = std::make_shared<EntryVector>();
+      sorted_->swap(entries_);
+      read_only_ = true;
+    }
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    MutexLock l(&mutex_);
+    size_t usage = entries_.capacity() * sizeof(const char*);
+    if (sorted_ != nullptr) {
+      usage += sorted_->capacity() * sizeof(const char*);
+    }
+    return usage;
+  }
+
+  MemTableRep::Iterator* NewIterator() const override {
+    return new SortedVectorIterator(Sorted(), cmp_);
+  }
+
+ private:
+  std::shared_ptr<const EntryVector> Sorted() const {
+    MutexLock l(&mutex_);
+    if (sorted_ == nullptr) {
+      sorted_ = std::make_shared<EntryVector>(entries_);
+      std::sort(sorted_->begin(), sorted_->end(), EntryLess(cmp_));
+    }
+    return sorted_;
+  }
+
+  const MemTableRep::KeyComparator* const cmp_;
+  mutable port::Mutex mutex_;
+  EntryVector entries_ GUARDED_BY(mutex_);  // Unsorted unless read_only_
+  // Sorted copy of entries_, or all entries once read_only_.
+  mutable std::shared_ptr<EntryVector> sorted_ GUARDED_BY(mutex_);
+  bool read_only_ GUARDED_BY(mutex_);
+};
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+ public:
+  HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length), bucket_count_(bucket_count) {}
+
+  MemTableRep* CreateMemTableRep(const MemTableRep::KeyComparator& cmp,
+                                 Arena* arena) const override {
+    return new HashSkipListRep(cmp, arena, prefix_length_, bucket_count_);
+  }
+
+  const char* Name() const override { return "leveldb.HashSkipListRep"; }
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  explicit VectorRepFactory(size_t reserve) : reserve_(reserve) {}
+
+  MemTableRep* CreateMemTableRep(const MemTableRep::KeyComparator& cmp,
+                                 Arena* arena) const override {
+    return new VectorRep(cmp, reserve_);
+  }
+
+  const char* Name() const override { return "leveldb.VectorRep"; }
+
+  bool IsInsertConcurrentlySupported() const override { return true; }
+
+ private:
+  const size_t reserve_;
+};
+
+}  // namespace
+
+const MemTableRepFactory* NewHashSkipListRepFactory(size_t prefix_length,
+                                                    size_t bucket_count) {
+  return new HashSkipListRepFactory(prefix_length,
+                                    bucket_count > 0 ? bucket_count : 1);
+}
+
+const MemTableRepFactory* NewVectorRepFactory(size_t reserve) {
+  return new VectorRepFactory(reserve);
+}
+
+}  // namespace leveldb
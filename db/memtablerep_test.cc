@@ -0,0 +1,166 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+enum RepType { kSkipList, kHashSkipList, kVector };
+
+// Orders encoded internal keys like the memtable does.
+struct InternalKeyLess {
+  bool operator()(const std::string& a, const std::string& b) const {
+    static const InternalKeyComparator cmp(BytewiseComparator());
+    return cmp.Compare(a, b) < 0;
+  }
+};
+
+typedef std::map<std::string, std::string, InternalKeyLess> Model;
+
+class MemTableRepTest : public testing::TestWithParam<RepType> {
+ public:
+  MemTableRepTest() : cmp_(BytewiseComparator()), factory_(nullptr) {
+    switch (GetParam()) {
+      case kSkipList:
+        break;
+      case kHashSkipList:
+        // Few buckets and a short prefix so that buckets are shared.
+        factory_ = NewHashSkipListRepFactory(3, 7);
+        break;
+      case kVector:
+        factory_ = NewVectorRepFactory();
+        break;
+    }
+    mem_ = new MemTable(cmp_, factory_);
+    mem_->Ref();
+  }
+
+  ~MemTableRepTest() {
+    mem_->Unref();
+    delete factory_;
+  }
+
+  // Look up "key" at "seq", returning "NOT_FOUND" or "DELETED" if the
+  // memtable holds no value for it.
+  std::string Get(const std::string& key, SequenceNumber seq) {
+    LookupKey lkey(key, seq);
+    std::string value;
+    Status s;
+    if (!mem_->Get(lkey, &value, &s)) {
+      return "NOT_FOUND";
+    }
+    return s.ok() ? value : "DELETED";
+  }
+
+  // Check that iteration yields exactly the contents of "model".
+  void CheckIteration(const Model& model) {
+    Iterator* iter = mem_->NewIterator();
+    Model::const_iterator it = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != model.end());
+      ASSERT_EQ(it->first, iter->key().ToString());
+      ASSERT_EQ(it->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(it == model.end());
+
+    // Backwards as well.
+    Model::const_reverse_iterator rit = model.rbegin();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), ++rit) {
+      ASSERT_TRUE(rit != model.rend());
+      ASSERT_EQ(rit->first, iter->key().ToString());
+    }
+    ASSERT_TRUE(rit == model.rend());
+    delete iter;
+  }
+
+ protected:
+  InternalKeyComparator cmp_;
+  const MemTableRepFactory* factory_;
+  MemTable* mem_;
+};
+
+TEST_P(MemTableRepTest, Empty) {
+  ASSERT_EQ("NOT_FOUND", Get("foo", 100));
+  Iterator* iter = mem_->NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(Slice("foo"));
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST_P(MemTableRepTest, PutDeleteAndGet) {
+  mem_->Add(1, kTypeValue, "foo", "v1");
+  mem_->Add(2, kTypeValue, "bar", "v2");
+  mem_->Add(3, kTypeValue, "foo", "v3");
+  mem_->Add(4, kTypeDeletion, "bar", "");
+
+  ASSERT_EQ("NOT_FOUND", Get("foo", 0));
+  ASSERT_EQ("v1", Get("foo", 1));
+  ASSERT_EQ("v1", Get("foo", 2));
+  ASSERT_EQ("v3", Get("foo", 3));
+  ASSERT_EQ("v2", Get("bar", 2));
+  ASSERT_EQ("v2", Get("bar", 3));
+  ASSERT_EQ("DELETED", Get("bar", 4));
+  ASSERT_EQ("NOT_FOUND", Get("baz", 10));
+  ASSERT_EQ("NOT_FOUND", Get("fo", 10));
+}
+
+TEST_P(MemTableRepTest, RandomizedAgainstModel) {
+  Random rnd(test::RandomSeed());
+  Model model;
+  SequenceNumber seq = 0;
+  for (int i = 0; i < 2000; i++) {
+    // Keys of varying length, many sharing a prefix.
+    std::string key = "k" + std::to_string(rnd.Uniform(500));
+    std::string value = std::to_string(i);
+    seq++;
+    mem_->Add(seq, kTypeValue, key, value);
+    InternalKey ikey(key, seq, kTypeValue);
+    model[ikey.Encode().ToString()] = value;
+
+    if (i % 200 == 0) {
+      // Reads may be interleaved with writes.
+      ASSERT_EQ(value, Get(key, seq));
+    }
+  }
+
+  for (int i = 0; i < 500; i++) {
+    std::string key = "k" + std::to_string(i);
+    // The newest value of the key is the first model entry for it.
+    InternalKey ikey(key, kMaxSequenceNumber, kValueTypeForSeek);
+    Model::const_iterator it = model.lower_bound(ikey.Encode().ToString());
+    if (it != model.end() && ExtractUserKey(it->first) == Slice(key)) {
+      ASSERT_EQ(it->second, Get(key, seq));
+    } else {
+      ASSERT_EQ("NOT_FOUND", Get(key, seq));
+    }
+  }
+
+  CheckIteration(model);
+  mem_->MarkReadOnly();
+  CheckIteration(model);
+  ASSERT_EQ("NOT_FOUND", Get("k", seq));
+}
+
+INSTANTIATE_TEST_SUITE_P(MemTableReps, MemTableRepTest,
+                         testing::Values(kSkipList, kHashSkipList, kVector));
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -6,6 +6,8 @@
 
 #include <atomic>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
@@ -365,6 +367,88 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert disjoint keys with InsertConcurrently() while a
+// reader checks that the list it observes is always sorted.
+class ConcurrentInsertState {
+ public:
+  static constexpr int kWriters = 4;
+  static constexpr int kPerWriter = 20000;
+
+  ConcurrentInsertState()
+      : list(Comparator(), &arena), next_id(0), running(0), stop(false) {}
+
+  Arena arena;
+  SkipList<Key, Comparator> list;
+  std::atomic<int> next_id;
+  std::atomic<int> running;
+  std::atomic<bool> stop;
+};
+
+static void ConcurrentInserter(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  const int id = state->next_id.fetch_add(1);
+  Random rnd(1000 + id);
+  // Insert the keys of this writer in a shuffled order.
+  std::vector<Key> keys;
+  for (int i = 0; i < ConcurrentInsertState::kPerWriter; i++) {
+    keys.push_back(static_cast<Key>(i) * ConcurrentInsertState::kWriters + id);
+  }
+  for (size_t i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  for (Key k : keys) {
+    state->list.InsertConcurrently(k);
+  }
+  state->running.fetch_sub(1);
+}
+
+static void SortedOrderReader(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  while (!state->stop.load(std::memory_order_acquire)) {
+    SkipList<Key, Comparator>::Iterator iter(&state->list);
+    bool first = true;
+    Key last = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      if (!first) {
+        EXPECT_LT(last, iter.key());
+      }
+      first = false;
+      last = iter.key();
+    }
+  }
+  state->running.fetch_sub(1);
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  ConcurrentInsertState state;
+  state.running.store(ConcurrentInsertState::kWriters + 1);
+  Env::Default()->StartThread(SortedOrderReader, &state);
+  for (int i = 0; i < ConcurrentInsertState::kWriters; i++) {
+    Env::Default()->StartThread(ConcurrentInserter, &state);
+  }
+  while (state.running.load() > 1) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  state.stop.store(true, std::memory_order_release);
+  while (state.running.load() > 0) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  const Key total =
+      ConcurrentInsertState::kWriters * ConcurrentInsertState::kPerWriter;
+  SkipList<Key, Comparator>::Iterator iter(&state.list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < total; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < total; k += 97) {
+    ASSERT_TRUE(state.list.Contains(k));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,8 +4,10 @@
 
 #include "db/table_cache.h"
 
+#include "db/dbformat.h"
 #include "db/filename.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
 
@@ -14,6 +16,7 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  bool pinned;  // Whether the index and filter blocks of table are pinned
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
@@ -23,28 +26,118 @@ static void DeleteEntry(const Slice& key, void* value) {
   delete tf;
 }
 
+static void DeleteTableAndFile(void* arg, void* ignored) {
+  DeleteEntry(Slice(), arg);
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
   cache->Release(h);
 }
 
+// The iterate bounds of a table iterator, as internal keys.  A user key is
+// < lower_bound if and only if all its internal keys are < the smallest
+// internal key of lower_bound, and similarly for upper_bound.
+struct InternalBounds {
+  std::string lower_key;
+  std::string upper_key;
+  Slice lower_bound;
+  Slice upper_bound;
+};
+
+static void DeleteInternalBounds(void* arg, void* ignored) {
+  delete reinterpret_cast<InternalBounds*>(arg);
+}
+
+// Iterator over a table for ReadOptions::prefix_same_as_start, which only
+// needs the entries >= the target of a Seek() that share its prefix.  A
+// Seek() whose prefix the filters of the table rule out leaves the
+// iterator invalid without reading the index or data blocks.
+class TableCache::PrefixFilterIterator : public Iterator {
+ public:
+  PrefixFilterIterator(Iterator* iter, const Table* table,
+                       const ReadOptions& options,
+                       const SliceTransform* prefix_extractor)
+      : iter_(iter),
+        table_(table),
+        options_(options),
+        prefix_extractor_(prefix_extractor),
+        skipped_(false) {}
+
+  ~PrefixFilterIterator() override { delete iter_; }
+
+  bool Valid() const override { return !skipped_ && iter_->Valid(); }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+
+  void Seek(const Slice& target) override {
+    const Slice user_key = ExtractUserKey(target);
+    skipped_ = false;
+    if (prefix_extractor_->InDomain(user_key)) {
+      prefix_key_.clear();
+      AppendInternalKey(
+          &prefix_key_,
+          ParsedInternalKey(prefix_extractor_->Transform(user_key),
+                            kMaxSequenceNumber, kValueTypeForSeek));
+      skipped_ = !table_->PrefixMayMatch(options_, target, prefix_key_);
+    }
+    if (!skipped_) {
+      iter_->Seek(target);
+    }
+  }
+
+  void SeekToFirst() override {
+    skipped_ = false;
+    iter_->SeekToFirst();
+  }
+
+  void SeekToLast() override {
+    skipped_ = false;
+    iter_->SeekToLast();
+  }
+
+ private:
+  Iterator* const iter_;
+  const Table* const table_;
+  const ReadOptions options_;
+  const SliceTransform* const prefix_extractor_;
+  bool skipped_;
+  std::string prefix_key_;
+};
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(options.clock_table_cache ? NewClockCache(entries, 1)
+                                       : NewLRUCache(entries)) {}
 
 TableCache::~TableCache() { delete cache_; }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             int level, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
+  const bool pin = options_.pin_l0_l1_index_and_filter_blocks && level >= 0 &&
+                   level <= 1;
   *handle = cache_->Lookup(key);
+  if (*handle != nullptr && level >= 0 &&
+      reinterpret_cast<TableAndFile*>(cache_->Value(*handle))->pinned != pin) {
+    // The file moved to another level since the table was opened, by a
+    // flush pushed past level-0 or by a trivial move.  Open it again, so
+    // that the pins follow the level.  Readers of the old table keep it
+    // until they release it.
+    cache_->Release(*handle);
+    cache_->Erase(key);
+    *handle = nullptr;
+  }
   if (*handle == nullptr) {
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
@@ -59,6 +152,9 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    if (s.ok() && pin) {
+      table->PinIndexAndFilter();
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
@@ -69,6 +165,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->pinned = pin;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -77,19 +174,52 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  int level, Table** tableptr) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-  Iterator* result = table->NewIterator(options);
+  InternalBounds* bounds = nullptr;
+  Iterator* result;
+  if (options.iterate_lower_bound == nullptr &&
+      options.iterate_upper_bound == nullptr) {
+    result = table->NewIterator(options);
+  } else {
+    // The table orders internal keys, so the bounds have to be converted.
+    bounds = new InternalBounds;
+    ReadOptions table_options = options;
+    if (options.iterate_lower_bound != nullptr) {
+      AppendInternalKey(&bounds->lower_key,
+                        ParsedInternalKey(*options.iterate_lower_bound,
+                                          kMaxSequenceNumber,
+                                          kValueTypeForSeek));
+      bounds->lower_bound = bounds->lower_key;
+      table_options.iterate_lower_bound = &bounds->lower_bound;
+    }
+    if (options.iterate_upper_bound != nullptr) {
+      AppendInternalKey(&bounds->upper_key,
+                        ParsedInternalKey(*options.iterate_upper_bound,
+                                          kMaxSequenceNumber,
+                                          kValueTypeForSeek));
+      bounds->upper_bound = bounds->upper_key;
+      table_options.iterate_upper_bound = &bounds->upper_bound;
+    }
+    result = table->NewIterator(table_options);
+  }
+  if (options.prefix_same_as_start && options_.prefix_extractor != nullptr) {
+    result = new PrefixFilterIterator(result, table, options,
+                                      options_.prefix_extractor);
+  }
+  if (bounds != nullptr) {
+    result->RegisterCleanup(&DeleteInternalBounds, bounds, nullptr);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -97,12 +227,55 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewCompactionIterator(const ReadOptions& options,
+                                            uint64_t file_number,
+                                            uint64_t file_size, int level) {
+  if (!options_.use_direct_io_for_compaction_reads) {
+    return NewIterator(options, file_number, file_size, level);
+  }
+
+  // Compactions read each table once, so there is nothing to gain from
+  // caching its blocks or reading its filter.
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  Status s = env_->NewDirectRandomAccessFile(
+      TableFileName(dbname_, file_number), &file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if (env_->NewDirectRandomAccessFile(old_fname, &file).ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    Options table_options = options_;
+    table_options.block_cache = nullptr;
+    table_options.compressed_block_cache = nullptr;
+    table_options.filter_policy = nullptr;
+    table_options.filter_policy_per_level.clear();
+    table_options.cache_index_and_filter_blocks = false;
+    s = Table::Open(table_options, file, file_size, &table);
+  }
+  if (!s.ok()) {
+    delete file;
+    return NewErrorIterator(s);
+  }
+
+  TableAndFile* tf = new TableAndFile;
+  tf->file = file;
+  tf->table = table;
+  tf->pinned = false;
+  Iterator* result = table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, tf, nullptr);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, int level, const Slice& k,
+                       void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
@@ -111,6 +284,21 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, int level, int n,
+                            const Slice* keys, void* const* args,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&)) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalMultiGet(options, n, keys, args, handle_result);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
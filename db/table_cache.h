@@ -25,26 +25,49 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  "level" is the level
+  // of the file, or -1 if it is not known; it decides whether the index
+  // and filter blocks of the table are pinned in the block cache, and a
+  // table opened at a level that pins differently is opened again.  A
+  // level of -1 uses the table as it is.  If "tableptr" is
   // non-null, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, int level,
+                        Table** tableptr = nullptr);
+
+  // Like NewIterator(), for reading the table as input of a compaction.
+  // With options.use_direct_io_for_compaction_reads, the table is opened
+  // apart from the cache, from a file read with direct I/O.
+  Iterator* NewCompactionIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size,
+                                  int level);
 
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
+             uint64_t file_size, int level, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Like Get() for the n internal keys in keys[0,n-1], sorted in
+  // increasing order.  Results for keys[i] are passed along with args[i].
+  // The table is looked up once for all of the keys.
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, int level, int n, const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  class PrefixFilterIterator;
+
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
 
   Env* const env_;
   const std::string dbname_;
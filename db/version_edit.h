@@ -17,7 +17,8 @@ class VersionSet;
 
 /* 记录了一个 SSTable 的元信息 */
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0), being_compacted(false) {}
 
   int refs;             /* 引用计数，表示当前 SSTable 被多少个 Version 所引用 */
   int allowed_seeks;    /* 当前 SSTable 允许被 Seek 的次数 */
@@ -25,6 +26,7 @@ struct FileMetaData {
   uint64_t file_size;   /* SSTable 文件大小 */
   InternalKey smallest; /* 最小 Key 值 */
   InternalKey largest;  /* 最大 Key 值 */
+  bool being_compacted; /* 是否正在作为某个 Compaction 的输入，受 DBImpl::mutex_ 保护 */
 };
 
 /* Version N + VersionEdit => Version N+1，VersionEdit 记录了增量 */
@@ -167,25 +167,59 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 20-byte value containing the file number and file size, both
+// encoded using EncodeFixed64, and the level encoded using EncodeFixed32.
 class Version::LevelFileNumIterator : public Iterator {
  public:
+  // If non-null, "lower_bound" and "upper_bound" are user keys: files whose
+  // keys are all < *lower_bound or all >= *upper_bound are treated as if
+  // they were not in the list.
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
-      : icmp_(icmp), flist_(flist), index_(flist->size()) {  // Marks as invalid
+                       const std::vector<FileMetaData*>* flist, int level,
+                       const Slice* lower_bound = nullptr,
+                       const Slice* upper_bound = nullptr)
+      : icmp_(icmp),
+        flist_(flist),
+        level_(level),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
+        index_(flist->size()) {  // Marks as invalid
+    if (lower_bound != nullptr) {
+      lower_key_ =
+          InternalKey(*lower_bound, kMaxSequenceNumber, kValueTypeForSeek);
+    }
+    if (upper_bound != nullptr) {
+      upper_key_ =
+          InternalKey(*upper_bound, kMaxSequenceNumber, kValueTypeForSeek);
+    }
   }
   bool Valid() const override { return index_ < flist_->size(); }
   void Seek(const Slice& target) override {
     index_ = FindFile(icmp_, *flist_, target);
+    SkipForward();
+  }
+  void SeekToFirst() override {
+    index_ = (lower_bound_ == nullptr)
+                 ? 0
+                 : FindFile(icmp_, *flist_, lower_key_.Encode());
+    SkipForward();
   }
-  void SeekToFirst() override { index_ = 0; }
   void SeekToLast() override {
-    index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    if (upper_bound_ == nullptr) {
+      index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    } else {
+      // Start from the first file with keys >= *upper_bound_.
+      index_ = FindFile(icmp_, *flist_, upper_key_.Encode());
+      if (index_ == flist_->size()) {
+        index_ = flist_->empty() ? 0 : flist_->size() - 1;
+      }
+    }
+    SkipBackward();
   }
   void Next() override {
     assert(Valid());
     index_++;
+    SkipForward();
   }
   void Prev() override {
     assert(Valid());
@@ -193,6 +227,7 @@ class Version::LevelFileNumIterator : public Iterator {
       index_ = flist_->size();  // Marks as invalid
     } else {
       index_--;
+      SkipBackward();
     }
   }
   Slice key() const override {
@@ -203,44 +238,114 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed32(value_buf_ + 16, level_);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
 
  private:
+  bool BelowLowerBound(const FileMetaData* f) const {
+    return lower_bound_ != nullptr &&
+           icmp_.user_comparator()->Compare(f->largest.user_key(),
+                                            *lower_bound_) < 0;
+  }
+
+  bool AtOrAboveUpperBound(const FileMetaData* f) const {
+    return upper_bound_ != nullptr &&
+           icmp_.user_comparator()->Compare(f->smallest.user_key(),
+                                            *upper_bound_) >= 0;
+  }
+
+  // Moves forward past the files below the bounds, and marks the iterator
+  // as invalid at a file above them, after which all files are above them.
+  void SkipForward() {
+    while (Valid() && BelowLowerBound((*flist_)[index_])) {
+      index_++;
+    }
+    if (Valid() && AtOrAboveUpperBound((*flist_)[index_])) {
+      index_ = flist_->size();
+    }
+  }
+
+  // Like SkipForward(), moving backward.
+  void SkipBackward() {
+    while (Valid() && AtOrAboveUpperBound((*flist_)[index_])) {
+      index_ = (index_ == 0) ? flist_->size() : index_ - 1;
+    }
+    if (Valid() && BelowLowerBound((*flist_)[index_])) {
+      index_ = flist_->size();
+    }
+  }
+
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const int level_;
+  const Slice* const lower_bound_;
+  const Slice* const upper_bound_;
+  InternalKey lower_key_;  // Smallest internal keys of the bounds
+  InternalKey upper_key_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and level.
+  mutable char value_buf_[20];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 20) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
-    return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+    return cache->NewIterator(
+        options, DecodeFixed64(file_value.data()),
+        DecodeFixed64(file_value.data() + 8),
+        static_cast<int>(DecodeFixed32(file_value.data() + 16)));
+  }
+}
+
+// Like GetFileIterator(), for the inputs of a compaction.
+static Iterator* GetCompactionFileIterator(void* arg,
+                                           const ReadOptions& options,
+                                           const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 20) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewCompactionIterator(
+        options, DecodeFixed64(file_value.data()),
+        DecodeFixed64(file_value.data() + 8),
+        static_cast<int>(DecodeFixed32(file_value.data() + 16)));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(vset_->icmp_, &files_[level], level,
+                               options.iterate_lower_bound,
+                               options.iterate_upper_bound),
+      &GetFileIterator, vset_->table_cache_, options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
-  // Merge all level zero files together since they may overlap
+  // Merge all level zero files together since they may overlap, leaving
+  // out the files entirely outside the iterate bounds.
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    const FileMetaData* f = files_[0][i];
+    if ((options.iterate_lower_bound != nullptr &&
+         ucmp->Compare(f->largest.user_key(), *options.iterate_lower_bound) <
+             0) ||
+        (options.iterate_upper_bound != nullptr &&
+         ucmp->Compare(f->smallest.user_key(),
+                       *options.iterate_upper_bound) >= 0)) {
+      continue;
+    }
+    iters->push_back(
+        vset_->table_cache_->NewIterator(options, f->number, f->file_size, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -360,9 +465,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, level, state->ikey,
+          &state->saver, SaveValue);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -408,6 +513,132 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys,
+                       std::string* const* values, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  // Per-key state, as kept by Get() for a single key
+  struct KeyState {
+    Saver saver;
+    bool done;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+  };
+  std::vector<KeyState> state(n);
+  for (int i = 0; i < n; i++) {
+    state[i].saver.state = kNotFound;
+    state[i].saver.ucmp = ucmp;
+    state[i].saver.user_key = keys[i]->user_key();
+    state[i].saver.value = values[i];
+    state[i].done = false;
+    state[i].last_file_read = nullptr;
+    state[i].last_file_read_level = -1;
+    stats[i].seek_file = nullptr;
+    stats[i].seek_file_level = -1;
+    statuses[i] = Status::NotFound(Slice());
+  }
+
+  // Keys (indices into "keys") to look up in one file, in sorted order
+  std::vector<int> batch;
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  auto search_file = [&](int level, FileMetaData* f) {
+    batch_keys.clear();
+    batch_args.clear();
+    for (int i : batch) {
+      KeyState* ks = &state[i];
+      if (stats[i].seek_file == nullptr && ks->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        stats[i].seek_file = ks->last_file_read;
+        stats[i].seek_file_level = ks->last_file_read_level;
+      }
+      ks->last_file_read = f;
+      ks->last_file_read_level = level;
+      batch_keys.push_back(keys[i]->internal_key());
+      batch_args.push_back(&ks->saver);
+    }
+
+    Status s = vset_->table_cache_->MultiGet(
+        options, f->number, f->file_size, level,
+        static_cast<int>(batch.size()),
+        batch_keys.data(), batch_args.data(), SaveValue);
+    for (int i : batch) {
+      KeyState* ks = &state[i];
+      if (!s.ok()) {
+        statuses[i] = s;
+        ks->done = true;
+        continue;
+      }
+      switch (ks->saver.state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          statuses[i] = Status::OK();
+          ks->done = true;
+          break;
+        case kDeleted:
+          ks->done = true;
+          break;
+        case kCorrupt:
+          statuses[i] = Status::Corruption("corrupted key for ",
+                                           ks->saver.user_key);
+          ks->done = true;
+          break;
+      }
+    }
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest, sending each file the
+  // keys that are still pending and fall in its range.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    for (int i = 0; i < n; i++) {
+      if (!state[i].done &&
+          ucmp->Compare(state[i].saver.user_key, f->smallest.user_key()) >=
+              0 &&
+          ucmp->Compare(state[i].saver.user_key, f->largest.user_key()) <=
+              0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      search_file(0, f);
+    }
+  }
+
+  // Search other levels.  Files in a level are sorted and disjoint, so
+  // the pending keys fall into runs that share a file.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    uint32_t batch_index = 0;
+    for (int i = 0; i < n; i++) {
+      if (state[i].done) continue;
+      uint32_t index = FindFile(vset_->icmp_, files, keys[i]->internal_key());
+      if (index >= files.size()) {
+        break;  // This and all later keys are past the last file
+      }
+      if (ucmp->Compare(state[i].saver.user_key,
+                        files[index]->smallest.user_key()) < 0) {
+        continue;  // All of the file is past any data for this key
+      }
+      if (!batch.empty() && index != batch_index) {
+        search_file(level, files[batch_index]);
+      }
+      batch_index = index;
+      batch.push_back(i);
+    }
+    if (!batch.empty()) {
+      search_file(level, files[batch_index]);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -498,6 +729,12 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
+      // A compaction in progress may be about to write this range of
+      // level+1 even though no file there overlaps it yet.
+      if (vset_->OutputRangeBusy(level + 1, smallest_user_key,
+                                 largest_user_key)) {
+        break;
+      }
       if (level + 2 < config::kNumLevels) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
@@ -788,7 +1025,8 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
       dummy_versions_(this),
-      current_(nullptr) {
+      current_(nullptr),
+      pending_flush_level_(-1) {
   AppendVersion(new Version(this));
 }
 
@@ -829,7 +1067,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -1015,7 +1253,7 @@ Status VersionSet::Recover(bool* save_manifest) {
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
+    last_sequence_.store(last_sequence, std::memory_order_release);
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
 
@@ -1101,6 +1339,8 @@ void VersionSet::Finalize(Version* v) {
       score = static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->compaction_scores_[level] = score;
+
     /* 注意这里是在 for 循环中进行的，也就是寻找所有 level 中，score 最大的那个 level */
     if (score > best_score) {
       best_level = level;
@@ -1110,6 +1350,31 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate the bytes left to compact: the level-0 files once they are
+  // due, then at each level the bytes over its limit, including those
+  // compacted into it from above, along with the bytes of the next level
+  // that they overlap in proportion.
+  uint64_t pending = 0;
+  uint64_t incoming = 0;  // Bytes compacted into the level from above
+  if (v->files_[0].size() >= config::kL0_CompactionTrigger) {
+    incoming = TotalFileSize(v->files_[0]);
+    pending += incoming;
+  }
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    const uint64_t max_bytes =
+        static_cast<uint64_t>(MaxBytesForLevel(options_, level));
+    incoming = 0;
+    if (level_bytes > max_bytes) {
+      const double next_ratio =
+          static_cast<double>(TotalFileSize(v->files_[level + 1])) /
+          level_bytes;
+      incoming = level_bytes - max_bytes;
+      pending += static_cast<uint64_t>(incoming * (next_ratio + 1));
+    }
+  }
+  v->pending_compaction_bytes_ = pending;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1180,8 +1445,9 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
         Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+        Iterator* iter =
+            table_cache_->NewIterator(ReadOptions(), files[i]->number,
+                                      files[i]->file_size, level, &tableptr);
         if (tableptr != nullptr) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1266,6 +1532,10 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.rate_limit_reads = true;
+  if (options_->use_direct_io_for_compaction_reads) {
+    options.readahead_size = options_->compaction_readahead_size;
+  }
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1278,14 +1548,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewCompactionIterator(
+              options, files[i]->number, files[i]->file_size, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which],
+                                              c->level() + which),
+            &GetCompactionFileIterator, table_cache_, options);
       }
     }
   }
@@ -1297,48 +1568,75 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 
 /* 选择最终要执行的 Compaction 类型: Size Compaction or Seek Compaction */
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  Compaction* c = nullptr;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
+  // the compactions triggered by seeks.  Levels are tried in order of
+  // decreasing score so that a level whose files are already being
+  // compacted does not hold up compactions of the other levels.
+  int levels[config::kNumLevels - 1];
+  int num_levels = 0;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (current_->compaction_scores_[level] >= 1) {
+      levels[num_levels++] = level;
+    }
+  }
+  const Version* v = current_;
+  std::stable_sort(levels, levels + num_levels, [v](int a, int b) {
+    return v->compaction_scores_[a] > v->compaction_scores_[b];
+  });
 
   /* 优先级: size_compaction > seek_compaction */
-  if (size_compaction) {
-    level = current_->compaction_level_;    /* 获取待 Compact 的 level */
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
+  for (int i = 0; i < num_levels && c == nullptr; i++) {
+    const int level = levels[i];
+    const std::vector<FileMetaData*>& files = current_->files_[level];
 
     /* Pick the first file that comes after compact_pointer_[level]
-     * 遍历 files_[level] 所有 SSTable */
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      /* 取得每一个 SSTable 的  FileMetaData*/
-      FileMetaData* f = current_->files_[level][i];
-
+     * 遍历 files_[level] 中所有未参与 Compaction 的 SSTable */
+    FileMetaData* seed = nullptr;
+    for (size_t j = 0; j < files.size(); j++) {
+      FileMetaData* f = files[j];
+      if (f->being_compacted) {
+        continue;
+      }
       /* 获取第一个 Largest InternalKey > compact_pointer_[level] 的文件 */
       if (compact_pointer_[level].empty() ||
           icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+        seed = f;
         break;
       }
     }
 
-    /* 遍历完所有文件都没有找到合适的 SSTable 时，就默认使用第一个文件进行 Compact */
-    if (c->inputs_[0].empty()) {
+    /* 遍历完所有文件都没有找到合适的 SSTable 时，就默认使用第一个空闲文件进行 Compact */
+    if (seed == nullptr) {
       // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+      for (size_t j = 0; j < files.size(); j++) {
+        if (!files[j]->being_compacted) {
+          seed = files[j];
+          break;
+        }
+      }
+    }
+
+    if (seed != nullptr) {
+      c = SetupCompaction(level, seed);
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  if (c == nullptr && current_->file_to_compact_ != nullptr &&
+      !current_->file_to_compact_->being_compacted) {
+    c = SetupCompaction(current_->file_to_compact_level_,
+                        current_->file_to_compact_);
+  }
+
+  return c;
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* seed) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(seed);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1358,9 +1656,79 @@ Compaction* VersionSet::PickCompaction() {
 
   SetupOtherInputs(c);
 
+  if (CompactionConflicts(c)) {
+    delete c;
+    return nullptr;
+  }
+  RegisterCompaction(c);
   return c;
 }
 
+bool VersionSet::CompactionConflicts(const Compaction* c) const {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      if (f->being_compacted) {
+        return true;
+      }
+    }
+  }
+  if (c->level() == 0) {
+    // Level-0 files may overlap each other, so at most one compaction
+    // reads from level-0 at a time.
+    for (const Compaction* other : compactions_in_progress_) {
+      if (other->level() == 0) {
+        return true;
+      }
+    }
+  }
+  return OutputRangeBusy(c->level() + 1, c->smallest_.user_key(),
+                         c->largest_.user_key());
+}
+
+bool VersionSet::OutputRangeBusy(int level, const Slice& smallest_user_key,
+                                 const Slice& largest_user_key) const {
+  const Comparator* ucmp = icmp_.user_comparator();
+  for (const Compaction* other : compactions_in_progress_) {
+    if (other->level() + 1 == level &&
+        ucmp->Compare(smallest_user_key, other->largest_.user_key()) <= 0 &&
+        ucmp->Compare(largest_user_key, other->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return pending_flush_level_ == level &&
+         ucmp->Compare(smallest_user_key,
+                       pending_flush_largest_.user_key()) <= 0 &&
+         ucmp->Compare(largest_user_key,
+                       pending_flush_smallest_.user_key()) >= 0;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(!f->being_compacted);
+      f->being_compacted = true;
+    }
+  }
+  compactions_in_progress_.push_back(c);
+}
+
+void VersionSet::ReleaseCompaction(Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = false;
+    }
+  }
+  compactions_in_progress_.erase(std::find(compactions_in_progress_.begin(),
+                                           compactions_in_progress_.end(), c));
+}
+
+void VersionSet::SetPendingFlushOutput(int level, const InternalKey& smallest,
+                                       const InternalKey& largest) {
+  pending_flush_level_ = level;
+  pending_flush_smallest_ = smallest;
+  pending_flush_largest_ = largest;
+}
+
 /* Finds the largest key in a vector of files. Returns true if files it not empty.
  * 获取某一个 level 中最大的 InternalKey */
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1491,6 +1859,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     }
   }
 
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
@@ -1536,16 +1907,18 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  assert(!CompactionConflicts(c));
+  RegisterCompaction(c);
   return c;
 }
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      input_version_(nullptr) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index_(0), seen_key_(false), overlapped_bytes_(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
@@ -1575,13 +1948,15 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    size_t& level_ptr = cursor->level_ptrs_[lvl];
+    while (level_ptr < files.size()) {
+      FileMetaData* f = files[level_ptr];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1590,36 +1965,61 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      level_ptr++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index_ < grandparents_.size() &&
          icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                       grandparents_[cursor->grandparent_index_]
+                           ->largest.Encode()) > 0) {
+    if (cursor->seen_key_) {
+      cursor->overlapped_bytes_ +=
+          grandparents_[cursor->grandparent_index_]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index_++;
   }
-  seen_key_ = true;
+  cursor->seen_key_ = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes_ = 0;
     return true;
   } else {
     return false;
   }
 }
 
+void Compaction::GetSubcompactionBoundaries(
+    int max_ranges, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  const std::vector<FileMetaData*>& files = inputs_[1];
+  if (max_ranges <= 1 || files.size() <= 1) {
+    return;
+  }
+  // Cut at the first file boundary past each multiple of the target size,
+  // so that every range carries at least one "level+1" file.
+  const int64_t total = TotalFileSize(files);
+  const int64_t target = total / max_ranges;
+  int64_t cumulative = 0;
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    cumulative += files[i]->file_size;
+    if (cumulative >= target * static_cast<int64_t>(boundaries->size() + 1)) {
+      boundaries->push_back(files[i + 1]->smallest.user_key().ToString());
+      if (boundaries->size() + 1 == static_cast<size_t>(max_ranges)) {
+        break;
+      }
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
     input_version_->Unref();
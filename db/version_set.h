@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -79,6 +80,16 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // For each i in [0,n-1], do the same as
+  //    statuses[i] = Get(options, *keys[i], values[i], &stats[i]);
+  // "keys" must be sorted by user key.  Keys that land in the same table
+  // are looked up together, sharing the table cache lookup and the index
+  // and data block reads.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* values, Status* statuses,
+                GetStats* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -132,7 +143,12 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -175,6 +191,14 @@ class Version {
    * */
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, so that PickCompaction() can fall
+  // back to another level when the best one is busy.  Filled by Finalize().
+  double compaction_scores_[config::kNumLevels];
+
+  // Estimated number of bytes that compactions have to rewrite to bring
+  // every level within its limit.  Filled by Finalize().
+  uint64_t pending_compaction_bytes_;
 };
 
 class VersionSet {
@@ -221,13 +245,23 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the number of bytes that compactions are estimated to have to
+  // rewrite before every level is within its limit.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
+  // Return the last sequence number.  May be called without the lock;
+  // all entries up to the returned sequence number are visible in the
+  // memtables.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -241,18 +275,39 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate conflicts with a compaction that is already in progress.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction.  The result is registered as in progress;
+  // the caller should pass it to ReleaseCompaction() and then delete it.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // level that overlaps the specified range.  The result is registered
+  // as in progress; the caller should pass it to ReleaseCompaction() and
+  // then delete it.
+  // REQUIRES: no other compaction is in progress.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Mark "*c" as finished so that its inputs and output range may be
+  // picked by later compactions.
+  void ReleaseCompaction(Compaction* c);
+
+  // Return the number of compactions returned by PickCompaction() or
+  // CompactRange() that have not been released yet.
+  int NumCompactionsInProgress() const {
+    return static_cast<int>(compactions_in_progress_.size());
+  }
+
+  // Record that a memtable compaction is about to install a file covering
+  // [smallest,largest] at "level".  Until ClearPendingFlushOutput() is
+  // called no compaction that writes into that range of "level" is picked.
+  void SetPendingFlushOutput(int level, const InternalKey& smallest,
+                             const InternalKey& largest);
+  void ClearPendingFlushOutput() { pending_flush_level_ = -1; }
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -301,6 +356,23 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Build a compaction of "seed" at "level" (plus whatever else must be
+  // compacted along with it) and register it as in progress.  Returns
+  // nullptr if the compaction would conflict with one in progress.
+  Compaction* SetupCompaction(int level, FileMetaData* seed);
+
+  // Returns true iff "c" can not run alongside the compactions that are
+  // already in progress.
+  bool CompactionConflicts(const Compaction* c) const;
+
+  // Returns true iff some in-progress compaction or pending memtable
+  // compaction will install files overlapping the user key range
+  // [smallest_user_key,largest_user_key] at "level".
+  bool OutputRangeBusy(int level, const Slice& smallest_user_key,
+                       const Slice& largest_user_key) const;
+
+  void RegisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -316,7 +388,7 @@ class VersionSet {
   /* part 2: Meta Data，包括 SSTable Number、Log Number 以及上一个 SEQ 等信息 */
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -335,6 +407,12 @@ class VersionSet {
    *
    * 记录每一个 level 下一次 Compaction 的起始 InternalKey，可以为空字符串 */
   std::string compact_pointer_[config::kNumLevels];
+
+  /* part 6: 并发 Compaction 相关 */
+  std::vector<Compaction*> compactions_in_progress_;
+  int pending_flush_level_;  // -1 if no memtable output is pending
+  InternalKey pending_flush_smallest_;
+  InternalKey pending_flush_largest_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -367,19 +445,63 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of one pass over the keys of this compaction, as needed by
+  // IsBaseLevelForKey() and ShouldStopBefore().  The keys passed along
+  // with a cursor must be increasing, so each subcompaction needs its own.
+  class Cursor {
+   public:
+    Cursor();
+
+   private:
+    friend class Compaction;
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index_;  // Index in grandparent_starts_
+    bool seen_key_;             // Some output key has been seen
+    int64_t overlapped_bytes_;  // Bytes of overlap between current output
+                                // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs_ holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs_[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key) {
+    return IsBaseLevelForKey(user_key, &cursor_);
+  }
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key) {
+    return ShouldStopBefore(internal_key, &cursor_);
+  }
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Split the key space of this compaction into at most "max_ranges"
+  // disjoint ranges of roughly equal input size, cutting only at the start
+  // of "level+1" input files.  Stores the user keys at which each range
+  // but the first begins in *boundaries, in increasing order.  Leaves
+  // *boundaries empty if the compaction cannot be split.
+  void GetSubcompactionBoundaries(int max_ranges,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
 
+  // Return the smallest and largest internal key over all inputs.
+  const InternalKey& smallest() const { return smallest_; }
+  const InternalKey& largest() const { return largest_; }
+
  private:
   friend class Version;
   friend class VersionSet;
@@ -399,21 +521,17 @@ class Compaction {
    * inputs_[1] 表示 level K+1 将要进行 Compact 的 sst files (vector) */
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Key range covered by inputs_[0] and inputs_[1].  Outputs are confined
+  // to this range.
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Grandparent files (parent == level_ + 1, grandparent == level_ + 2)
+  // overlapping the inputs; used by ShouldStopBefore()
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+
+  // Cursor used when the compaction is not split into subcompactions
+  Cursor cursor_;
 };
 
 }  // namespace leveldb
@@ -5,7 +5,11 @@
 #include "db/version_set.h"
 
 #include "gtest/gtest.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -328,6 +332,135 @@ TEST_F(AddBoundaryInputsTest, TestDisjoinFilePointers) {
   ASSERT_EQ(f3, compaction_files_[2]);
 }
 
+
+class PickCompactionTest : public testing::Test {
+ public:
+  PickCompactionTest()
+      : env_(NewMemEnv(Env::Default())),
+        dbname_("/pick_compaction_test"),
+        icmp_(BytewiseComparator()) {
+    options_.env = env_;
+    options_.create_if_missing = true;
+    DB* db = nullptr;
+    EXPECT_LEVELDB_OK(DB::Open(options_, dbname_, &db));
+    delete db;
+    vset_ = new VersionSet(dbname_, &options_, nullptr, &icmp_);
+    bool save_manifest;
+    EXPECT_LEVELDB_OK(vset_->Recover(&save_manifest));
+  }
+
+  ~PickCompactionTest() {
+    delete vset_;
+    delete env_;
+  }
+
+  void AddFile(int level, uint64_t file_size, const char* smallest,
+               const char* largest) {
+    VersionEdit edit;
+    uint64_t number = vset_->NewFileNumber();
+    edit.AddFile(level, number, file_size,
+                 InternalKey(smallest, 100, kTypeValue),
+                 InternalKey(largest, 100, kTypeValue));
+    port::Mutex mu;
+    MutexLock l(&mu);
+    EXPECT_LEVELDB_OK(vset_->LogAndApply(&edit, &mu));
+  }
+
+  void Release(Compaction* c) {
+    vset_->ReleaseCompaction(c);
+    delete c;
+  }
+
+  Env* env_;
+  std::string dbname_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  VersionSet* vset_;
+};
+
+TEST_F(PickCompactionTest, DisjointCompactionsRunTogether) {
+  // Both level-1 and level-3 are twice their size limit and touch
+  // unrelated key ranges.
+  AddFile(1, 20 * 1048576, "a", "b");
+  AddFile(3, 2000 * 1048576, "x", "y");
+
+  Compaction* c1 = vset_->PickCompaction();
+  ASSERT_TRUE(c1 != nullptr);
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != nullptr);
+  ASSERT_NE(c1->level(), c2->level());
+  ASSERT_EQ(2, vset_->NumCompactionsInProgress());
+
+  // Every over-sized file is already being compacted.
+  ASSERT_TRUE(vset_->PickCompaction() == nullptr);
+
+  // Once released, the same input can be picked again.
+  int level = c1->level();
+  Release(c1);
+  Compaction* c3 = vset_->PickCompaction();
+  ASSERT_TRUE(c3 != nullptr);
+  ASSERT_EQ(level, c3->level());
+  Release(c2);
+  Release(c3);
+  ASSERT_EQ(0, vset_->NumCompactionsInProgress());
+}
+
+TEST_F(PickCompactionTest, SharedInputsAreSkipped) {
+  AddFile(1, 20 * 1048576, "a", "b");
+  AddFile(2, 200 * 1048576, "a", "b");
+
+  // The level-1 compaction pulls in the only level-2 file, so the
+  // level-2 compaction has to wait for it.
+  Compaction* c1 = vset_->PickCompaction();
+  ASSERT_TRUE(c1 != nullptr);
+  ASSERT_EQ(1, c1->level());
+  ASSERT_TRUE(vset_->PickCompaction() == nullptr);
+  Release(c1);
+
+  // A flush headed for level-2 blocks the level-1 compaction but not the
+  // level-2 one.
+  vset_->SetPendingFlushOutput(2, InternalKey("a", 200, kTypeValue),
+                               InternalKey("a", 200, kTypeValue));
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != nullptr);
+  ASSERT_EQ(2, c2->level());
+  ASSERT_TRUE(vset_->PickCompaction() == nullptr);
+  Release(c2);
+  vset_->ClearPendingFlushOutput();
+}
+
+TEST_F(PickCompactionTest, SubcompactionBoundaries) {
+  AddFile(1, 20 * 1048576, "a", "z");
+  AddFile(2, 10 * 1048576, "a", "c");
+  AddFile(2, 10 * 1048576, "d", "f");
+  AddFile(2, 10 * 1048576, "g", "i");
+  AddFile(2, 10 * 1048576, "j", "l");
+
+  Compaction* c = vset_->PickCompaction();
+  ASSERT_TRUE(c != nullptr);
+  ASSERT_EQ(1, c->level());
+  ASSERT_EQ(4, c->num_input_files(1));
+
+  std::vector<std::string> boundaries;
+  c->GetSubcompactionBoundaries(1, &boundaries);
+  ASSERT_TRUE(boundaries.empty());
+
+  c->GetSubcompactionBoundaries(2, &boundaries);
+  ASSERT_EQ(1, boundaries.size());
+  ASSERT_EQ("g", boundaries[0]);
+
+  c->GetSubcompactionBoundaries(4, &boundaries);
+  ASSERT_EQ(3, boundaries.size());
+  ASSERT_EQ("d", boundaries[0]);
+  ASSERT_EQ("g", boundaries[1]);
+  ASSERT_EQ("j", boundaries[2]);
+
+  // Never more ranges than "level+1" files.
+  c->GetSubcompactionBoundaries(10, &boundaries);
+  ASSERT_EQ(3, boundaries.size());
+  Release(c);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
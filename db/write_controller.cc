@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace leveldb {
+
+namespace {
+
+// Progress of "value" from "soft" towards "hard", in [0, 1].
+double Progress(double value, double soft, double hard) {
+  if (value >= hard) {
+    return 1;
+  }
+  return (value - soft) / (hard - soft);
+}
+
+}  // namespace
+
+WriteController::WriteController(const Options& options)
+    : level0_slowdown_writes_trigger_(options.level0_slowdown_writes_trigger),
+      level0_stop_writes_trigger_(options.level0_stop_writes_trigger),
+      soft_pending_compaction_bytes_limit_(
+          options.soft_pending_compaction_bytes_limit),
+      hard_pending_compaction_bytes_limit_(
+          options.hard_pending_compaction_bytes_limit),
+      max_delayed_write_rate_(options.delayed_write_rate),
+      stopped_(false),
+      delayed_write_rate_(0),
+      next_write_micros_(0) {}
+
+void WriteController::Update(int level0_files,
+                             uint64_t pending_compaction_bytes) {
+  const bool level0_delayed = level0_files >= level0_slowdown_writes_trigger_;
+  const bool bytes_delayed = soft_pending_compaction_bytes_limit_ > 0 &&
+                             pending_compaction_bytes >=
+                                 soft_pending_compaction_bytes_limit_;
+  stopped_ = level0_files >= level0_stop_writes_trigger_ ||
+             (hard_pending_compaction_bytes_limit_ > 0 &&
+              pending_compaction_bytes >= hard_pending_compaction_bytes_limit_);
+  if (!level0_delayed && !bytes_delayed && !stopped_) {
+    delayed_write_rate_ = 0;
+    next_write_micros_ = 0;
+    return;
+  }
+
+  double progress = 0;
+  if (level0_delayed) {
+    progress = Progress(level0_files, level0_slowdown_writes_trigger_,
+                        level0_stop_writes_trigger_);
+  }
+  if (bytes_delayed && hard_pending_compaction_bytes_limit_ > 0) {
+    progress = std::max(
+        progress, Progress(pending_compaction_bytes,
+                           soft_pending_compaction_bytes_limit_,
+                           hard_pending_compaction_bytes_limit_));
+  }
+  if (stopped_) {
+    progress = 1;
+  }
+  const double rate = max_delayed_write_rate_ * (1 - 0.9 * progress);
+  delayed_write_rate_ =
+      std::max<uint64_t>(1, static_cast<uint64_t>(rate + 0.5));
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros) const {
+  return next_write_micros_ > now_micros ? next_write_micros_ - now_micros
+                                         : 0;
+}
+
+void WriteController::Charge(uint64_t now_micros, uint64_t bytes) {
+  assert(IsDelayed());
+  next_write_micros_ = std::max(next_write_micros_, now_micros) +
+                       bytes * 1000000 / delayed_write_rate_;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Decides how fast writes may go while compactions fall behind, so that
+// write throughput degrades smoothly rather than stopping all at once.
+//
+// Writes are delayed once level-0 reaches the slowdown trigger or the
+// pending compaction bytes reach their soft limit.  Each of the two then
+// measures its progress towards its hard limit, and the delayed write
+// rate drops linearly with the larger progress, from
+// Options::delayed_write_rate down to a tenth of it.  At a hard limit,
+// writes are stopped.
+//
+// Writes are paced by charging the controller for the bytes of each
+// write: the next write is delayed until the bytes charged so far have
+// gone by at the delayed write rate.
+//
+// Not safe for concurrent use: DBImpl calls it with its mutex held.
+class WriteController {
+ public:
+  // "options" must be sanitized (see SanitizeOptions).
+  explicit WriteController(const Options& options);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Recomputes the state of writes from the number of level-0 files and
+  // the bytes that compactions are estimated to have left to rewrite.
+  void Update(int level0_files, uint64_t pending_compaction_bytes);
+
+  // Returns true if writes that need a new memtable must wait.
+  bool IsStopped() const { return stopped_; }
+
+  // Returns true if writes are paced.
+  bool IsDelayed() const { return delayed_write_rate_ > 0; }
+
+  // Returns the rate in bytes per second that writes are paced to, or
+  // zero if they are not delayed.
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+
+  // Returns the number of microseconds after "now_micros" that the next
+  // write has to wait for.
+  uint64_t GetDelay(uint64_t now_micros) const;
+
+  // Charges a write of "bytes" made at "now_micros".
+  // REQUIRES: IsDelayed()
+  void Charge(uint64_t now_micros, uint64_t bytes);
+
+ private:
+  const int level0_slowdown_writes_trigger_;
+  const int level0_stop_writes_trigger_;
+  const uint64_t soft_pending_compaction_bytes_limit_;
+  const uint64_t hard_pending_compaction_bytes_limit_;
+  const uint64_t max_delayed_write_rate_;
+
+  bool stopped_;
+  uint64_t delayed_write_rate_;
+
+  // Time at which the bytes charged so far have gone by.
+  uint64_t next_write_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,102 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static Options ControllerOptions() {
+  Options options;
+  options.level0_slowdown_writes_trigger = 8;
+  options.level0_stop_writes_trigger = 12;
+  options.soft_pending_compaction_bytes_limit = 1000;
+  options.hard_pending_compaction_bytes_limit = 2000;
+  options.delayed_write_rate = 1000000;
+  return options;
+}
+
+TEST(WriteControllerTest, Level0Files) {
+  WriteController controller(ControllerOptions());
+  controller.Update(7, 0);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_TRUE(!controller.IsStopped());
+  ASSERT_EQ(0, controller.delayed_write_rate());
+
+  // The rate drops linearly from the slowdown trigger to the stop trigger.
+  controller.Update(8, 0);
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(1000000, controller.delayed_write_rate());
+  controller.Update(10, 0);
+  ASSERT_EQ(550000, controller.delayed_write_rate());
+  ASSERT_TRUE(!controller.IsStopped());
+
+  controller.Update(12, 0);
+  ASSERT_TRUE(controller.IsStopped());
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(100000, controller.delayed_write_rate());
+
+  controller.Update(2, 0);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_TRUE(!controller.IsStopped());
+}
+
+TEST(WriteControllerTest, PendingCompactionBytes) {
+  WriteController controller(ControllerOptions());
+  controller.Update(0, 999);
+  ASSERT_TRUE(!controller.IsDelayed());
+  controller.Update(0, 1500);
+  ASSERT_EQ(550000, controller.delayed_write_rate());
+
+  // The larger progress of the two sets the rate.
+  controller.Update(11, 1500);
+  ASSERT_EQ(325000, controller.delayed_write_rate());
+
+  controller.Update(0, 2000);
+  ASSERT_TRUE(controller.IsStopped());
+
+  // A zero limit is disabled.
+  Options options = ControllerOptions();
+  options.soft_pending_compaction_bytes_limit = 0;
+  options.hard_pending_compaction_bytes_limit = 0;
+  WriteController unlimited(options);
+  unlimited.Update(0, 1 << 30);
+  ASSERT_TRUE(!unlimited.IsDelayed());
+  ASSERT_TRUE(!unlimited.IsStopped());
+}
+
+TEST(WriteControllerTest, Pacing) {
+  WriteController controller(ControllerOptions());
+  controller.Update(8, 0);
+  ASSERT_EQ(0, controller.GetDelay(1000));
+
+  // 1000 bytes at 1MB/s take a millisecond.
+  controller.Charge(1000, 1000);
+  ASSERT_EQ(1000, controller.GetDelay(1000));
+  ASSERT_EQ(500, controller.GetDelay(1500));
+  ASSERT_EQ(0, controller.GetDelay(2500));
+
+  // Charges add up, starting from the later of now and the last one.
+  controller.Charge(1500, 1000);
+  ASSERT_EQ(2000, controller.GetDelay(1000));
+  controller.Charge(10000, 1000);
+  ASSERT_EQ(1000, controller.GetDelay(10000));
+
+  // Slower rates stretch the delay of later charges.
+  controller.Update(10, 0);
+  controller.Charge(10000, 5500);
+  ASSERT_EQ(11000, controller.GetDelay(10000));
+
+  // Writes that are no longer delayed forget the charges.
+  controller.Update(0, 0);
+  ASSERT_EQ(0, controller.GetDelay(10000));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,9 +10,10 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
+// Builtin cache implementations with a least-recently-used eviction
+// policy, with or without resistance to scans, and with the CLOCK
+// approximation of it are provided.  Clients may use their own
+// implementations if they want something more sophisticated (like a
 // custom eviction policy, variable cache sizing, etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -28,9 +29,40 @@ namespace leveldb {
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a least-recently-used eviction policy.  Up to half of the
+// capacity is reserved for high priority entries.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but with "high_pri_pool_ratio" of the
+// capacity reserved for high priority entries.  High priority entries
+// within that pool are only evicted once there are no low priority entries
+// left to evict; beyond it, the least recently used ones become low priority
+// entries.  A ratio of 0 disables the pool, and all entries are evicted in
+// least-recently-used order.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity that resists scans.  Like
+// NewLRUCache(capacity, 0.625), but entries also become high priority
+// entries when they are looked up after they were inserted.  A scan that
+// reads a lot of data once only evicts other entries that were used once,
+// instead of the working set of point lookups.
+LEVELDB_EXPORT Cache* NewScanResistantLRUCache(size_t capacity);
+
+// Create a new cache with a fixed size capacity that approximates a
+// least-recently-used eviction policy with the CLOCK algorithm.  Lookup()
+// and Release() only use atomic operations, so concurrent readers do not
+// contend on a mutex.  The cache is split into 2^num_shard_bits shards (16
+// by default), each with a hash table sized for entries of about
+// "estimated_entry_charge"; if entries are much smaller on average, the
+// cache holds fewer entries than its capacity would allow.  Entries with
+// the same key inserted concurrently may both stay in the cache until one
+// is evicted.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge);
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge,
+                                    int num_shard_bits);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +77,9 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Hint to the eviction policy about how costly it is to lose an entry.
+  enum Priority { kLowPriority, kHighPriority };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +92,16 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert(), but with a priority hint for the eviction policy.
+  // The default implementation ignores the priority.
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -96,6 +98,17 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up all of "keys" against the same state of the database.  The
+  // i-th returned status and (*values)[i] are what Get() would have
+  // returned for keys[i]; *values is resized to keys.size().
+  //
+  // Cheaper than calling Get() for each key: the work of finding a table,
+  // its index entry and its data block is shared by the keys that land in
+  // the same place.
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -130,6 +143,16 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.delayed-write-rate" - returns the rate in bytes per second
+  //     that writes are slowed down to while compactions fall behind, or
+  //     zero if they are not (see Options::level0_slowdown_writes_trigger).
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes that compactions have to rewrite before every
+  //     level is within its limit.
+  //  "leveldb.rate-limiter" - returns a multi-line string with the rate
+  //     limit of options.rate_limiter and the bytes that flushes and
+  //     compactions went through it with and waited for.  Fails if the DB
+  //     has no rate limiter.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -110,6 +110,23 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), for a file whose reads bypass the
+  // operating system's cache where supported, so that reading the whole
+  // file once does not evict data that is read often.  Such reads gain
+  // nothing from the readahead of the operating system either.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), for a file whose writes bypass the operating
+  // system's cache where supported.  Until Sync() or Close(), Flush() may
+  // keep the data in the buffer of the file, except for log files.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +214,22 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Background work is run by one of several thread pools.  Work scheduled
+  // with kHigh priority never waits behind queued kLow work.
+  enum Priority { kLow = 0, kHigh = 1 };
+
+  // Arrange to run "(*function)(arg)" once in a background thread from the
+  // pool serving "pri".
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri);
+
+  // Make sure that the pool serving "pri" may run at least "number"
+  // background work items concurrently.  Pools never shrink.
+  //
+  // The default implementation does nothing.
+  virtual void IncBackgroundThreadsIfNeeded(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -269,6 +302,35 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // A read of "n" bytes at "offset" into "scratch[0..n-1]" for
+  // SubmitReads().
+  struct ReadRequest {
+    uint64_t offset = 0;
+    size_t n = 0;
+    char* scratch = nullptr;
+
+    // Set once the read is done, as by Read(offset, n, &result, scratch).
+    Slice result;
+    Status status;
+
+    // For use by the implementation while the read is in flight.
+    void* pending = nullptr;
+  };
+
+  // Starts the reads "reqs[0..n-1]" and may return before they are done,
+  // so that they proceed together and while the caller does other work.
+  // WaitForReads() must then be called on them, and the requests and
+  // their scratch buffers must stay live until it returns.
+  //
+  // The default implementation reads them one at a time with Read().
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void SubmitReads(ReadRequest* reqs, size_t n) const;
+
+  // Waits until the reads "reqs[0..n-1]", submitted together or apart by
+  // SubmitReads(), are done, and their result and status are set.
+  virtual void WaitForReads(ReadRequest* reqs, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -355,6 +417,14 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -384,6 +454,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void IncBackgroundThreadsIfNeeded(int number, Priority pri) override {
+    return target_->IncBackgroundThreadsIfNeeded(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
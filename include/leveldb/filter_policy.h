@@ -70,6 +70,39 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a cache-local bloom filter with
+// approximately the specified number of bits per key.  All probes for a
+// key fall within one 64-byte line of the filter, so a lookup costs a
+// single cache miss instead of one per probe, at the price of a slightly
+// higher false positive rate than NewBloomFilterPolicy() in theory for the
+// same bits_per_key.  Probes are checked with AVX2 instructions on CPUs
+// that support them.
+//
+// The filters are not compatible with those of NewBloomFilterPolicy(), so
+// tables written with one policy are read as if they had no filters by
+// the other.  The same restrictions on comparators apply.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const FilterPolicy* NewCacheLocalBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses a Ribbon filter with about the
+// false positive rate of a bloom filter of the specified number of bits
+// per key, in about 20% less space.  Building a Ribbon filter costs
+// several times more CPU than building a bloom filter, so it pays off
+// for the large, rarely rewritten tables of the last levels (see
+// Options::filter_policy_per_level).  Sets of keys too small to benefit
+// get a bloom filter instead.
+//
+// The same restrictions on comparators as for NewBloomFilterPolicy()
+// apply.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(
+    int bloom_equivalent_bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
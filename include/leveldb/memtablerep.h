@@ -0,0 +1,153 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the data structure that holds the entries of a
+// memtable.  The default representation is a skiplist, which keeps entries
+// sorted as they are inserted.  A database can be configured with a
+// MemTableRepFactory to use a different representation, e.g. one that is
+// cheaper to insert into when the workload is mostly bulk writes.
+//
+// Entries are opaque, arena-allocated byte strings owned by the memtable.
+// Each entry starts with a varint32-length-prefixed internal key (the user
+// key followed by an 8-byte sequence number and type), followed by the
+// value.  A representation orders entries only through the KeyComparator
+// it is created with, and may use MemTableRep::UserKey() to look at the
+// user key of an entry.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+class LEVELDB_EXPORT MemTableRep {
+ public:
+  // Orders two memtable entries.
+  class LEVELDB_EXPORT KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    // Three-way comparison of the entries "a" and "b".
+    virtual int operator()(const char* a, const char* b) const = 0;
+  };
+
+  // Iteration over the entries of a representation, in KeyComparator
+  // order.  Entries inserted after the iterator was created may or may not
+  // be visible to it.
+  class LEVELDB_EXPORT Iterator {
+   public:
+    virtual ~Iterator();
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Advance to the first entry >= target.  "target" is encoded like an
+    // entry, but may consist of the length-prefixed internal key only.
+    virtual void Seek(const char* target) = 0;
+
+    virtual void SeekToFirst() = 0;
+
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep();
+
+  // Insert "entry" into the representation.
+  // REQUIRES: nothing that compares equal to entry is in the representation.
+  // REQUIRES: external synchronization against other inserts.
+  virtual void Insert(const char* entry) = 0;
+
+  // Return true if InsertConcurrently() may be used.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+
+  // Like Insert(), but may be called from several threads at once.
+  // REQUIRES: IsInsertConcurrentlySupported()
+  virtual void InsertConcurrently(const char* entry);
+
+  // Return the first entry >= target, or nullptr if there is none.  Only
+  // entries with the same user key as "target" matter to the caller, so
+  // a representation may skip entries with other user keys.
+  virtual const char* Lookup(const char* target) const = 0;
+
+  // Called once no more entries will be inserted, e.g. when the memtable
+  // is about to be flushed.
+  virtual void MarkReadOnly() {}
+
+  // Memory allocated for entries outside of the arena passed at creation,
+  // in bytes.  Fixed overhead such as a hash table need not be counted:
+  // the memtable is flushed once the sum of this and the arena usage
+  // reaches Options::write_buffer_size.
+  virtual size_t ApproximateMemoryUsage() const { return 0; }
+
+  // Return a new iterator over all entries.  The caller must delete it
+  // before the representation is destroyed.
+  virtual Iterator* NewIterator() const = 0;
+
+  // Return the user key of a memtable entry.
+  static Slice UserKey(const char* entry);
+};
+
+// Creates the representation of every new memtable of a database.
+class LEVELDB_EXPORT MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory();
+
+  // The memtable owns the result, which allocates its memory from "arena"
+  // or reports it through ApproximateMemoryUsage().
+  virtual MemTableRep* CreateMemTableRep(const MemTableRep::KeyComparator& cmp,
+                                         Arena* arena) const = 0;
+
+  // Return the name of this representation.
+  virtual const char* Name() const = 0;
+
+  // Return true if the representations support InsertConcurrently().
+  // Otherwise Options::allow_concurrent_memtable_write is ignored.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+};
+
+// Return a factory for memtables that hash the first "prefix_length" bytes
+// of each user key into one of "bucket_count" buckets, each a skiplist.
+// Point lookups only search one bucket; full iteration sorts the entries
+// of all buckets first, so it is much slower than with the default
+// skiplist.  Suited to workloads dominated by writes and point lookups.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count = 16384);
+
+// Return a factory for memtables that append entries to a vector without
+// ordering them, and sort them when the memtable is flushed.  Inserts are
+// much cheaper than with a skiplist, but a read of a memtable that is still
+// being written sorts a copy of the entries, so this is only suited to bulk
+// loads that do not read their own writes.  "reserve" entries are reserved
+// upfront.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MemTableRepFactory* NewVectorRepFactory(
+    size_t reserve = 0);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +18,10 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MemTableRepFactory;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -26,7 +32,9 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression = 0x2,
+  kLZ4Compression = 0x3
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -97,6 +105,10 @@ struct LEVELDB_EXPORT Options {
   // 限制 leveldb 允许打开的最大文件数
   int max_open_files = 1000;
 
+  // If true, the cache of open tables is a CLOCK cache (see NewClockCache)
+  // instead of an LRU cache, so that looking up an open table takes no lock.
+  bool clock_table_cache = false;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -108,6 +120,28 @@ struct LEVELDB_EXPORT Options {
   // 详见: https://dev.mysql.com/doc/refman/5.7/en/query-cache.html
   Cache* block_cache = nullptr;
 
+  // If non-null, blocks that are stored compressed in tables are also kept
+  // in this cache in their compressed form.  A read that misses
+  // block_cache looks here before reading the file, and then only has to
+  // uncompress the block.  Compressed blocks are smaller, so the same
+  // amount of memory holds more of them here than in block_cache; when
+  // memory is tight, give block_cache a small budget for the hottest blocks
+  // and this cache the rest.
+  Cache* compressed_block_cache = nullptr;
+
+  // If true, the index and filter blocks of open tables are kept in
+  // block_cache with high priority instead of in memory owned by each
+  // table, so that the memory they use is charged to and bounded by
+  // block_cache.  Tables whose index or filter has been evicted read it
+  // again on the next lookup.
+  bool cache_index_and_filter_blocks = false;
+
+  // If true and cache_index_and_filter_blocks is set, tables at level 0
+  // or 1 hold on to their index and filter blocks in block_cache while
+  // they stay there, so that the blocks of the tables that most reads go
+  // through are never evicted.
+  bool pin_l0_l1_index_and_filter_blocks = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -123,6 +157,22 @@ struct LEVELDB_EXPORT Options {
    * 就存储完整的 Key，而不进行前缀压缩处理，K 值默认为 16，也就是 block_restart_interval */
   int block_restart_interval = 16;
 
+  // If true, each data block ends with a hash index from the user keys it
+  // holds to the restart interval holding them, so that point lookups jump
+  // to that interval instead of binary searching the restart points.  This
+  // costs about one byte per key and block, divided by
+  // data_block_hash_table_util_ratio.  Blocks with more than 253 restart
+  // points are written without one.
+  //
+  // Only applies to the tables of a DB, whose keys are internal keys, and
+  // requires a comparator that only considers keys equal when their bytes
+  // are equal.  Tables written with this option cannot be read by versions
+  // of leveldb without it.
+  bool data_block_hash_index = false;
+
+  // Number of distinct user keys per bucket of data_block_hash_index.
+  double data_block_hash_table_util_ratio = 0.75;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -151,17 +201,165 @@ struct LEVELDB_EXPORT Options {
   /* SSTable 压缩算法 */
   CompressionType compression = kSnappyCompression;
 
+  // Compression level for kZstdCompression.  Higher levels compress
+  // better but more slowly; zstd accepts -5 to 22.
+  int zstd_compression_level = 1;
+
+  // If non-zero, each table whose blocks are zstd compressed gets its own
+  // dictionary of up to this many bytes, trained on its first data blocks
+  // and stored in a meta block of the table.  This helps most when blocks
+  // are small and share structure that a single block is too short for
+  // zstd to pick up, e.g. small JSON documents.  Typical values are 16KB
+  // to 64KB.
+  size_t zstd_max_dict_bytes = 0;
+
+  // The uncompressed data blocks a dictionary is trained on are buffered
+  // in memory until this many bytes have been added to the table, or the
+  // table is finished, and are written out once the dictionary is ready.
+  // Only used if zstd_max_dict_bytes is non-zero.
+  size_t zstd_max_train_bytes = 1024 * 1024;
+
+  // If non-empty, the compression of the tables written to level L is
+  // compression_per_level[L], or the last entry if L is past the end,
+  // and "compression" is ignored.  For example {kLZ4Compression,
+  // kLZ4Compression, kZstdCompression} keeps the frequently rewritten
+  // levels 0 and 1 fast to write and compresses the larger levels densely.
+  // Memtable flushes use the entry of level 0 even when the new table is
+  // placed at a deeper level.
+  std::vector<CompressionType> compression_per_level;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, compactions read their input tables with direct I/O (see
+  // Env::NewDirectRandomAccessFile()), so that reading them does not evict
+  // the data that reads of the database keep in the operating system's
+  // cache.  The inputs are then read ahead by compaction_readahead_size.
+  bool use_direct_io_for_compaction_reads = false;
+
+  // Readahead size of the compaction input reads when
+  // use_direct_io_for_compaction_reads is set, which get no readahead from
+  // the operating system.
+  size_t compaction_readahead_size = 2 * 1024 * 1024;
+
+  // If true, tables and logs are written with direct I/O (see
+  // Env::NewDirectWritableFile()).  Log files keep writing each record out
+  // as it is added, padded to a whole device block until the next one.
+  bool use_direct_writes = false;
+
+  // If non-null, flushes and compactions ask the limiter for the bytes of
+  // the tables they write, flushes with priority Env::kHigh and compactions
+  // with Env::kLow, and compactions also for the bytes they read.  Writes to
+  // the log are not limited.  See leveldb/rate_limiter.h.
+  RateLimiter* rate_limiter = nullptr;
+
+  // Writes slow down once level-0 has level0_slowdown_writes_trigger files,
+  // or once compactions are estimated to have
+  // soft_pending_compaction_bytes_limit bytes or more left to rewrite.
+  // They are then paced to delayed_write_rate bytes per second, a rate
+  // that drops to a tenth of it as level-0 approaches
+  // level0_stop_writes_trigger files and the backlog of compactions
+  // approaches hard_pending_compaction_bytes_limit bytes.  Once either is
+  // reached, writes that need a new memtable stop until compactions catch
+  // up.  A pending compaction bytes limit of zero disables it.
+  int level0_slowdown_writes_trigger = 8;
+  int level0_stop_writes_trigger = 12;
+  uint64_t soft_pending_compaction_bytes_limit = 64ull << 30;
+  uint64_t hard_pending_compaction_bytes_limit = 256ull << 30;
+  uint64_t delayed_write_rate = 16 << 20;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   // 快速判断某一个 key 是否在 sstable 中，通常是使用 Bloom Filter 这一 “假阳性” 的算法
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-empty, the tables written to level L get their filters from
+  // filter_policy_per_level[L], or the last entry if L is past the end,
+  // and "filter_policy", if set, is only used to read tables written with
+  // it.  A null entry writes no filters.  For example {bloom, bloom,
+  // ribbon} keeps cheap-to-build Bloom filters on the frequently rewritten
+  // levels 0 and 1 and smaller Ribbon filters on the larger levels.
+  // Memtable flushes use the entry of level 0.
+  //
+  // Tables are read with whichever of these policies wrote them, so all
+  // policies must have distinct names.
+  std::vector<const FilterPolicy*> filter_policy_per_level;
+
+  // If true, new tables get a single filter over all of their keys instead
+  // of one filter per 2KB of data blocks.  A lookup then checks the filter
+  // before searching the index block, so a key missing from a table costs
+  // one filter probe.  The filter of a large table is loaded as one piece.
+  //
+  // Tables written with either setting remain readable.
+  bool full_table_filter = false;
+
+  // If true, the index of each new table is split into partitions of
+  // about index_partition_size bytes, and a small top-level index that
+  // points at them is all that Table::Open() loads.  If there is a filter
+  // policy, each index partition gets a filter over the keys of the data
+  // blocks it indexes, and full_table_filter is ignored.  Partitions are
+  // read through the block cache on demand, which keeps opening a large
+  // table fast and the memory of the tables that are not used small, at
+  // the price of up to two more block reads per lookup on a cache miss.
+  //
+  // Tables written with either setting remain readable.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of an index partition (see partition_index_and_filters).
+  size_t index_partition_size = 4 * 1024;
+
+  // If non-null, the filters of new tables also hold the prefixes this
+  // extracts from their keys, and the tables record its name.  Iterators
+  // created with ReadOptions::prefix_same_as_start then skip the tables
+  // whose filters show that they hold no key with the prefix of the key
+  // they seek to, without reading their index or data blocks.  Has no
+  // effect without a filter policy.  See NewFixedPrefixTransform() in
+  // leveldb/slice_transform.h.
+  //
+  // Tables written with another or no prefix extractor are never skipped.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // Maximum number of compactions that may run concurrently in the
+  // background.  Compactions only run concurrently when their inputs and
+  // output key ranges do not overlap (e.g. level-0 => level-1 alongside
+  // level-3 => level-4).  Memtable compactions do not count against this
+  // limit: they are scheduled with Env::kHigh priority so that they never
+  // queue behind a long running compaction.
+  //
+  // Values larger than one only help if options.env runs background work
+  // concurrently (see Env::IncBackgroundThreadsIfNeeded).
+  int max_background_compactions = 1;
+
+  // Maximum number of threads a single compaction is split into.  A
+  // compaction whose "level+1" inputs span several files is divided at
+  // those file boundaries into disjoint key ranges that are merged and
+  // written in parallel, then installed together.  This mostly speeds up
+  // large manual compactions (DB::CompactRange).
+  int max_subcompactions = 1;
+
+  // If true, a group of writes can append to the log while the previous
+  // group is still being applied to the memtable, instead of waiting for
+  // it.  Raises write throughput when the log write or sync is a
+  // significant part of each write.  A write still returns only after it
+  // has been applied to the memtable.
+  bool enable_pipelined_write = false;
+
+  // If true, the writes of a group are applied to the memtable by their
+  // own threads in parallel, and several groups may be applied at once,
+  // instead of the group leader inserting the whole group by itself.
+  // Sequence numbers still become visible to readers in order.  Implies
+  // enable_pipelined_write.
+  bool allow_concurrent_memtable_write = false;
+
+  // If non-null, use the specified factory to create the data structure
+  // of each memtable.  If null, memtables are skiplists, which suit most
+  // workloads.  See NewHashSkipListRepFactory() and NewVectorRepFactory()
+  // in leveldb/memtablerep.h for alternatives.
+  const MemTableRepFactory* memtable_factory = nullptr;
 };
 
 // Options that control read operations
@@ -183,6 +381,43 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If non-null, iterators only return keys >= "*iterate_lower_bound" and
+  // keys < "*iterate_upper_bound", as ordered by Options::comparator.  Seeks
+  // to keys outside the bounds are clamped to them, and the files and
+  // blocks entirely outside the bounds are not read.  The bounds are not
+  // copied and must outlive the iterators.  Ignored by Get().
+  const Slice* iterate_lower_bound = nullptr;
+  const Slice* iterate_upper_bound = nullptr;
+
+  // If true, an iterator only returns the keys that have the same prefix,
+  // as extracted by Options::prefix_extractor, as the target of the last
+  // Seek(), and becomes invalid past them, which lets it skip the tables
+  // that hold no such key (see Options::prefix_extractor).  Seeking to a
+  // key without a prefix, or SeekToFirst(), iterates in total order.
+  // Prev() and SeekToLast() are not supported and make the iterator
+  // invalid with a NotSupported status.  Ignored if the database has no
+  // prefix extractor.
+  bool prefix_same_as_start = false;
+
+  // If true, MultiGet() reads the data blocks it needs from each table
+  // with concurrent asynchronous reads (see RandomAccessFile::SubmitReads()),
+  // and iterators read the next data block of a table while the current
+  // one is being scanned.  The blocks are handed over through
+  // Options::block_cache, so this needs a block cache and fill_cache.  It
+  // gains nothing for tables that are memory-mapped.
+  bool async_io = false;
+
+  // If non-zero, iterators read this many bytes ahead whenever they read a
+  // data block of a table that is not in the buffer of the last such read.
+  // If zero, iterators read ahead of scans by themselves: once they read
+  // consecutive blocks of a table, they read ahead by 8KB, doubling with
+  // each read up to 256KB.  Memory-mapped tables are never read ahead.
+  size_t readahead_size = 0;
+
+  // If true, iterators ask Options::rate_limiter for the bytes they read
+  // from tables, with priority Env::kLow, like compactions do.
+  bool rate_limit_reads = false;
 };
 
 // Options that control write operations
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter caps the rate at which the background work of a database
+// reads and writes its files (see Options::rate_limiter), so that bursts of
+// compaction I/O do not take the bandwidth that reads of the database need.
+// Flushes of memtables, which writes wait for, go before compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/env.h"
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  virtual ~RateLimiter();
+
+  // Blocks until "bytes" more bytes may be read or written.  Requests of
+  // priority Env::kHigh, made by flushes, are granted before those of
+  // priority Env::kLow, made by compactions.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Request(int64_t bytes, Env::Priority priority) = 0;
+
+  // Returns the current rate limit, which an auto-tuned limiter adjusts.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Returns the number of bytes requested with "priority" so far.
+  virtual int64_t GetTotalBytesThrough(Env::Priority priority) const = 0;
+
+  // Returns the number of microseconds that requests with "priority" have
+  // waited for so far.
+  virtual int64_t GetTotalWaitMicros(Env::Priority priority) const = 0;
+};
+
+// Returns a token bucket limiter that allows "rate_bytes_per_sec" bytes per
+// second, in refills every "refill_period_micros".  Bytes left unused at a
+// refill are lost, so bursts never exceed one refill.
+//
+// If "auto_tuned" is true, "rate_bytes_per_sec" is an upper bound, and the
+// limit starts at half of it.  It then follows the backlog of requests,
+// checked every 100 refill periods: it rises by 5% if requests waited in at
+// least 90% of the periods, and drops by 5% if they waited in less than
+// half of them, down to a twentieth of the upper bound.
+//
+// The limiter reads the time from and sleeps through "env", or
+// Env::Default() if it is null.
+//
+// The caller must delete the result after any database that uses it is
+// closed.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t rate_bytes_per_sec, int64_t refill_period_micros = 100 * 1000,
+    bool auto_tuned = false, Env* env = nullptr);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
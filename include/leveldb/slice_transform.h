@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps keys to their prefix.  A database configured with
+// a prefix extractor (see Options::prefix_extractor) adds the prefixes of
+// its keys to its filters, so that iterators created with
+// ReadOptions::prefix_same_as_start can skip the tables that hold no key
+// with the prefix of the key they seek to.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  It is recorded in the tables whose
+  // filters hold the prefixes it extracts, so it must change whenever the
+  // prefixes it extracts change.
+  virtual const char* Name() const = 0;
+
+  // Return true if "key" has a prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Return the prefix of "key", which must be a prefix of its bytes.  Keys
+  // that compare less than a key with a given prefix, and greater than
+  // another one with that prefix, must have that prefix too.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a transform whose prefix is the first "prefix_length" bytes of a
+// key.  Shorter keys have no prefix.  The caller must delete the result
+// after any database that uses it is closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_length);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
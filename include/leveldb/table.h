@@ -7,6 +7,7 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -14,6 +15,8 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+struct BlockContents;
+class FilterPolicy;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -48,6 +51,10 @@ class LEVELDB_EXPORT Table {
   // Returns a new iterator over the table contents.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
+  // The iterate bounds of the ReadOptions, if any, are keys of the table
+  // as ordered by options.comparator, and only keep the iterator from
+  // reading the blocks entirely outside them: it may still return keys
+  // outside the bounds from the blocks that straddle them.
   Iterator* NewIterator(const ReadOptions&) const;
 
   // Given a key, return an approximate byte offset in the file where
@@ -60,12 +67,60 @@ class LEVELDB_EXPORT Table {
 
  private:
   friend class TableCache;
+  class PrefetchingIndexIterator;
+  struct Filter;
+  struct Readahead;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static void DeleteReadahead(void* arg, void* ignored);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  static Iterator* BoundedIndexPartitionReader(void*, const ReadOptions&,
+                                               const Slice&);
+  static void DeleteCachedFilter(const Slice& key, void* value);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Reads the block with index entry "index_value" through the block cache,
+  // inserting it with the given priority on a miss.  The bounds are passed
+  // to Block::NewIterator().  Misses are read from "file" if non-null, and
+  // else from the file of the table.
+  Iterator* NewBlockIterator(const ReadOptions&, const Slice& index_value,
+                             Cache::Priority priority,
+                             const Slice* lower_bound = nullptr,
+                             const Slice* upper_bound = nullptr,
+                             RandomAccessFile* file = nullptr) const;
+
+  // Returns an iterator over the index block named by the footer.
+  Iterator* NewIndexBlockIterator(const ReadOptions&,
+                                  const Slice* lower_bound = nullptr,
+                                  const Slice* upper_bound = nullptr) const;
+
+  // Returns an iterator over the index entries of the data blocks, which
+  // reads the index partitions if the index is partitioned.  It skips the
+  // entries of the blocks outside the iterate bounds of the ReadOptions.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Keeps the index and filter blocks of the table in the block cache until
+  // the table is deleted.  Does nothing unless
+  // options.cache_index_and_filter_blocks is set.
+  void PinIndexAndFilter();
+
+  // Returns false if the filter of the index partition with top-level index
+  // entry "partition_value" says that "key" is not in the partition.
+  bool PartitionMayMatch(const ReadOptions&, const Slice& partition_value,
+                         const Slice& key) const;
+
+  // Returns false if the filters show that no entry >= target matches
+  // "prefix_key", a key made of the prefix of "target" as extracted by
+  // options.prefix_extractor.  Always true for tables whose filters do not
+  // hold the prefixes of that extractor.
+  bool PrefixMayMatch(const ReadOptions&, const Slice& target,
+                      const Slice& prefix_key) const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
@@ -73,8 +128,68 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // Like InternalGet() for the n keys in keys[0,n-1], which must be sorted
+  // in increasing order; the entry found for keys[i] is reported with
+  // args[i].  Keys that fall into the same data block share one index
+  // seek and one block read.
+  Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void SetFilter(const FilterPolicy* policy, const Slice& filter_handle_value,
+                 bool full);
+
+  // Reads the filter through the block cache if the index and filter are
+  // cached, or from the file.  Returns nullptr on errors.  If *cache_handle
+  // is set, the filter is owned by the block cache, and else by the caller.
+  Filter* ReadFilter(const ReadOptions&, Cache::Handle** cache_handle) const;
+
+  // Like ReadFilter() for the index block, which is returned in *block.
+  Status ReadIndexBlock(const ReadOptions&, Block** block,
+                        Cache::Handle** cache_handle) const;
+
+  // Inserts the index or filter block at "handle" into the block cache
+  // with high priority.
+  Cache::Handle* InsertIndexOrFilter(const BlockHandle& handle, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value)) const;
+
+  // Returns the filter of the table, or nullptr if there is none.  The
+  // caller must pass the result and *cache_handle to ReleaseFilter() once
+  // done with it.
+  const Filter* GetFilter(const ReadOptions&,
+                          Cache::Handle** cache_handle) const;
+  void ReleaseFilter(const Filter* filter, Cache::Handle* cache_handle) const;
+
+  void ReadCompressionDict(const Slice& dict_handle_value);
+  // Read a data block from "file", going through
+  // options.compressed_block_cache.
+  Status ReadDataBlock(RandomAccessFile* file, const ReadOptions& options,
+                       const BlockHandle& handle,
+                       BlockContents* contents) const;
+  // Inserts the stored contents of a data block read from the file into
+  // options.compressed_block_cache, which takes ownership of
+  // "compressed_block".
+  void AddCompressedBlock(const ReadOptions& options, const BlockHandle& handle,
+                          std::string* compressed_block) const;
+
+  // Reads the data blocks "handles[0..n-1]" missing from the block cache
+  // with concurrent asynchronous reads and inserts them into the cache.
+  // pinned[i] is set to a handle on the cached block i, or nullptr, which
+  // the caller must release.  Read errors are left for the normal read
+  // path to report.
+  void PrefetchDataBlocks(const ReadOptions&, const BlockHandle* handles,
+                          int n, Cache::Handle** pinned) const;
+
+  // Decodes the data block read into "contents" with the new[] buffer
+  // "buf" and inserts it into the block cache with low priority.  Returns
+  // the cache handle, or nullptr if the block is corrupted or not cachable.
+  Cache::Handle* InsertPrefetchedBlock(const ReadOptions&,
+                                       const BlockHandle& handle,
+                                       const Slice& contents, char* buf) const;
 
   Rep* const rep_;
 };
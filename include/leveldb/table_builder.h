@@ -82,14 +82,28 @@ class LEVELDB_EXPORT TableBuilder {
   /* 一共添加了多少 Key-Value 对 */
   uint64_t NumEntries() const;
 
-  // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Size of the file generated so far, including the data blocks held back
+  // until the compression dictionary is trained.  If invoked after a
+  // successful Finish() call, returns the size of the final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   /* 序列化需要写入的 Data Block */
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  // Add the index entry of a data block, and write out the current index
+  // partition once it is large enough.
+  void AddIndexEntry(const Slice& key, const BlockHandle& handle);
+  // Write the current index partition and the filter of its data blocks,
+  // and point the top-level index at them.
+  void WriteIndexPartition();
+  // Compress "raw" with the table's compression, using "dict" as the zstd
+  // dictionary if it is non-empty, and write it to the file.
+  void CompressAndWriteBlock(const Slice& raw, const Slice& dict,
+                             BlockHandle* handle);
+  // Train the compression dictionary on the buffered data blocks and
+  // write them out.
+  void EnterUnbuffered();
   /* 将压缩后的数据写入文件中 */
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
@@ -81,6 +81,50 @@ bool Snappy_GetUncompressedLength(const char* input, size_t length,
 bool Snappy_Uncompress(const char* input_data, size_t input_length,
                        char* output);
 
+// Store the zstd compression of "input[0,input_length-1]" in *output,
+// using the given zstd compression level.  If dict_length is non-zero,
+// dict[0,dict_length-1] is used as the compression dictionary.
+// Returns false if zstd is not supported by this port.
+bool Zstd_Compress(int level, const char* input, size_t input_length,
+                   std::string* output, const char* dict = nullptr,
+                   size_t dict_length = 0);
+
+// If input[0,input_length-1] looks like a valid zstd compressed
+// buffer, store the size of the uncompressed data in *result and
+// return true.  Else return false.
+bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                size_t* result);
+
+// Attempt to zstd uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid zstd
+// compressed data.  Input compressed with a dictionary must be
+// uncompressed with the same dictionary.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Zstd_GetUncompressedLength.
+bool Zstd_Uncompress(const char* input_data, size_t input_length,
+                     char* output, const char* dict = nullptr,
+                     size_t dict_length = 0);
+
+// Train a zstd dictionary of at most max_dict_length bytes on the
+// "num_samples" samples stored back to back in "samples", where sample i
+// is sample_lengths[i] bytes long, and store it in *dict.
+// Returns false if zstd is not supported by this port, or if the samples
+// are not suitable for training (e.g. there are too few of them).
+bool Zstd_TrainDictionary(const char* samples, const size_t* sample_lengths,
+                          size_t num_samples, size_t max_dict_length,
+                          std::string* dict);
+
+// Like the Snappy_* functions above, but for LZ4 compression.  Returns
+// false if LZ4 is not supported by this port.
+bool LZ4_Compress(const char* input, size_t input_length,
+                  std::string* output);
+bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                               size_t* result);
+bool LZ4_Uncompress(const char* input_data, size_t input_length,
+                    char* output);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
@@ -28,6 +28,13 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif  // HAVE_ZSTD
+#if HAVE_LZ4
+#include <lz4.h>
+#endif  // HAVE_LZ4
 
 #include <cassert>
 #include <condition_variable>  // NOLINT
@@ -128,6 +135,189 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_SNAPPY
 }
 
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+                          std::string* output, const char* dict = nullptr,
+                          size_t dict_length = 0) {
+#if HAVE_ZSTD
+  // Get the MaxCompressedLength.
+  size_t outlen = ZSTD_compressBound(length);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  ZSTD_CCtx* ctx = ZSTD_createCCtx();
+  // No dictionary is used if dict_length is 0.
+  outlen = ZSTD_compress_usingDict(ctx, &(*output)[0], output->size(), input,
+                                   length, dict, dict_length, level);
+  ZSTD_freeCCtx(ctx);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)level;
+  (void)input;
+  (void)length;
+  (void)output;
+  (void)dict;
+  (void)dict_length;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#if HAVE_ZSTD
+  size_t size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = size;
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length, char* output,
+                            const char* dict = nullptr,
+                            size_t dict_length = 0) {
+#if HAVE_ZSTD
+  size_t outlen;
+  if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  ZSTD_DCtx* ctx = ZSTD_createDCtx();
+  outlen = ZSTD_decompress_usingDict(ctx, output, outlen, input, length, dict,
+                                     dict_length);
+  ZSTD_freeDCtx(ctx);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  (void)dict;
+  (void)dict_length;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_TrainDictionary(const char* samples,
+                                 const size_t* sample_lengths,
+                                 size_t num_samples, size_t max_dict_length,
+                                 std::string* dict) {
+#if HAVE_ZSTD
+  dict->resize(max_dict_length);
+  size_t dict_length =
+      ZDICT_trainFromBuffer(&(*dict)[0], dict->size(), samples, sample_lengths,
+                            static_cast<unsigned>(num_samples));
+  if (ZDICT_isError(dict_length)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(dict_length);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)samples;
+  (void)sample_lengths;
+  (void)num_samples;
+  (void)max_dict_length;
+  (void)dict;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// LZ4 blocks do not record their uncompressed length, so it is stored in
+// front of the compressed data as a varint32.
+inline bool LZ4_Compress(const char* input, size_t length,
+                         std::string* output) {
+#if HAVE_LZ4
+  if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(5 + bound);
+  char* p = &(*output)[0];
+  uint32_t v = static_cast<uint32_t>(length);
+  while (v >= 128) {
+    *(p++) = static_cast<char>(v | 128);
+    v >>= 7;
+  }
+  *(p++) = static_cast<char>(v);
+  const int header = static_cast<int>(p - output->data());
+  const int outlen =
+      LZ4_compress_default(input, p, static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(header + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#if HAVE_LZ4
+  uint32_t v = 0;
+  for (size_t i = 0, shift = 0; i < length && shift <= 28; i++, shift += 7) {
+    const uint32_t byte = static_cast<unsigned char>(input[i]);
+    v |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *result = v;
+      return true;
+    }
+  }
+  return false;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_LZ4
+  size_t ulength;
+  if (!LZ4_GetUncompressedLength(input, length, &ulength)) {
+    return false;
+  }
+  size_t header = 1;
+  while (static_cast<unsigned char>(input[header - 1]) & 128) {
+    header++;
+  }
+  const int outlen =
+      LZ4_decompress_safe(input + header, output,
+                          static_cast<int>(length - header),
+                          static_cast<int>(ulength));
+  return outlen >= 0 && static_cast<size_t>(outlen) == ulength;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
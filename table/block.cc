@@ -13,29 +13,49 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+         ~kDataBlockHashIndexFlag;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  // End of the restart array.
+  size_t limit = size_ - sizeof(uint32_t);
+  if (DecodeFixed32(data_ + limit) & kDataBlockHashIndexFlag) {
+    if (limit < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    limit -= sizeof(uint32_t);
+    num_hash_buckets_ = DecodeFixed32(data_ + limit);
+    if (num_hash_buckets_ == 0 || num_hash_buckets_ > limit) {
+      size_ = 0;
+      return;
+    }
+    limit -= num_hash_buckets_;
+    hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + limit);
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (NumRestarts() > max_restarts_allowed) {
+    // The size is too small for NumRestarts()
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - NumRestarts() * sizeof(uint32_t);
   }
 }
 
@@ -80,6 +100,10 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const uint8_t* const hash_buckets_;  // Hash index, or nullptr if none
+  uint32_t const num_hash_buckets_;
+  const Slice* const lower_bound_;  // See Block::NewIterator()
+  const Slice* const upper_bound_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +138,17 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* hash_buckets,
+       uint32_t num_hash_buckets, const Slice* lower_bound,
+       const Slice* upper_bound)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_hash_buckets_(num_hash_buckets),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -137,6 +167,10 @@ class Block::Iter : public Iterator {
 
   void Next() override {
     assert(Valid());
+    if (upper_bound_ != nullptr && Compare(key_, *upper_bound_) >= 0) {
+      MarkInvalid();
+      return;
+    }
     ParseNextKey();
   }
 
@@ -159,9 +193,14 @@ class Block::Iter : public Iterator {
     do {
       // Loop until end of current entry hits the start of original entry
     } while (ParseNextKey() && NextEntryOffset() < original);
+    CheckLowerBound();
   }
 
   void Seek(const Slice& target) override {
+    if (hash_buckets_ != nullptr && SeekWithHashIndex(target)) {
+      return;
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -236,9 +275,52 @@ class Block::Iter : public Iterator {
     while (ParseNextKey() && NextEntryOffset() < restarts_) {
       // Keep skipping
     }
+    CheckLowerBound();
   }
 
  private:
+  void MarkInvalid() {
+    current_ = restarts_;
+    restart_index_ = num_restarts_;
+  }
+
+  // Ends a backward iteration that reached an entry < *lower_bound_.
+  void CheckLowerBound() {
+    if (lower_bound_ != nullptr && Valid() &&
+        Compare(key_, *lower_bound_) < 0) {
+      MarkInvalid();
+    }
+  }
+
+  // Seeks to the restart interval the hash index maps the user key of
+  // "target" to.  Returns false, leaving the iterator anywhere, if the
+  // user key is not in the block or its interval is unknown, in which case
+  // the restart array has to be searched.
+  bool SeekWithHashIndex(const Slice& target) {
+    if (target.size() < 8) {
+      return false;
+    }
+    const Slice user_key(target.data(), target.size() - 8);
+    const uint8_t bucket =
+        hash_buckets_[Hash(user_key.data(), user_key.size(),
+                           kDataBlockHashIndexSeed) %
+                      num_hash_buckets_];
+    if (bucket >= num_restarts_) {
+      return false;  // No entry, or a collision
+    }
+    SeekToRestartPoint(bucket);
+    while (ParseNextKey()) {
+      if (Compare(key_, target) >= 0) {
+        // All the entries of the user key are in this restart interval, so
+        // this is the first entry >= target if it has the user key.  If it
+        // does not, the hash of another user key may have led here.
+        return key_.size() >= 8 &&
+               Slice(key_.data(), key_.size() - 8) == user_key;
+      }
+    }
+    return !status_.ok();
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -277,7 +359,9 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator,
+                             const Slice* lower_bound,
+                             const Slice* upper_bound) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
@@ -285,7 +369,9 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts,
+                    hash_buckets_, num_hash_buckets_, lower_bound,
+                    upper_bound);
   }
 }
 
@@ -26,7 +26,16 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // If "lower_bound" is non-null, Prev() and SeekToLast() end the iteration
+  // instead of stopping at an entry < *lower_bound.  If "upper_bound" is
+  // non-null, Next() from an entry >= *upper_bound ends the iteration.  For
+  // index blocks, whose entries are upper bounds of the keys of the blocks
+  // they point to, this skips the blocks entirely outside the bounds.  Both
+  // must outlive the iterator.
+  Iterator* NewIterator(const Comparator* comparator,
+                        const Slice* lower_bound = nullptr,
+                        const Slice* upper_bound = nullptr);
 
  private:
   class Iter;
@@ -36,7 +45,9 @@ class Block {
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
-  bool owned_;               // Block owns data_[]
+  const uint8_t* hash_buckets_;  // Buckets of the hash index, or nullptr
+  uint32_t num_hash_buckets_;
+  bool owned_;  // Block owns data_[]
 };
 
 }  // namespace leveldb
@@ -33,7 +33,9 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -50,13 +52,21 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_entries_.clear();
 }
 
 /* 返回 Block 未压缩之前的大小 */
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));  // Restart array length
+  if (options_->data_block_hash_index) {
+    estimate += static_cast<size_t>(
+                    hash_entries_.size() /
+                    options_->data_block_hash_table_util_ratio) +
+                sizeof(uint32_t);  // Buckets and their number
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -64,8 +74,27 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
+  uint32_t num_restarts = restarts_.size();
+  if (options_->data_block_hash_index &&
+      num_restarts <= kDataBlockHashIndexMaxRestarts) {
+    uint32_t num_buckets = static_cast<uint32_t>(
+        hash_entries_.size() / options_->data_block_hash_table_util_ratio);
+    num_buckets |= 1;  // Odd, and at least one bucket
+    std::string buckets(num_buckets, kDataBlockHashIndexNoEntry);
+    for (const auto& entry : hash_entries_) {
+      char& bucket = buckets[entry.first % num_buckets];
+      if (static_cast<uint8_t>(bucket) == kDataBlockHashIndexNoEntry) {
+        bucket = static_cast<char>(entry.second);
+      } else if (static_cast<uint8_t>(bucket) != entry.second) {
+        bucket = static_cast<char>(kDataBlockHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kDataBlockHashIndexFlag;
+  }
   /* 压入 Restart Points 数量 */
-  PutFixed32(&buffer_, restarts_.size());
+  PutFixed32(&buffer_, num_restarts);
   /* 设置结束标志位 */
   finished_ = true;
   /* 返回完整的 Buffer 内容 */
@@ -97,6 +126,20 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     counter_ = 0;
   }
 
+  if (options_->data_block_hash_index) {
+    // Keys are internal keys.  Entries of a user key that are all in the
+    // same restart interval need a single entry in the hash index.
+    assert(key.size() >= 8);
+    const Slice user_key(key.data(), key.size() - 8);
+    const uint32_t restart_index = restarts_.size() - 1;
+    if (counter_ == 0 || shared < user_key.size() ||
+        last_key_piece.size() != key.size()) {
+      hash_entries_.emplace_back(
+          Hash(user_key.data(), user_key.size(), kDataBlockHashIndexSeed),
+          restart_index);
+    }
+  }
+
   /* 获取 key 和 last_key_ 的非共享长度 */
   const size_t non_shared = key.size() - shared;
 
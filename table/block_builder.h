@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -43,6 +44,10 @@ class BlockBuilder {
   int counter_;                     /* Entry 计数器，用于重启点的计算 */
   bool finished_;                   /* 是否已经调用了 Finish() 方法 */
   std::string last_key_;            /* 最后添加的 Key */
+
+  // If options_->data_block_hash_index is set, the hash of the user key of
+  // each entry paired with the index of its restart interval.
+  std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
 };
 
 }  // namespace leveldb
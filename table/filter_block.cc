@@ -15,10 +15,13 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, bool full)
+    : policy_(policy), full_(full) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_) {
+    return;
+  }
 
   /* block_offset 可以认为是 Data Block 的结束偏移量，kFilterBase 的值其实就是 2048，
    * 即 2KB，filter_index 就表示需要创建多少个 Bloom Filter */
@@ -42,6 +45,11 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
 }
 
 Slice FilterBlockBuilder::Finish() {
+  if (full_) {
+    // A single filter over all keys, without an offset array.
+    GenerateFilter();
+    return Slice(result_);
+  }
   if (!start_.empty()) {
     GenerateFilter();
   }
@@ -125,4 +133,11 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
+  if (filter_.empty()) {
+    return false;  // The table has no keys
+  }
+  return policy_->KeyMayMatch(key, filter_);
+}
+
 }  // namespace leveldb
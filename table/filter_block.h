@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  A full filter block instead holds one
+// filter for all keys of the table, which is checked before the index.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -27,9 +28,12 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// If "full" is true, StartBlock() is ignored and Finish() returns a single
+// filter over all keys, to be read with a FullFilterBlockReader.
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*, bool full = false);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -47,6 +51,7 @@ class FilterBlockBuilder {
   void GenerateFilter();          /* 构建一个 Filter */
 
   const FilterPolicy* policy_;    /* filter 类型，如 BloomFilterPolicy */
+  const bool full_;               // One filter for the whole table
   std::string keys_;              /* User Keys，全部塞到一个 string 中 */
   std::vector<size_t> start_;     /* 每一个 User Key 在 keys_ 中的起始位置 */
   std::string result_;            /* keys_ 通过 policy_ 计算出来的 filtered data */
@@ -70,6 +75,18 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents)
+      : policy_(policy), filter_(contents) {}
+  bool KeyMayMatch(const Slice& key);
+
+ private:
+  const FilterPolicy* policy_;
+  Slice filter_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -61,8 +61,59 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
+Status UncompressBlockContents(const char* data, size_t n, char type,
+                               const Slice& compression_dict,
+                               BlockContents* result) {
+  size_t ulength = 0;
+  char* ubuf = nullptr;
+  switch (type) {
+    case kSnappyCompression: {
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted snappy compressed block contents");
+      }
+      ubuf = new char[ulength];
+      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted snappy compressed block contents");
+      }
+      break;
+    }
+    case kZstdCompression: {
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted zstd compressed block contents");
+      }
+      ubuf = new char[ulength];
+      if (!port::Zstd_Uncompress(data, n, ubuf, compression_dict.data(),
+                                 compression_dict.size())) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted zstd compressed block contents");
+      }
+      break;
+    }
+    case kLZ4Compression: {
+      if (!port::LZ4_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      ubuf = new char[ulength];
+      if (!port::LZ4_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      break;
+    }
+    default:
+      return Status::Corruption("bad block type");
+  }
+  result->data = Slice(ubuf, ulength);
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 const Slice& compression_dict,
+                 std::string* compressed_block) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -77,6 +128,20 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     delete[] buf;
     return s;
   }
+  return DecodeBlock(options, handle, contents, buf, result, compression_dict,
+                     compressed_block);
+}
+
+Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                   const Slice& contents, char* buf, BlockContents* result,
+                   const Slice& compression_dict,
+                   std::string* compressed_block) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  Status s;
+  size_t n = static_cast<size_t>(handle.size());
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -112,24 +177,15 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
 
       // Ok
       break;
-    case kSnappyCompression: {
-      size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
-        delete[] buf;
-        return Status::Corruption("corrupted compressed block contents");
-      }
-      char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
-        delete[] buf;
-        delete[] ubuf;
-        return Status::Corruption("corrupted compressed block contents");
+    case kSnappyCompression:
+    case kZstdCompression:
+    case kLZ4Compression:
+      s = UncompressBlockContents(data, n, data[n], compression_dict, result);
+      if (s.ok() && compressed_block != nullptr) {
+        compressed_block->assign(data, n + 1);
       }
       delete[] buf;
-      result->data = Slice(ubuf, ulength);
-      result->heap_allocated = true;
-      result->cachable = true;
-      break;
-    }
+      return s;
     default:
       delete[] buf;
       return Status::Corruption("bad block type");
@@ -73,6 +73,21 @@ class Footer {
   BlockHandle index_handle_;        /* 索引 Index Block */
 };
 
+// A data block written with Options::data_block_hash_index ends with a
+// hash index from the user keys it holds to the restart points:
+//    restarts:     uint32[num_restarts]
+//    buckets:      uint8[num_buckets]
+//    num_buckets:  uint32
+//    num_restarts | kDataBlockHashIndexFlag:  uint32
+// instead of the usual restart array and num_restarts.  A bucket holds
+// the index of the restart interval holding all the entries of the user
+// keys that hash to it, or one of the two markers below.
+static const uint32_t kDataBlockHashIndexFlag = 1u << 31;
+static const uint32_t kDataBlockHashIndexMaxRestarts = 253;
+static const uint8_t kDataBlockHashIndexCollision = 254;
+static const uint8_t kDataBlockHashIndexNoEntry = 255;
+static const uint32_t kDataBlockHashIndexSeed = 0x3c1d5a29;
+
 // kTableMagicNumber was picked by running
 //    echo http://code.google.com/p/leveldb/ | sha1sum
 // and taking the leading 64 bits.
@@ -81,6 +96,27 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block holding the zstd dictionary of the table's
+// data blocks, if it has one.
+static const char kCompressionDictBlockName[] = "compression.dict";
+
+// Prefix of the metaindex key of a full filter block.  The name of the
+// filter policy follows.
+static const char kFullFilterBlockPrefix[] = "fullfilter.";
+
+// Prefix of the metaindex key recording the policy of the filters of a
+// partitioned index.  The name of the filter policy follows.
+static const char kPartitionedFilterPrefix[] = "partitionedfilter.";
+
+// Name of the metaindex entry that marks a partitioned index.  Its value
+// is empty.
+static const char kPartitionedIndexName[] = "partitionedindex";
+
+// Prefix of the metaindex key recording that the filters of the table also
+// hold the prefixes of its keys.  The name of the prefix extractor follows,
+// and the value is empty.
+static const char kPrefixExtractorPrefix[] = "prefixextractor.";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -88,9 +124,32 @@ struct BlockContents {
 };
 
 // Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// return non-OK.  On success fill *result and return OK.  Zstd
+// compressed blocks are uncompressed with "compression_dict" if it is
+// non-empty.  If "compressed_block" is non-null and the block is stored
+// compressed, *compressed_block is set to the stored block contents
+// followed by the one-byte compression type, and is left alone otherwise.
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 const Slice& compression_dict = Slice(),
+                 std::string* compressed_block = nullptr);
+
+// Like ReadBlock(), once the block and its trailer have been read into
+// "contents", for example by RandomAccessFile::SubmitReads().  "buf" is
+// the scratch buffer of the read, allocated with new[]; it is deleted or
+// handed over to *result.
+Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                   const Slice& contents, char* buf, BlockContents* result,
+                   const Slice& compression_dict = Slice(),
+                   std::string* compressed_block = nullptr);
+
+// Uncompress the contents data[0,n-1] of a block stored with compression
+// "type" into a new heap-allocated buffer, and fill *result with it.
+// Returns non-OK if "type" is kNoCompression or unknown, or if the
+// contents are corrupted.
+Status UncompressBlockContents(const char* data, size_t n, char type,
+                               const Slice& compression_dict,
+                               BlockContents* result);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/readahead_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+const size_t ReadaheadFile::kInitialReadahead;
+const size_t ReadaheadFile::kMaxReadahead;
+
+ReadaheadFile::ReadaheadFile(RandomAccessFile* file, size_t readahead_size,
+                             RateLimiter* rate_limiter)
+    : file_(file),
+      fixed_readahead_(readahead_size),
+      rate_limiter_(rate_limiter),
+      last_access_end_(std::numeric_limits<uint64_t>::max()),
+      sequential_accesses_(0),
+      readahead_(kInitialReadahead),
+      buf_(nullptr),
+      buf_capacity_(0),
+      buf_offset_(0),
+      buf_len_(0),
+      direct_(false) {}
+
+ReadaheadFile::~ReadaheadFile() { delete[] buf_; }
+
+void ReadaheadFile::Access(uint64_t offset, size_t n) {
+  if (offset == last_access_end_) {
+    sequential_accesses_++;
+  } else {
+    sequential_accesses_ = 0;
+    readahead_ = kInitialReadahead;
+  }
+  last_access_end_ = offset + n;
+}
+
+Status ReadaheadFile::ReadFile(uint64_t offset, size_t n, Slice* result,
+                               char* scratch) const {
+  if (rate_limiter_ != nullptr) {
+    rate_limiter_->Request(static_cast<int64_t>(n), Env::kLow);
+  }
+  return file_->Read(offset, n, result, scratch);
+}
+
+Status ReadaheadFile::Read(uint64_t offset, size_t n, Slice* result,
+                           char* scratch) const {
+  if (buf_len_ > 0 && offset >= buf_offset_ &&
+      offset + n <= buf_offset_ + buf_len_) {
+    std::memcpy(scratch, buf_ + (offset - buf_offset_), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  size_t readahead;
+  if (fixed_readahead_ > 0) {
+    readahead = fixed_readahead_;
+  } else {
+    readahead = (sequential_accesses_ > 0 ? readahead_ : 0);
+  }
+  if (direct_ || readahead <= n) {
+    return ReadFile(offset, n, result, scratch);
+  }
+
+  if (buf_capacity_ < readahead) {
+    delete[] buf_;
+    buf_ = new char[readahead];
+    buf_capacity_ = readahead;
+  }
+  buf_len_ = 0;
+  Status s = ReadFile(offset, readahead, result, buf_);
+  if (!s.ok()) {
+    // Some files fail reads past their end rather than returning less.
+    return ReadFile(offset, n, result, scratch);
+  }
+  if (result->data() != buf_) {
+    direct_ = true;
+    *result = Slice(result->data(), std::min(n, result->size()));
+    return s;
+  }
+  buf_offset_ = offset;
+  buf_len_ = result->size();
+  if (fixed_readahead_ == 0) {
+    readahead_ = std::min(readahead_ * 2, kMaxReadahead);
+  }
+  const size_t len = std::min(n, buf_len_);
+  std::memcpy(scratch, buf_, len);
+  *result = Slice(scratch, len);
+  return s;
+}
+
+}  // namespace leveldb
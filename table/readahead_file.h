@@ -0,0 +1,83 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+class RateLimiter;
+
+// A RandomAccessFile that reads the blocks of a table ahead of a scan.
+// Each read that misses the readahead buffer refills the buffer with the
+// extent of the file starting at the read, and later reads that fall in
+// the buffer are copied from it.
+//
+// With a fixed readahead size, every refill reads that many bytes.  Else
+// readahead is adaptive: it starts once the caller accesses two blocks in
+// a row that follow each other in the file, with kInitialReadahead bytes,
+// doubles with each refill up to kMaxReadahead bytes, and stops again as
+// soon as an access does not follow the previous one.
+//
+// Files that return their own memory rather than the scratch buffer of a
+// read, such as memory-mapped files, are read directly since readahead
+// gains nothing for them.
+//
+// Not safe for concurrent use: it is meant for a single iterator.
+class ReadaheadFile : public RandomAccessFile {
+ public:
+  static const size_t kInitialReadahead = 8 * 1024;
+  static const size_t kMaxReadahead = 256 * 1024;
+
+  // Reads from "file", which must outlive this object.  A
+  // "readahead_size" of zero makes readahead adaptive.  If "rate_limiter"
+  // is non-null, the reads from "file" ask it for their bytes with
+  // priority Env::kLow.
+  ReadaheadFile(RandomAccessFile* file, size_t readahead_size,
+                RateLimiter* rate_limiter = nullptr);
+
+  ReadaheadFile(const ReadaheadFile&) = delete;
+  ReadaheadFile& operator=(const ReadaheadFile&) = delete;
+
+  ~ReadaheadFile() override;
+
+  // Tells the file that the caller accesses "n" bytes at "offset", whether
+  // it reads them or finds them elsewhere, such as in the block cache.
+  // Adaptive readahead follows the sequence of these accesses.
+  void Access(uint64_t offset, size_t n);
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override;
+
+ private:
+  // Reads from file_, going through rate_limiter_.
+  Status ReadFile(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const;
+
+  RandomAccessFile* const file_;
+  const size_t fixed_readahead_;  // Zero if adaptive
+  RateLimiter* const rate_limiter_;
+
+  // State of adaptive readahead.
+  uint64_t last_access_end_;
+  int sequential_accesses_;  // Accesses in a row after the first one
+  mutable size_t readahead_;
+
+  // Extent of the file held in buf_[0, buf_len_-1].
+  mutable char* buf_;
+  mutable size_t buf_capacity_;
+  mutable uint64_t buf_offset_;
+  mutable size_t buf_len_;
+
+  mutable bool direct_;  // If true, the file returns its own memory
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_READAHEAD_FILE_H_
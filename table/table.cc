@@ -4,37 +4,97 @@
 
 #include "leveldb/table.h"
 
+#include <string>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/readahead_file.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
+// The filter of a table, in either format.
+struct Table::Filter {
+  Filter() : block_filter(nullptr), full_filter(nullptr), data(nullptr) {}
+  ~Filter() {
+    delete block_filter;
+    delete full_filter;
+    delete[] data;
+  }
+
+  FilterBlockReader* block_filter;
+  FullFilterBlockReader* full_filter;  // At most one of the two is set
+  const char* data;  // Contents of the filter if heap allocated, or nullptr
+};
+
 struct Table::Rep {
   ~Rep() {
-    delete filter;
-    delete[] filter_data;
-    delete index_block;
+    if (index_cache_handle != nullptr) {
+      options.block_cache->Release(index_cache_handle);
+    } else {
+      delete index_block;
+    }
+    if (filter_cache_handle != nullptr) {
+      options.block_cache->Release(filter_cache_handle);
+    } else {
+      delete filter;
+    }
+  }
+
+  // Whether the index and filter are left to the block cache.
+  bool CacheIndexAndFilter() const {
+    return options.cache_index_and_filter_blocks &&
+           options.block_cache != nullptr;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
+  uint64_t compressed_cache_id;
+  std::string compression_dict;  // Empty if data blocks use no dictionary
 
-  BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  // The filter found by ReadMeta(), if filter_policy is not null.
+  const FilterPolicy* filter_policy;
+  BlockHandle filter_handle;
+  bool full_filter_format;
+
+  // The index block and filter, or nullptr while they are only in the block
+  // cache.  They are owned by the table unless the corresponding cache
+  // handle is set, in which case they are pinned in the block cache.
   Block* index_block;
+  Cache::Handle* index_cache_handle;
+  Filter* filter;
+  Cache::Handle* filter_cache_handle;
+
+  // If partitioned_index is true, index_block is the top-level index of
+  // the partitions, and the partitions have filters built with
+  // partition_filter_policy unless it is null.
+  bool partitioned_index;
+  const FilterPolicy* partition_filter_policy;
+
+  // Whether the filters also hold the key prefixes extracted by
+  // options.prefix_extractor.
+  bool prefix_filtered;
+
+  BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  BlockHandle index_handle;      // Saved from footer
 };
 
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -68,24 +128,45 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
+    rep->index_handle = footer.index_handle();
     rep->index_block = index_block;
+    rep->index_cache_handle = nullptr;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
+    rep->compressed_cache_id = (options.compressed_block_cache
+                                    ? options.compressed_block_cache->NewId()
+                                    : 0);
+    rep->filter_policy = nullptr;
+    rep->full_filter_format = false;
     rep->filter = nullptr;
+    rep->filter_cache_handle = nullptr;
+    rep->partitioned_index = false;
+    rep->partition_filter_policy = nullptr;
+    rep->prefix_filtered = false;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
+
+    // Hand the index block over to the block cache.  Blocks that cannot be
+    // cached are cheap to keep, since they are not copies of the file.
+    if (rep->CacheIndexAndFilter() && index_block_contents.cachable) {
+      rep->options.block_cache->Release(
+          (*table)->InsertIndexOrFilter(rep->index_handle, index_block,
+                                        index_block->size(),
+                                        &DeleteCachedBlock));
+      rep->index_block = nullptr;
+    }
   }
 
   return s;
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+  // An empty metaindex block consists of its restart array with a single
+  // restart point, and is never compressed.
+  static const uint64_t kEmptyBlockSize = 2 * sizeof(uint32_t);
+  if (footer.metaindex_handle().size() <= kEmptyBlockSize) {
+    return;  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -98,37 +179,218 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  iter->Seek(kCompressionDictBlockName);
+  if (iter->Valid() && iter->key() == Slice(kCompressionDictBlockName)) {
+    ReadCompressionDict(iter->value());
+  }
+  iter->Seek(kPartitionedIndexName);
+  if (iter->Valid() && iter->key() == Slice(kPartitionedIndexName)) {
+    rep_->partitioned_index = true;
+  }
+  if (rep_->options.prefix_extractor != nullptr) {
+    std::string key = kPrefixExtractorPrefix;
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    rep_->prefix_filtered = iter->Valid() && iter->key() == Slice(key);
+  }
+  // The table was written with at most one of the configured policies.
+  std::vector<const FilterPolicy*> policies(
+      rep_->options.filter_policy_per_level);
+  policies.insert(policies.begin(), rep_->options.filter_policy);
+  for (const FilterPolicy* policy : policies) {
+    if (policy == nullptr) continue;
+    if (rep_->partitioned_index) {
+      std::string key = kPartitionedFilterPrefix;
+      key.append(policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        rep_->partition_filter_policy = policy;
+        break;
+      }
+      continue;
+    }
+    std::string key = kFullFilterBlockPrefix;
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      SetFilter(policy, iter->value(), true);
+      break;
+    }
+    key = "filter.";
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      SetFilter(policy, iter->value(), false);
+      break;
+    }
   }
   delete iter;
   delete meta;
+
+  if (rep_->filter_policy != nullptr) {
+    Cache::Handle* cache_handle;
+    Filter* filter = ReadFilter(opt, &cache_handle);
+    if (cache_handle != nullptr) {
+      rep_->options.block_cache->Release(cache_handle);
+    } else {
+      rep_->filter = filter;
+    }
+  }
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::SetFilter(const FilterPolicy* policy,
+                      const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
-  BlockHandle filter_handle;
-  if (!filter_handle.DecodeFrom(&v).ok()) {
+  if (rep_->filter_handle.DecodeFrom(&v).ok()) {
+    rep_->filter_policy = policy;
+    rep_->full_filter_format = full;
+  }
+}
+
+Cache::Handle* Table::InsertIndexOrFilter(const BlockHandle& handle,
+                                          void* value, size_t charge,
+                                          void (*deleter)(const Slice&,
+                                                          void*)) const {
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  return rep_->options.block_cache->InsertWithPriority(
+      key, value, charge, deleter, Cache::kHighPriority);
+}
+
+static Cache::Handle* LookupIndexOrFilter(Cache* block_cache,
+                                          uint64_t cache_id,
+                                          const BlockHandle& handle) {
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  return block_cache->Lookup(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+}
+
+void Table::DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<Filter*>(value);
+}
+
+Table::Filter* Table::ReadFilter(const ReadOptions& options,
+                                 Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *cache_handle = nullptr;
+  if (rep_->CacheIndexAndFilter()) {
+    *cache_handle =
+        LookupIndexOrFilter(block_cache, rep_->cache_id, rep_->filter_handle);
+    if (*cache_handle != nullptr) {
+      return reinterpret_cast<Filter*>(block_cache->Value(*cache_handle));
+    }
+  }
+
+  BlockContents block;
+  if (!ReadBlock(rep_->file, options, rep_->filter_handle, &block).ok()) {
+    return nullptr;
+  }
+  Filter* filter = new Filter;
+  if (block.heap_allocated) {
+    filter->data = block.data.data();  // Will need to delete later
+  }
+  if (rep_->full_filter_format) {
+    filter->full_filter =
+        new FullFilterBlockReader(rep_->filter_policy, block.data);
+  } else {
+    filter->block_filter =
+        new FilterBlockReader(rep_->filter_policy, block.data);
+  }
+  if (rep_->CacheIndexAndFilter() && block.cachable) {
+    *cache_handle = InsertIndexOrFilter(rep_->filter_handle, filter,
+                                        block.data.size(), &DeleteCachedFilter);
+  }
+  return filter;
+}
+
+const Table::Filter* Table::GetFilter(const ReadOptions& options,
+                                      Cache::Handle** cache_handle) const {
+  *cache_handle = nullptr;
+  if (rep_->filter != nullptr || rep_->filter_policy == nullptr ||
+      !rep_->CacheIndexAndFilter()) {
+    return rep_->filter;
+  }
+  return ReadFilter(options, cache_handle);
+}
+
+void Table::ReleaseFilter(const Filter* filter,
+                          Cache::Handle* cache_handle) const {
+  if (cache_handle != nullptr) {
+    rep_->options.block_cache->Release(cache_handle);
+  } else if (filter != rep_->filter) {
+    delete filter;
+  }
+}
+
+Status Table::ReadIndexBlock(const ReadOptions& options, Block** block,
+                             Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  *cache_handle =
+      LookupIndexOrFilter(block_cache, rep_->cache_id, rep_->index_handle);
+  if (*cache_handle != nullptr) {
+    *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
+    return Status::OK();
+  }
+
+  // Every read of the table needs the index, so it is cached even if
+  // options.fill_cache is false.
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, options, rep_->index_handle, &contents);
+  if (s.ok()) {
+    *block = new Block(contents);
+    if (contents.cachable) {
+      *cache_handle = InsertIndexOrFilter(rep_->index_handle, *block,
+                                          (*block)->size(), &DeleteCachedBlock);
+    }
+  }
+  return s;
+}
+
+void Table::PinIndexAndFilter() {
+  if (!rep_->CacheIndexAndFilter()) {
+    return;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  if (rep_->index_block == nullptr) {
+    Block* block;
+    Cache::Handle* cache_handle;
+    if (ReadIndexBlock(opt, &block, &cache_handle).ok()) {
+      rep_->index_block = block;
+      rep_->index_cache_handle = cache_handle;
+    }
+  }
+  if (rep_->filter == nullptr && rep_->filter_policy != nullptr) {
+    rep_->filter = ReadFilter(opt, &rep_->filter_cache_handle);
+  }
+}
+
+void Table::ReadCompressionDict(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  if (!dict_handle.DecodeFrom(&v).ok()) {
     return;
   }
 
-  // We might want to unify with ReadBlock() if we start
-  // requiring checksum verification in Table::Open.
+  // Without the dictionary, reads of the data blocks fail with a
+  // corruption error, so there is no need to report the failure here.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!ReadBlock(rep_->file, opt, dict_handle, &block).ok()) {
     return;
   }
+  rep_->compression_dict.assign(block.data.data(), block.data.size());
   if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();  // Will need to delete later
+    delete[] block.data.data();
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
 Table::~Table() { delete rep_; }
@@ -137,9 +399,9 @@ static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+static void DeleteCachedCompressedBlock(const Slice& key, void* value) {
+  std::string* compressed_block = reinterpret_cast<std::string*>(value);
+  delete compressed_block;
 }
 
 static void ReleaseBlock(void* arg, void* h) {
@@ -148,12 +410,199 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+Status Table::ReadDataBlock(RandomAccessFile* file,
+                            const ReadOptions& options,
+                            const BlockHandle& handle,
+                            BlockContents* contents) const {
+  Cache* compressed_cache = rep_->options.compressed_block_cache;
+  if (compressed_cache == nullptr) {
+    return ReadBlock(file, options, handle, contents,
+                     rep_->compression_dict);
+  }
+
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->compressed_cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = compressed_cache->Lookup(key);
+  if (cache_handle != nullptr) {
+    // The checksum was verified, if requested, when the block was read.
+    const std::string* compressed_block = reinterpret_cast<std::string*>(
+        compressed_cache->Value(cache_handle));
+    Status s = UncompressBlockContents(
+        compressed_block->data(), compressed_block->size() - 1,
+        compressed_block->back(), rep_->compression_dict, contents);
+    compressed_cache->Release(cache_handle);
+    return s;
+  }
+
+  std::string* compressed_block = new std::string;
+  Status s = ReadBlock(file, options, handle, contents,
+                       rep_->compression_dict, compressed_block);
+  if (s.ok()) {
+    AddCompressedBlock(options, handle, compressed_block);
+  } else {
+    delete compressed_block;
+  }
+  return s;
+}
+
+void Table::AddCompressedBlock(const ReadOptions& options,
+                               const BlockHandle& handle,
+                               std::string* compressed_block) const {
+  Cache* compressed_cache = rep_->options.compressed_block_cache;
+  if (compressed_block->empty() || !options.fill_cache) {
+    delete compressed_block;
+    return;
+  }
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->compressed_cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  compressed_cache->Release(compressed_cache->Insert(
+      key, compressed_block, compressed_block->size(),
+      &DeleteCachedCompressedBlock));
+}
+
+void Table::PrefetchDataBlocks(const ReadOptions& options,
+                               const BlockHandle* handles, int n,
+                               Cache::Handle** pinned) const {
+  Cache* block_cache = rep_->options.block_cache;
+  std::vector<RandomAccessFile::ReadRequest> reads;
+  std::vector<int> read_blocks;  // Index in handles[] of each read
+  for (int i = 0; i < n; i++) {
+    pinned[i] = nullptr;
+    if (block_cache == nullptr || !options.fill_cache) {
+      continue;
+    }
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handles[i].offset());
+    pinned[i] = block_cache->Lookup(
+        Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (pinned[i] == nullptr) {
+      RandomAccessFile::ReadRequest read;
+      read.offset = handles[i].offset();
+      read.n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+      read.scratch = new char[read.n];
+      reads.push_back(read);
+      read_blocks.push_back(i);
+    }
+  }
+  if (reads.empty()) {
+    return;
+  }
+
+  rep_->file->SubmitReads(reads.data(), reads.size());
+  rep_->file->WaitForReads(reads.data(), reads.size());
+  for (size_t r = 0; r < reads.size(); r++) {
+    const int i = read_blocks[r];
+    if (reads[r].status.ok()) {
+      pinned[i] = InsertPrefetchedBlock(options, handles[i], reads[r].result,
+                                        reads[r].scratch);
+    } else {
+      delete[] reads[r].scratch;
+    }
+  }
+}
+
+Cache::Handle* Table::InsertPrefetchedBlock(const ReadOptions& options,
+                                            const BlockHandle& handle,
+                                            const Slice& contents,
+                                            char* buf) const {
+  std::string* compressed_block =
+      (rep_->options.compressed_block_cache != nullptr ? new std::string
+                                                       : nullptr);
+  BlockContents block_contents;
+  Status s = DecodeBlock(options, handle, contents, buf, &block_contents,
+                         rep_->compression_dict, compressed_block);
+  if (compressed_block != nullptr) {
+    if (s.ok()) {
+      AddCompressedBlock(options, handle, compressed_block);
+    } else {
+      delete compressed_block;
+    }
+  }
+  if (!s.ok()) {
+    return nullptr;
+  }
+  Block* block = new Block(block_contents);
+  if (!block_contents.cachable) {
+    delete block;
+    return nullptr;
+  }
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  return rep_->options.block_cache->InsertWithPriority(
+      key, block, block->size(), &DeleteCachedBlock, Cache::kLowPriority);
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->NewBlockIterator(options, index_value, Cache::kLowPriority);
+}
+
+// The readahead of the data block reads of one table iterator.
+struct Table::Readahead {
+  Readahead(const Table* t, size_t readahead_size, RateLimiter* rate_limiter)
+      : table(t), file(t->rep_->file, readahead_size, rate_limiter) {}
+
+  const Table* const table;
+  ReadaheadFile file;
+};
+
+// Like BlockReader(), reading through the Readahead passed as "arg".
+Iterator* Table::ReadaheadBlockReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Readahead* readahead = reinterpret_cast<Readahead*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  if (handle.DecodeFrom(&input).ok()) {
+    readahead->file.Access(handle.offset(),
+                           static_cast<size_t>(handle.size()) +
+                               kBlockTrailerSize);
+  }
+  return readahead->table->NewBlockIterator(options, index_value,
+                                            Cache::kLowPriority, nullptr,
+                                            nullptr, &readahead->file);
+}
+
+void Table::DeleteReadahead(void* arg, void* ignored) {
+  delete reinterpret_cast<Readahead*>(arg);
+}
+
+// Like BlockReader(), for the partitions of a partitioned index.
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return table->NewBlockIterator(options, index_value, Cache::kHighPriority);
+}
+
+// Like IndexPartitionReader(), for iterators that honour the iterate bounds.
+Iterator* Table::BoundedIndexPartitionReader(void* arg,
+                                             const ReadOptions& options,
+                                             const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return table->NewBlockIterator(options, index_value, Cache::kHighPriority,
+                                 options.iterate_lower_bound,
+                                 options.iterate_upper_bound);
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const Slice& index_value,
+                                  Cache::Priority priority,
+                                  const Slice* lower_bound,
+                                  const Slice* upper_bound,
+                                  RandomAccessFile* file) const {
+  if (file == nullptr) {
+    file = rep_->file;
+  }
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -167,24 +616,24 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadDataBlock(file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            cache_handle = block_cache->InsertWithPriority(
+                key, block, block->size(), &DeleteCachedBlock, priority);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadDataBlock(file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -193,7 +642,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator, lower_bound,
+                              upper_bound);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -205,24 +655,339 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+Iterator* Table::NewIndexBlockIterator(const ReadOptions& options,
+                                       const Slice* lower_bound,
+                                       const Slice* upper_bound) const {
+  if (rep_->index_block != nullptr) {
+    return rep_->index_block->NewIterator(rep_->options.comparator,
+                                          lower_bound, upper_bound);
+  }
+  Block* block;
+  Cache::Handle* cache_handle;
+  Status s = ReadIndexBlock(options, &block, &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter =
+      block->NewIterator(rep_->options.comparator, lower_bound, upper_bound);
+  if (cache_handle == nullptr) {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, rep_->options.block_cache,
+                          cache_handle);
+  }
+  return iter;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = NewIndexBlockIterator(options, options.iterate_lower_bound,
+                                         options.iterate_upper_bound);
+  if (rep_->partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Table::BoundedIndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
+// The index iterator of Table::NewIterator() for ReadOptions::async_io.
+// Each Next() to the entry of a data block starts an asynchronous read of
+// the block after it, which proceeds while the caller goes through the
+// current block, and which the next Next() hands over through the block
+// cache.  Only one read is in flight at a time.
+class Table::PrefetchingIndexIterator : public Iterator {
+ public:
+  PrefetchingIndexIterator(const Table* table, const ReadOptions& options)
+      : table_(table),
+        options_(options),
+        index_iter_(table->NewIndexIterator(options)),
+        ahead_iter_(table->NewIndexIterator(options)),
+        ahead_synced_(false),
+        read_pending_(false),
+        pinned_(nullptr) {}
+
+  ~PrefetchingIndexIterator() override {
+    FinishPrefetch();
+    Unpin();
+    delete index_iter_;
+    delete ahead_iter_;
+  }
+
+  bool Valid() const override { return index_iter_->Valid(); }
+  Slice key() const override { return index_iter_->key(); }
+  Slice value() const override { return index_iter_->value(); }
+  // Errors of ahead_iter_ show up in index_iter_ once it gets there.
+  Status status() const override { return index_iter_->status(); }
+
+  void Seek(const Slice& target) override {
+    ahead_synced_ = false;
+    index_iter_->Seek(target);
+  }
+  void SeekToFirst() override {
+    ahead_synced_ = false;
+    index_iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    ahead_synced_ = false;
+    index_iter_->SeekToLast();
+  }
+  void Prev() override {
+    ahead_synced_ = false;
+    index_iter_->Prev();
+  }
+
+  void Next() override {
+    index_iter_->Next();
+    if (!index_iter_->Valid()) {
+      return;
+    }
+    // The block being read ahead, if any, is the one needed now.
+    FinishPrefetch();
+
+    // Keep ahead_iter_ one entry after index_iter_.
+    if (ahead_synced_) {
+      ahead_iter_->Next();
+    } else {
+      ahead_iter_->Seek(index_iter_->key());
+      if (ahead_iter_->Valid()) {
+        ahead_iter_->Next();
+      }
+    }
+    ahead_synced_ = ahead_iter_->Valid();
+    if (ahead_synced_) {
+      StartPrefetch(ahead_iter_->value());
+    }
+  }
+
+ private:
+  void StartPrefetch(Slice index_value) {
+    if (!read_handle_.DecodeFrom(&index_value).ok()) {
+      return;
+    }
+    Cache* block_cache = table_->rep_->options.block_cache;
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, table_->rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, read_handle_.offset());
+    Cache::Handle* cache_handle = block_cache->Lookup(
+        Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (cache_handle != nullptr) {
+      block_cache->Release(cache_handle);
+      return;
+    }
+    read_ = RandomAccessFile::ReadRequest();
+    read_.offset = read_handle_.offset();
+    read_.n = static_cast<size_t>(read_handle_.size()) + kBlockTrailerSize;
+    read_.scratch = new char[read_.n];
+    table_->rep_->file->SubmitReads(&read_, 1);
+    read_pending_ = true;
+  }
+
+  // Waits for the read in flight, if any, and inserts the block into the
+  // block cache.  The block stays pinned until the next call so that it
+  // is still cached when the caller looks it up.
+  void FinishPrefetch() {
+    if (!read_pending_) {
+      return;
+    }
+    table_->rep_->file->WaitForReads(&read_, 1);
+    read_pending_ = false;
+    Unpin();
+    if (read_.status.ok()) {
+      pinned_ = table_->InsertPrefetchedBlock(options_, read_handle_,
+                                              read_.result, read_.scratch);
+    } else {
+      delete[] read_.scratch;
+    }
+  }
+
+  void Unpin() {
+    if (pinned_ != nullptr) {
+      table_->rep_->options.block_cache->Release(pinned_);
+      pinned_ = nullptr;
+    }
+  }
+
+  const Table* const table_;
+  const ReadOptions options_;
+  Iterator* const index_iter_;
+  Iterator* const ahead_iter_;  // One entry after index_iter_ if synced
+  bool ahead_synced_;
+  bool read_pending_;
+  BlockHandle read_handle_;
+  RandomAccessFile::ReadRequest read_;
+  Cache::Handle* pinned_;
+};
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Iterator* index_iter;
+  if (options.async_io && options.fill_cache &&
+      rep_->options.block_cache != nullptr) {
+    index_iter = new PrefetchingIndexIterator(this, options);
+  } else {
+    index_iter = NewIndexIterator(options);
+  }
+  Readahead* readahead = new Readahead(
+      this, options.readahead_size,
+      options.rate_limit_reads ? rep_->options.rate_limiter : nullptr);
+  Iterator* iter = NewTwoLevelIterator(index_iter, &Table::ReadaheadBlockReader,
+                                       readahead, options);
+  iter->RegisterCleanup(&DeleteReadahead, readahead, nullptr);
+  return iter;
+}
+
+namespace {
+
+// The contents of a filter partition held in the block cache.
+struct FilterPartition {
+  ~FilterPartition() {
+    if (heap_allocated) {
+      delete[] data.data();
+    }
+  }
+
+  Slice data;
+  bool heap_allocated;
+};
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+}  // namespace
+
+bool Table::PartitionMayMatch(const ReadOptions& options,
+                              const Slice& partition_value,
+                              const Slice& key) const {
+  const FilterPolicy* policy = rep_->partition_filter_policy;
+  if (policy == nullptr) {
+    return true;
+  }
+  Slice input = partition_value;
+  BlockHandle index_handle, filter_handle;
+  if (!index_handle.DecodeFrom(&input).ok() ||
+      !filter_handle.DecodeFrom(&input).ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, filter_handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      const FilterPartition* filter = reinterpret_cast<FilterPartition*>(
+          block_cache->Value(cache_handle));
+      const bool result = policy->KeyMayMatch(key, filter->data);
+      block_cache->Release(cache_handle);
+      return result;
+    }
+  }
+
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, options, filter_handle, &contents).ok()) {
+    return true;
+  }
+  FilterPartition* filter = new FilterPartition;
+  filter->data = contents.data;
+  filter->heap_allocated = contents.heap_allocated;
+  const bool result = filter->data.empty()
+                          ? false  // The partition has no keys
+                          : policy->KeyMayMatch(key, filter->data);
+  if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+    block_cache->Release(block_cache->InsertWithPriority(
+        cache_key, filter, filter->data.size(), &DeleteCachedFilterPartition,
+        Cache::kHighPriority));
+  } else {
+    delete filter;
+  }
+  return result;
+}
+
+bool Table::PrefixMayMatch(const ReadOptions& options, const Slice& target,
+                           const Slice& prefix_key) const {
+  if (!rep_->prefix_filtered) {
+    return true;
+  }
+  // Entries >= target with the prefix, if any, start with the first entry
+  // >= target.  That entry is in the block (or partition) that an index
+  // seek finds, or is the first entry of the next one.
+  bool result = true;
+  Iterator* iiter = nullptr;
+  Cache::Handle* filter_cache_handle = nullptr;
+  const Filter* filter = nullptr;
+  if (rep_->partitioned_index) {
+    if (rep_->partition_filter_policy != nullptr) {
+      iiter = NewIndexBlockIterator(options);
+      iiter->Seek(target);
+      result = false;
+      for (int i = 0; i < 2 && iiter->Valid() && !result; i++) {
+        result = PartitionMayMatch(options, iiter->value(), prefix_key);
+        iiter->Next();
+      }
+    }
+  } else {
+    filter = GetFilter(options, &filter_cache_handle);
+    if (filter != nullptr && filter->full_filter != nullptr) {
+      result = filter->full_filter->KeyMayMatch(prefix_key);
+    } else if (filter != nullptr && filter->block_filter != nullptr) {
+      iiter = NewIndexBlockIterator(options);
+      iiter->Seek(target);
+      result = false;
+      for (int i = 0; i < 2 && iiter->Valid() && !result; i++) {
+        Slice handle_value = iiter->value();
+        BlockHandle handle;
+        result = !handle.DecodeFrom(&handle_value).ok() ||
+                 filter->block_filter->KeyMayMatch(handle.offset(), prefix_key);
+        iiter->Next();
+      }
+    }
+  }
+  if (iiter != nullptr) {
+    if (!iiter->status().ok()) {
+      result = true;  // Errors are treated as potential matches
+    }
+    delete iiter;
+  }
+  ReleaseFilter(filter, filter_cache_handle);
+  return result;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
+  Cache::Handle* filter_cache_handle;
+  const Filter* filter = GetFilter(options, &filter_cache_handle);
+  if (filter != nullptr && filter->full_filter != nullptr &&
+      !filter->full_filter->KeyMayMatch(k)) {
+    ReleaseFilter(filter, filter_cache_handle);
+    return Status::OK();  // Not found, without touching the index
+  }
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter;
+  if (rep_->partitioned_index) {
+    // Check the filter of the partition before reading the partition.
+    Iterator* top = NewIndexBlockIterator(options);
+    top->Seek(k);
+    if (!top->Valid() || !PartitionMayMatch(options, top->value(), k)) {
+      s = top->status();
+      delete top;
+      ReleaseFilter(filter, filter_cache_handle);
+      return s;
+    }
+    iiter = IndexPartitionReader(this, options, top->value());
+    delete top;
+  } else {
+    iiter = NewIndexBlockIterator(options);
+  }
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
+    FilterBlockReader* block_filter =
+        (filter != nullptr ? filter->block_filter : nullptr);
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (block_filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
+        !block_filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
@@ -238,12 +1003,116 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     s = iiter->status();
   }
   delete iiter;
+  ReleaseFilter(filter, filter_cache_handle);
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  if (rep_->partitioned_index) {
+    // Look the keys up one by one.  The partitions they share stay in the
+    // block cache between lookups.
+    for (int i = 0; i < n && s.ok(); i++) {
+      s = InternalGet(options, keys[i], args[i], handle_result);
+    }
+    return s;
+  }
+  const Comparator* cmp = rep_->options.comparator;
+  Cache::Handle* filter_cache_handle;
+  const Filter* filter = GetFilter(options, &filter_cache_handle);
+  FullFilterBlockReader* full_filter =
+      (filter != nullptr ? filter->full_filter : nullptr);
+  FilterBlockReader* block_filter =
+      (filter != nullptr ? filter->block_filter : nullptr);
+  Iterator* iiter = NewIndexBlockIterator(options);
+
+  // Find the data block each key may be in; keys with an empty
+  // block_values[i] are not in the table.
+  std::vector<std::string> block_values(n);
+  int num_blocks = 0;
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (full_filter != nullptr && !full_filter->KeyMayMatch(k)) {
+      continue;  // Not found
+    }
+    // The index entry found for the previous key is still the right one
+    // as long as its separator is >= k.
+    if (!iiter->Valid() || cmp->Compare(iiter->key(), k) < 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      break;  // This and all later keys are past the end of the table
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (block_filter != nullptr &&
+        !block_filter->KeyMayMatch(handle.offset(), k)) {
+      continue;  // Not found
+    }
+    block_values[i] = iiter->value().ToString();
+    num_blocks++;
+  }
+
+  // Read the blocks missing from the block cache all at once.
+  std::vector<Cache::Handle*> pinned;
+  if (s.ok() && options.async_io && num_blocks > 1) {
+    std::vector<BlockHandle> handles;
+    const std::string* last_value = nullptr;
+    for (int i = 0; i < n; i++) {
+      if (block_values[i].empty() ||
+          (last_value != nullptr && *last_value == block_values[i])) {
+        continue;
+      }
+      last_value = &block_values[i];
+      Slice handle_value = block_values[i];
+      handles.emplace_back();
+      handles.back().DecodeFrom(&handle_value);
+    }
+    pinned.resize(handles.size());
+    PrefetchDataBlocks(options, handles.data(),
+                       static_cast<int>(handles.size()), pinned.data());
+  }
+
+  Iterator* block_iter = nullptr;
+  const std::string* block_value = nullptr;  // Index entry of block_iter
+  for (int i = 0; i < n && s.ok(); i++) {
+    if (block_values[i].empty()) {
+      continue;
+    }
+    if (block_iter == nullptr || *block_value != block_values[i]) {
+      delete block_iter;
+      block_iter = BlockReader(this, options, block_values[i]);
+      block_value = &block_values[i];
+    }
+    block_iter->Seek(keys[i]);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+  }
+  for (Cache::Handle* cache_handle : pinned) {
+    if (cache_handle != nullptr) {
+      rep_->options.block_cache->Release(cache_handle);
+    }
+  }
+  delete block_iter;
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  ReleaseFilter(filter, filter_cache_handle);
   return s;
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
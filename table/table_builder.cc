@@ -5,11 +5,15 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <string>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "table/block.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -30,11 +34,26 @@ struct TableBuilder::Rep {
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+                         : new FilterBlockBuilder(
+                               opt.filter_policy,
+                               opt.full_table_filter ||
+                                   opt.partition_index_and_filters)),
+        partitioned(opt.partition_index_and_filters),
+        top_index_block(&index_block_options),
+        pending_index_entry(false),
+        buffering(opt.compression == kZstdCompression &&
+                  opt.zstd_max_dict_bytes > 0),
+        buffered_bytes(0) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
   }
 
+  // A data block held back until the compression dictionary is trained.
+  struct BufferedBlock {
+    std::string contents;   // Uncompressed block contents
+    std::string index_key;  // Index key, once the next block has started
+  };
+
   Options options;              /* Data Block Options */
   Options index_block_options;  /* Index Block Options */
   WritableFile* file;           /* 抽象类，决定了如何进行文件的写入，主要实现为 PosixWritableFile */
@@ -47,6 +66,14 @@ struct TableBuilder::Rep {
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block; /* 构建 Filter Block 所需的 BlockBuilder */
 
+  // If partitioned, index_block holds the current index partition and
+  // filter_block the filter of its data blocks.  top_index_block maps the
+  // last key of each partition to the handles of the partition and of its
+  // filter.
+  const bool partitioned;
+  BlockBuilder top_index_block;
+  std::string last_index_key;  // Last key added to index_block
+
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
   // keys in the index block.  For example, consider a block boundary
@@ -60,6 +87,14 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;  /* 压缩之后的 Data Block */
+
+  // While buffering, data blocks are kept in buffered_blocks instead of
+  // being written, and neither their index entries nor their filters have
+  // been added yet.  All but the last buffered block know their index key.
+  bool buffering;
+  std::vector<BufferedBlock> buffered_blocks;
+  size_t buffered_bytes;
+  std::string compression_dict;  // Empty if data blocks use no dictionary
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
@@ -82,12 +117,17 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters != rep_->partitioned) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -107,18 +147,21 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 
     /* 通过 last_key 和 当前 key 计算得到一个 X，使得 last_entry <= X < key  */
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
 
     /* 向 Index Block 中添加上一个 Data Block 的 Index */
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    if (r->buffering) {
+      // The block's handle is not known until it is written.
+      r->buffered_blocks.back().index_key = r->last_key;
+    } else {
+      AddIndexEntry(r->last_key, r->pending_handle);
+    }
 
     /* 上一个 Data Block 的 Index Block 已经写完，故更新 pending_index_entry 为 false */
     r->pending_index_entry = false;
   }
 
   /* 若指定了 FilterPolicy，那么就会写入 Filter Block */
-  if (r->filter_block != nullptr) {
+  if (r->filter_block != nullptr && !r->buffering) {
     r->filter_block->AddKey(key);
   }
 
@@ -144,6 +187,19 @@ void TableBuilder::Flush() {
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
 
+  if (r->buffering) {
+    Slice raw = r->data_block.Finish();
+    r->buffered_blocks.emplace_back();
+    r->buffered_blocks.back().contents.assign(raw.data(), raw.size());
+    r->buffered_bytes += raw.size();
+    r->data_block.Reset();
+    r->pending_index_entry = true;
+    if (r->buffered_bytes >= r->options.zstd_max_train_bytes) {
+      EnterUnbuffered();
+    }
+    return;
+  }
+
   /* 对 Data Block 进行压缩，并生成 Block Handle */
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
@@ -168,38 +224,165 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
 
   /* 获取 Data Block 的全部数据 */
   Slice raw = block->Finish();
+  // Only data blocks are compressed with the dictionary, since it is read
+  // from the metaindex block after the index block has been read.
+  // Index partitions are only read after Table::Open(), so they may use
+  // the dictionary as well.
+  Slice dict;
+  if (block == &r->data_block || (r->partitioned && block == &r->index_block)) {
+    dict = r->compression_dict;
+  }
+  CompressAndWriteBlock(raw, dict, handle);
+  /* 清空 Data Block */
+  block->Reset();
+}
 
+void TableBuilder::CompressAndWriteBlock(const Slice& raw, const Slice& dict,
+                                         BlockHandle* handle) {
+  Rep* r = rep_;
   Slice block_contents;
 
   /* 默认压缩方式为 kSnappyCompression */
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
+  std::string* compressed = &r->compressed_output;
+  bool compressed_ok = false;
   switch (type) {
     case kNoCompression:
-      block_contents = raw;
       break;
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-
-      /* 进行 snappy 压缩，并且只有在压缩率大于 12.5 时才会选用压缩结果 */
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        /* 未配置压缩算法，或者是使用 snappy 压缩时压缩率低于 12.5% */
-        block_contents = raw;
-        type = kNoCompression;
-      }
+    case kSnappyCompression:
+      compressed_ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kZstdCompression:
+      compressed_ok = port::Zstd_Compress(r->options.zstd_compression_level,
+                                          raw.data(), raw.size(), compressed,
+                                          dict.data(), dict.size());
+      break;
+
+    case kLZ4Compression:
+      compressed_ok = port::LZ4_Compress(raw.data(), raw.size(), compressed);
       break;
-    }
+  }
+
+  /* 只有在压缩率大于 12.5% 时才会选用压缩结果 */
+  if (compressed_ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    /* 未配置压缩算法，压缩算法不可用，或者压缩率低于 12.5% */
+    block_contents = raw;
+    type = kNoCompression;
   }
   /* 将处理后的 block contents、压缩类型以及 block handle 写入到文件中 */
   WriteRawBlock(block_contents, type, handle);
   /* 清空临时存储 buffer */
   r->compressed_output.clear();
-  /* 清空 Data Block */
-  block->Reset();
+}
+
+void TableBuilder::EnterUnbuffered() {
+  Rep* r = rep_;
+  assert(r->buffering);
+  r->buffering = false;
+
+  // Every buffered block is a sample; the budget is already bounded by
+  // zstd_max_train_bytes.  If training fails, e.g. because there are too
+  // few samples, the blocks are compressed without a dictionary.
+  std::string samples;
+  std::vector<size_t> sample_lengths;
+  samples.reserve(r->buffered_bytes);
+  for (const Rep::BufferedBlock& b : r->buffered_blocks) {
+    samples.append(b.contents);
+    sample_lengths.push_back(b.contents.size());
+  }
+  if (sample_lengths.empty() ||
+      !port::Zstd_TrainDictionary(samples.data(), sample_lengths.data(),
+                                  sample_lengths.size(),
+                                  r->options.zstd_max_dict_bytes,
+                                  &r->compression_dict)) {
+    r->compression_dict.clear();
+  }
+
+  // Write the blocks, adding the index entries and filter keys that were
+  // held back while buffering.
+  const size_t n = r->buffered_blocks.size();
+  for (size_t i = 0; i < n && ok(); i++) {
+    const Rep::BufferedBlock& b = r->buffered_blocks[i];
+    if (r->filter_block != nullptr) {
+      BlockContents contents;
+      contents.data = b.contents;
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      Block block(contents);
+      Iterator* iter = block.NewIterator(r->options.comparator);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        r->filter_block->AddKey(iter->key());
+      }
+      delete iter;
+    }
+
+    BlockHandle handle;
+    CompressAndWriteBlock(b.contents, r->compression_dict, &handle);
+    if (!ok()) {
+      break;
+    }
+    if (r->filter_block != nullptr) {
+      r->filter_block->StartBlock(r->offset);
+    }
+    if (i + 1 < n) {
+      AddIndexEntry(b.index_key, handle);
+    } else {
+      // The last block's index key depends on the next key added, so it
+      // stays pending as if the block had just been flushed.
+      r->pending_handle = handle;
+    }
+  }
+  if (ok()) {
+    r->status = r->file->Flush();
+  }
+  r->buffered_blocks.clear();
+  r->buffered_bytes = 0;
+}
+
+void TableBuilder::AddIndexEntry(const Slice& key, const BlockHandle& handle) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(key, Slice(handle_encoding));
+  if (r->partitioned) {
+    r->last_index_key.assign(key.data(), key.size());
+    if (r->index_block.CurrentSizeEstimate() >=
+        r->options.index_partition_size) {
+      WriteIndexPartition();
+    }
+  }
+}
+
+void TableBuilder::WriteIndexPartition() {
+  Rep* r = rep_;
+  assert(r->partitioned);
+  if (!ok() || r->index_block.empty()) return;
+
+  // The filter covers the keys of the data blocks indexed by the
+  // partition, since index entries are added before the keys of the
+  // next block.
+  BlockHandle filter_handle;
+  if (r->filter_block != nullptr) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_handle);
+    delete r->filter_block;
+    r->filter_block = new FilterBlockBuilder(r->options.filter_policy, true);
+  }
+  BlockHandle index_handle;
+  if (ok()) {
+    WriteBlock(&r->index_block, &index_handle);
+  }
+  if (ok()) {
+    std::string handle_encoding;
+    index_handle.EncodeTo(&handle_encoding);
+    if (r->filter_block != nullptr) {
+      filter_handle.EncodeTo(&handle_encoding);
+    }
+    r->top_index_block.Add(r->last_index_key, Slice(handle_encoding));
+  }
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -228,29 +411,76 @@ Status TableBuilder::Finish() {
 
   /* 将最后一个 Data Block 写入 */
   Flush();
+  if (r->buffering && ok()) {
+    EnterUnbuffered();
+  }
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle compression_dict_handle;
+
+  // Write compression dictionary block
+  if (ok() && !r->compression_dict.empty()) {
+    WriteRawBlock(r->compression_dict, kNoCompression,
+                  &compression_dict_handle);
+  }
+
+  // Write the last index partition, so that the filter of the table is
+  // complete.
+  if (r->partitioned && ok()) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      AddIndexEntry(r->last_key, r->pending_handle);
+      r->pending_index_entry = false;
+    }
+    WriteIndexPartition();
+  }
 
   // Write filter block
-  if (ok() && r->filter_block != nullptr) {
+  if (ok() && r->filter_block != nullptr && !r->partitioned) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // Its keys are block names, not internal keys.
+    Options meta_index_options = r->options;
+    meta_index_options.data_block_hash_index = false;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
+    // Keys must be added in sorted order.
+    if (!r->compression_dict.empty()) {
+      std::string handle_encoding;
+      compression_dict_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kCompressionDictBlockName, handle_encoding);
+    }
+    if (r->filter_block != nullptr && r->partitioned) {
+      // The filters are found through the top-level index.  The entry
+      // records the policy that built them.
+      std::string key = kPartitionedFilterPrefix;
+      key.append(r->options.filter_policy->Name());
+      meta_index_block.Add(key, Slice());
+    } else if (r->filter_block != nullptr) {
+      // Add mapping from "filter.Name" or "fullfilter.Name" to location of
+      // filter data
+      std::string key =
+          r->options.full_table_filter ? kFullFilterBlockPrefix : "filter.";
       /* 若使用 Bloom Filter，key 的值为 filter.leveldb.BuiltinBloomFilter2 */
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->partitioned) {
+      meta_index_block.Add(kPartitionedIndexName, Slice());
+    }
+    if (r->filter_block != nullptr && r->options.prefix_extractor != nullptr) {
+      std::string key = kPrefixExtractorPrefix;
+      key.append(r->options.prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     /* 写入 Metaindex Block */
@@ -258,7 +488,9 @@ Status TableBuilder::Finish() {
   }
 
   // Write index block
-  if (ok()) {
+  if (ok() && r->partitioned) {
+    WriteBlock(&r->top_index_block, &index_block_handle);
+  } else if (ok()) {
     if (r->pending_index_entry) {
       r->options.comparator->FindShortSuccessor(&r->last_key);
       std::string handle_encoding;
@@ -292,6 +524,10 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::FileSize() const {
+  // Blocks held back for the dictionary count at their uncompressed size,
+  // so that callers splitting tables by size do not overshoot.
+  return rep_->offset + rep_->buffered_bytes;
+}
 
 }  // namespace leveldb
@@ -13,11 +13,14 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/readahead_file.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -125,11 +128,23 @@ class StringSource : public RandomAccessFile {
     }
     std::memcpy(scratch, &contents_[offset], n);
     *result = Slice(scratch, n);
+    reads_++;
     return Status::OK();
   }
 
+  size_t reads() const { return reads_; }
+
+  void SubmitReads(ReadRequest* reqs, size_t n) const override {
+    submitted_reads_ += n;
+    RandomAccessFile::SubmitReads(reqs, n);
+  }
+
+  size_t submitted_reads() const { return submitted_reads_; }
+
  private:
   std::string contents_;
+  mutable size_t reads_ = 0;
+  mutable size_t submitted_reads_ = 0;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -230,6 +245,10 @@ class TableConstructor : public Constructor {
     source_ = new StringSource(sink.contents());
     Options table_options;
     table_options.comparator = options.comparator;
+    table_options.filter_policy = options.filter_policy;
+    table_options.block_cache = options.block_cache;
+    table_options.cache_index_and_filter_blocks =
+        options.cache_index_and_filter_blocks;
     return Table::Open(table_options, source_, sink.contents().size(), &table_);
   }
 
@@ -237,6 +256,13 @@ class TableConstructor : public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
+  size_t submitted_reads() const { return source_->submitted_reads(); }
+  size_t reads() const { return source_->reads(); }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
@@ -376,30 +402,33 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partitioned_index;
 };
 
 static const TestArgs kTestArgList[] = {
-    {TABLE_TEST, false, 16},
-    {TABLE_TEST, false, 1},
-    {TABLE_TEST, false, 1024},
-    {TABLE_TEST, true, 16},
-    {TABLE_TEST, true, 1},
-    {TABLE_TEST, true, 1024},
-
-    {BLOCK_TEST, false, 16},
-    {BLOCK_TEST, false, 1},
-    {BLOCK_TEST, false, 1024},
-    {BLOCK_TEST, true, 16},
-    {BLOCK_TEST, true, 1},
-    {BLOCK_TEST, true, 1024},
+    {TABLE_TEST, false, 16, false},
+    {TABLE_TEST, false, 1, false},
+    {TABLE_TEST, false, 1024, false},
+    {TABLE_TEST, true, 16, false},
+    {TABLE_TEST, true, 1, false},
+    {TABLE_TEST, true, 1024, false},
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
+
+    {BLOCK_TEST, false, 16, false},
+    {BLOCK_TEST, false, 1, false},
+    {BLOCK_TEST, false, 1024, false},
+    {BLOCK_TEST, true, 16, false},
+    {BLOCK_TEST, true, 1, false},
+    {BLOCK_TEST, true, 1024, false},
 
     // Restart interval does not matter for memtables
-    {MEMTABLE_TEST, false, 16},
-    {MEMTABLE_TEST, true, 16},
+    {MEMTABLE_TEST, false, 16, false},
+    {MEMTABLE_TEST, true, 16, false},
 
     // Do not bother with restart interval variations for DB
-    {DB_TEST, false, 16},
-    {DB_TEST, true, 16},
+    {DB_TEST, false, 16, false},
+    {DB_TEST, true, 16, false},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -419,6 +448,11 @@ class Harness : public testing::Test {
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
+    if (args.partitioned_index) {
+      // Small partitions, so that tables have several of them.
+      options_.partition_index_and_filters = true;
+      options_.index_partition_size = 64;
+    }
     switch (args.type) {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
@@ -699,7 +733,7 @@ TEST_F(Harness, Randomized) {
 
 TEST_F(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = {DB_TEST, false, 16};
+  TestArgs args = {DB_TEST, false, 16, false};
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -745,6 +779,160 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+// Builds a block of internal keys holding 1 to 4 versions of every other
+// user key, with or without a hash index.
+static std::string BuildInternalKeyBlock(const Options& options, int num_keys,
+                                         std::vector<std::string>* keys) {
+  BlockBuilder builder(&options);
+  Random rnd(301);
+  for (int i = 0; i < num_keys; i += 2) {
+    char user_key[20];
+    std::snprintf(user_key, sizeof(user_key), "key%06d", i);
+    SequenceNumber seq = 100;
+    for (int v = 1 + rnd.Uniform(4); v > 0; v--) {
+      seq -= 1 + rnd.Uniform(20);
+      std::string key;
+      AppendInternalKey(&key, ParsedInternalKey(user_key, seq, kTypeValue));
+      builder.Add(key, "value");
+      keys->push_back(key);
+    }
+  }
+  return builder.Finish().ToString();
+}
+
+TEST(BlockTest, DataBlockHashIndex) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  // Short intervals, so that some user keys span two of them.
+  options.block_restart_interval = 4;
+  const int kNumKeys = 200;
+  std::vector<std::string> plain_keys, keys;
+  const std::string plain_data =
+      BuildInternalKeyBlock(options, kNumKeys, &plain_keys);
+  options.data_block_hash_index = true;
+  const std::string hashed_data =
+      BuildInternalKeyBlock(options, kNumKeys, &keys);
+  ASSERT_GT(hashed_data.size(), plain_data.size());
+  ASSERT_NE(0, DecodeFixed32(hashed_data.data() + hashed_data.size() - 4) &
+                   kDataBlockHashIndexFlag);
+
+  BlockContents contents;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  contents.data = plain_data;
+  Block plain_block(contents);
+  contents.data = hashed_data;
+  Block hashed_block(contents);
+  Iterator* plain = plain_block.NewIterator(&cmp);
+  Iterator* hashed = hashed_block.NewIterator(&cmp);
+
+  // Seeking either block must give the same result for present and absent
+  // user keys, at sequence numbers before, between and after their
+  // versions, and in any order.
+  Random rnd(test::RandomSeed());
+  for (int i = 0; i < 5000; i++) {
+    char user_key[20];
+    std::snprintf(user_key, sizeof(user_key), "key%06d",
+                  static_cast<int>(rnd.Uniform(kNumKeys + 2)) - 1);
+    std::string target;
+    AppendInternalKey(&target, ParsedInternalKey(user_key, rnd.Uniform(110),
+                                                 kValueTypeForSeek));
+    plain->Seek(target);
+    hashed->Seek(target);
+    ASSERT_EQ(plain->Valid(), hashed->Valid()) << user_key;
+    if (plain->Valid()) {
+      ASSERT_EQ(plain->key().ToString(), hashed->key().ToString());
+      hashed->Next();
+      plain->Next();
+      ASSERT_EQ(plain->Valid(), hashed->Valid());
+    }
+  }
+  ASSERT_LEVELDB_OK(hashed->status());
+
+  // Iteration is unaffected.
+  hashed->SeekToFirst();
+  for (const std::string& key : keys) {
+    ASSERT_TRUE(hashed->Valid());
+    ASSERT_EQ(key, hashed->key().ToString());
+    hashed->Next();
+  }
+  ASSERT_TRUE(!hashed->Valid());
+  delete plain;
+  delete hashed;
+}
+
+TEST(BlockTest, NoDataBlockHashIndexForManyRestarts) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 1;
+  options.data_block_hash_index = true;
+  std::vector<std::string> keys;
+  const std::string data = BuildInternalKeyBlock(options, 1000, &keys);
+  ASSERT_GT(keys.size(), kDataBlockHashIndexMaxRestarts);
+  ASSERT_EQ(keys.size(), DecodeFixed32(data.data() + data.size() - 4));
+
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(&cmp);
+  for (const std::string& key : keys) {
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+  }
+  delete iter;
+}
+
+TEST(BlockTest, IterateBounds) {
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options);
+  for (int i = 0; i < 20; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%02d", i);
+    builder.Add(key, "v");
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  // As for an index block, Next() stops after the first entry >= the upper
+  // bound, and Prev() at the first entry < the lower bound.
+  const Slice lower("k05");
+  const Slice upper("k09x");
+  Iterator* iter = block.NewIterator(BytewiseComparator(), &lower, &upper);
+  iter->Seek("k08");
+  ASSERT_EQ("k08", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("k09", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("k10", iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+
+  iter->Seek("k06");
+  iter->Prev();
+  ASSERT_EQ("k05", iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+
+  // The last entry is below the lower bound, so no entry is.
+  const Slice high_lower("k99");
+  iter = block.NewIterator(BytewiseComparator(), &high_lower, nullptr);
+  iter->SeekToLast();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -784,16 +972,281 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
-static bool SnappyCompressionSupported() {
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.index_partition_size = 1;  // One data block per partition
+  c.Finish(options, &keys, &kvmap);
+
+  // Offsets are found through the top-level index and the partitions, and
+  // each partition is written after its data block.
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01a"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k02"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"), 0, 100));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"), 10000, 11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04a"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+}
+
+TEST(TableTest, CacheIndexAndFilterBlocks) {
+  Cache* block_cache = NewLRUCache(1 << 20);
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+  {
+    TableConstructor c(BytewiseComparator());
+    Random rnd(301);
+    std::string value;
+    for (int i = 0; i < 1000; i++) {
+      char key[16];
+      std::snprintf(key, sizeof(key), "k%06d", i);
+      c.Add(key, test::RandomString(&rnd, 100, &value).ToString());
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kNoCompression;
+    options.filter_policy = filter_policy;
+    options.block_cache = block_cache;
+    options.cache_index_and_filter_blocks = true;
+    c.Finish(options, &keys, &kvmap);
+
+    // Opening the table charged its index and filter to the block cache.
+    const size_t meta_charge = block_cache->TotalCharge();
+    ASSERT_GT(meta_charge, 1000 * 10 / 8);
+
+    // Evicted blocks are read again as needed.
+    for (int round = 0; round < 2; round++) {
+      block_cache->Prune();
+      ASSERT_EQ(0, block_cache->TotalCharge());
+      Iterator* iter = c.NewIterator();
+      iter->Seek("k000500");
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ("k000500", iter->key().ToString());
+      delete iter;
+      ASSERT_GT(block_cache->TotalCharge(), 0);
+    }
+  }
+  delete filter_policy;
+  delete block_cache;
+}
+
+TEST(TableTest, AsyncIOIterator) {
+  Cache* block_cache = NewLRUCache(1 << 20);
+  {
+    TableConstructor c(BytewiseComparator());
+    Random rnd(301);
+    std::string value;
+    for (int i = 0; i < 1000; i++) {
+      char key[16];
+      std::snprintf(key, sizeof(key), "k%06d", i);
+      c.Add(key, test::RandomString(&rnd, 100, &value).ToString());
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kNoCompression;
+    options.block_cache = block_cache;
+    c.Finish(options, &keys, &kvmap);
+
+    ReadOptions ro;
+    ro.async_io = true;
+    for (int round = 0; round < 2; round++) {
+      const size_t submitted_before = c.submitted_reads();
+      Iterator* iter = c.NewIterator(ro);
+      KVMap::const_iterator expected = kvmap.begin();
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+        ASSERT_TRUE(expected != kvmap.end());
+        ASSERT_EQ(expected->first, iter->key().ToString());
+        ASSERT_EQ(expected->second, iter->value().ToString());
+      }
+      ASSERT_TRUE(expected == kvmap.end());
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+
+      // The first scan reads all blocks but the first one ahead of time,
+      // and the second one finds them in the cache.
+      const size_t submitted = c.submitted_reads() - submitted_before;
+      if (round == 0) {
+        ASSERT_GT(submitted, 50);
+      } else {
+        ASSERT_EQ(0, submitted);
+      }
+    }
+
+    // Seeks and reverse scans do not get in the way of read-ahead.
+    block_cache->Prune();
+    Iterator* iter = c.NewIterator(ro);
+    iter->Seek("k000500");
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("k000500", iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ("k000499", iter->key().ToString());
+    iter->Next();
+    iter->Next();
+    ASSERT_EQ("k000501", iter->key().ToString());
+    iter->Seek("k000900");
+    int count = 0;
+    for (; iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_EQ(100, count);
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+  delete block_cache;
+}
+
+// Reads "num_blocks" blocks of "block_size" bytes from "file", starting at
+// block "first" and then every "stride" blocks.
+static void ReadBlocks(const std::string& contents, ReadaheadFile* file,
+                       size_t block_size, int first, int stride,
+                       int num_blocks) {
+  std::string scratch(block_size, '\0');
+  for (int i = 0; i < num_blocks; i++) {
+    const uint64_t offset = (first + i * stride) * block_size;
+    file->Access(offset, block_size);
+    Slice result;
+    ASSERT_LEVELDB_OK(file->Read(offset, block_size, &result, &scratch[0]));
+    ASSERT_EQ(Slice(contents.data() + offset, block_size), result);
+  }
+}
+
+TEST(ReadaheadFileTest, Adaptive) {
+  Random rnd(301);
+  std::string contents;
+  test::RandomString(&rnd, 1 << 20, &contents);
+  const size_t kBlockSize = 4096;
+
+  // Sequential reads.  After the first one, the window grows from 8KB to
+  // 256KB: 8 + 16 + ... + 256 covers 504KB in 6 reads, and the other 516KB
+  // take 3 more.
+  {
+    StringSource source(contents);
+    ReadaheadFile file(&source, 0);
+    ReadBlocks(contents, &file, kBlockSize, 0, 1, 256);
+    ASSERT_EQ(10, source.reads());
+  }
+
+  // Reads that skip blocks are not read ahead.
+  {
+    StringSource source(contents);
+    ReadaheadFile file(&source, 0);
+    ReadBlocks(contents, &file, kBlockSize, 0, 2, 128);
+    ASSERT_EQ(128, source.reads());
+  }
+
+  // A jump restarts readahead with a small window.
+  {
+    StringSource source(contents);
+    ReadaheadFile file(&source, 0);
+    ReadBlocks(contents, &file, kBlockSize, 0, 1, 64);
+    const size_t reads = source.reads();
+    ReadBlocks(contents, &file, kBlockSize, 128, 1, 3);
+    // One read before readahead starts, and one of 8KB for the others.
+    ASSERT_EQ(reads + 2, source.reads());
+  }
+}
+
+TEST(ReadaheadFileTest, FixedSize) {
+  Random rnd(301);
+  std::string contents;
+  test::RandomString(&rnd, 1 << 20, &contents);
+  const size_t kBlockSize = 4096;
+
+  StringSource source(contents);
+  ReadaheadFile file(&source, 64 * 1024);
+  ReadBlocks(contents, &file, kBlockSize, 0, 1, 256);
+  ASSERT_EQ(16, source.reads());
+
+  // A fixed size reads ahead even of scattered reads.
+  ReadaheadFile scattered_file(&source, 64 * 1024);
+  ReadBlocks(contents, &scattered_file, kBlockSize, 0, 2, 128);
+  ASSERT_EQ(32, source.reads());
+}
+
+TEST(TableTest, IteratorReadahead) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 1000; i++) {
+    char key[16];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    c.Add(key, test::RandomString(&rnd, 100, &value).ToString());
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  size_t readahead_sizes[] = {0, 16 * 1024};
+  for (size_t readahead_size : readahead_sizes) {
+    ReadOptions ro;
+    ro.readahead_size = readahead_size;
+    const size_t reads_before = c.reads();
+    Iterator* iter = c.NewIterator(ro);
+    KVMap::const_iterator expected = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_TRUE(expected != kvmap.end());
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == kvmap.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    // The table has more than 100 data blocks of about 1KB.
+    const size_t reads = c.reads() - reads_before;
+    ASSERT_LT(reads, 20);
+  }
+}
+
+static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
-  return port::Snappy_Compress(in.data(), in.size(), &out);
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Compress(in.data(), in.size(), &out);
+    case kZstdCompression:
+      return port::Zstd_Compress(/*level=*/1, in.data(), in.size(), &out);
+    case kLZ4Compression:
+      return port::LZ4_Compress(in.data(), in.size(), &out);
+    default:
+      return false;
+  }
 }
 
-TEST(TableTest, ApproximateOffsetOfCompressed) {
-  if (!SnappyCompressionSupported()) {
-    std::fprintf(stderr, "skipping compression tests\n");
-    return;
+class CompressionTableTest
+    : public ::testing::TestWithParam<CompressionType> {};
+
+INSTANTIATE_TEST_SUITE_P(CompressionTests, CompressionTableTest,
+                         ::testing::Values(kSnappyCompression,
+                                           kZstdCompression,
+                                           kLZ4Compression));
+
+TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
+  CompressionType type = GetParam();
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
   }
 
   Random rnd(301);
@@ -807,7 +1260,7 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   KVMap kvmap;
   Options options;
   options.block_size = 1024;
-  options.compression = kSnappyCompression;
+  options.compression = type;
   c.Finish(options, &keys, &kvmap);
 
   // Expected upper and lower bounds of space used by compressible strings.
@@ -826,6 +1279,77 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Builds a table of small, similar JSON documents and returns its size.
+static uint64_t BuildJsonTable(size_t max_dict_bytes, size_t max_train_bytes) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 2000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "user%08d", i);
+    c.Add(key, "{\"id\":" + std::to_string(i) +
+                   ",\"name\":\"user" + std::to_string(i * 7919 % 2000) +
+                   "\",\"active\":" + (i % 3 == 0 ? "true" : "false") +
+                   ",\"tags\":[\"alpha\",\"beta\"]}");
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 256;
+  options.compression = kZstdCompression;
+  options.zstd_max_dict_bytes = max_dict_bytes;
+  options.zstd_max_train_bytes = max_train_bytes;
+  c.Finish(options, &keys, &kvmap);
+
+  // Every entry reads back, whether or not the dictionary could be used.
+  Iterator* iter = c.NewIterator();
+  KVMap::const_iterator model = kvmap.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+    EXPECT_TRUE(model != kvmap.end());
+    EXPECT_EQ(model->first, iter->key().ToString());
+    EXPECT_EQ(model->second, iter->value().ToString());
+  }
+  EXPECT_TRUE(model == kvmap.end());
+  EXPECT_LEVELDB_OK(iter->status());
+  delete iter;
+  return c.ApproximateOffsetOf("xyz");
+}
+
+TEST(TableTest, CompressionDictionary) {
+  const uint64_t plain = BuildJsonTable(0, 0);
+  // The dictionary is trained on the first blocks only, and on all blocks
+  // of the table.
+  const uint64_t partial = BuildJsonTable(4096, 16 * 1024);
+  const uint64_t whole = BuildJsonTable(4096, 1024 * 1024);
+  if (CompressionSupported(kZstdCompression)) {
+    ASSERT_LT(partial, plain);
+    ASSERT_LT(whole, plain);
+  } else {
+    ASSERT_EQ(plain, partial);
+    ASSERT_EQ(plain, whole);
+  }
+}
+
+TEST(TableTest, FileSizeWhileTrainingDictionary) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kZstdCompression;
+  options.zstd_max_dict_bytes = 4096;
+  options.zstd_max_train_bytes = 1024 * 1024;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%08d", i);
+    builder.Add(key, std::string(100, 'x'));
+  }
+
+  // The data blocks wait for the dictionary, but count toward the size.
+  ASSERT_EQ(0, sink.contents().size());
+  ASSERT_GE(builder.FileSize(), N * 100 - options.block_size);
+  ASSERT_LEVELDB_OK(builder.Finish());
+  ASSERT_EQ(sink.contents().size(), builder.FileSize());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
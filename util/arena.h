@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 class Arena {
@@ -28,6 +31,13 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe variants of Allocate() and AllocateAligned() for callers
+  // that allocate from several threads at once, e.g. concurrent memtable
+  // inserts.  They may be mixed with the variants above only if the calls
+  // are externally ordered.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -50,6 +60,9 @@ class Arena {
   // TODO(costan): This member is accessed via atomics, but the others are
   //               accessed without any locking. Is this OK?
   std::atomic<size_t> memory_usage_;
+
+  // Serializes the *Concurrently() allocation paths.
+  port::Mutex mutex_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -66,6 +79,20 @@ inline char* Arena::Allocate(size_t bytes) {
   return AllocateFallback(bytes);
 }
 
+inline char* Arena::AllocateConcurrently(size_t bytes) {
+  mutex_.Lock();
+  char* result = Allocate(bytes);
+  mutex_.Unlock();
+  return result;
+}
+
+inline char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  mutex_.Lock();
+  char* result = AllocateAligned(bytes);
+  mutex_.Unlock();
+  return result;
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_ARENA_H_
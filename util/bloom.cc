@@ -4,12 +4,28 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <atomic>
+
 #include "leveldb/slice.h"
+#include "util/bloom_test_helper.h"
 #include "util/hash.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// The AVX2 probe kernel is compiled for AVX2 regardless of the build flags,
+// and only called if the CPU supports it.
+#define LEVELDB_BLOOM_AVX2 1
+#else
+#define LEVELDB_BLOOM_AVX2 0
+#endif
+
 namespace leveldb {
 
 namespace {
+
+// Cleared by tests to cover the scalar probe loop on CPUs with AVX2.
+std::atomic<bool> g_bloom_use_avx2(true);
+
 static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
@@ -84,6 +100,136 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A Bloom filter made of 64-byte lines.  Each key hashes to one line and
+// all of its probes set bits within that line, so a lookup touches a single
+// cache line (two if the filter is not line-aligned in memory) instead of
+// up to k of them.  The false positive rate is slightly higher than that of
+// a standard Bloom filter with the same number of bits.
+//
+// Filter layout: num_lines * 64 bytes of bits, followed by one byte with
+// the number of probes.
+class CacheLocalBloomFilterPolicy : public FilterPolicy {
+ public:
+  static const size_t kLineBytes = 64;
+  static const uint32_t kLineBitsLog2 = 9;  // 512 bits per line
+
+  explicit CacheLocalBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  const char* Name() const override {
+    return "leveldb.CacheLocalBloomFilter";
+  }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    const size_t bits = n * bits_per_key_;
+    size_t num_lines = (bits + kLineBytes * 8 - 1) / (kLineBytes * 8);
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, num_lines) * kLineBytes;
+      uint32_t probe = h;
+      for (size_t j = 0; j < k_; j++) {
+        probe *= kProbeMultiplier;
+        const uint32_t bitpos = probe >> (32 - kLineBitsLog2);
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < kLineBytes + 1) return false;
+
+    const char* array = bloom_filter.data();
+    const size_t num_lines = (len - 1) / kLineBytes;
+    const size_t k = array[len - 1];
+    if (k < 1 || k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const char* line = array + LineIndex(h, num_lines) * kLineBytes;
+#if LEVELDB_BLOOM_AVX2
+    static const bool kHaveAVX2 = __builtin_cpu_supports("avx2");
+    if (kHaveAVX2 && g_bloom_use_avx2.load(std::memory_order_relaxed)) {
+      return LineMayMatchAVX2(h, static_cast<int>(k), line);
+    }
+#endif  // LEVELDB_BLOOM_AVX2
+    uint32_t probe = h;
+    for (size_t j = 0; j < k; j++) {
+      probe *= kProbeMultiplier;
+      const uint32_t bitpos = probe >> (32 - kLineBitsLog2);
+      if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    }
+    return true;
+  }
+
+ private:
+  // Probe j of a key with hash h tests bit (h * kProbeMultiplier^(j+1))
+  // >> 23 of its line.  The multiplier is odd, so the probes of keys that
+  // share a line, and thus the high bits of h, still differ.
+  static const uint32_t kProbeMultiplier = 0x9e3779b9;
+
+  // Map h uniformly onto [0, num_lines) without a division.
+  static size_t LineIndex(uint32_t h, size_t num_lines) {
+    return static_cast<size_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+  }
+
+#if LEVELDB_BLOOM_AVX2
+  // Tests up to 8 probes at a time: computes their bit positions in the
+  // lanes of a vector, gathers the 32-bit words of the line that hold
+  // them, and checks all bits at once.  Relies on x86 being little-endian,
+  // so that bit b of the line is bit b % 32 of 32-bit word b / 32.
+  __attribute__((target("avx2"))) static bool LineMayMatchAVX2(
+      uint32_t h, int k, const char* line) {
+    // Lane i multiplies by kProbeMultiplier^(i+1).
+    const __m256i multipliers = _mm256_setr_epi32(
+        0x9e3779b9, 0xe35e67b1, 0x734297e9, 0x35fbe861, 0xdeb7c719,
+        0x448b211, 0x3459b749, 0xab25f4c1);
+    const __m256i multiplier8 = _mm256_set1_epi32(0xab25f4c1);
+    const __m256i lane_numbers = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i ones = _mm256_set1_epi32(1);
+    const __m256i low5 = _mm256_set1_epi32(31);
+
+    __m256i base = _mm256_set1_epi32(static_cast<int>(h));
+    for (;;) {
+      const __m256i probes = _mm256_mullo_epi32(base, multipliers);
+      const __m256i bitpos = _mm256_srli_epi32(probes, 32 - kLineBitsLog2);
+      const __m256i words = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(line), _mm256_srli_epi32(bitpos, 5), 4);
+      const __m256i bits =
+          _mm256_sllv_epi32(ones, _mm256_and_si256(bitpos, low5));
+      // Lanes past the last probe do not count.
+      const __m256i active =
+          _mm256_cmpgt_epi32(_mm256_set1_epi32(k), lane_numbers);
+      const __m256i missing =
+          _mm256_and_si256(_mm256_andnot_si256(words, bits), active);
+      if (!_mm256_testz_si256(missing, missing)) {
+        return false;
+      }
+      k -= 8;
+      if (k <= 0) {
+        return true;
+      }
+      base = _mm256_mullo_epi32(base, multiplier8);
+    }
+  }
+#endif  // LEVELDB_BLOOM_AVX2
+
+  size_t bits_per_key_;
+  size_t k_;
+};
 }  // namespace
 
 /* 创建一个 BloomFilterPolicy 对象，bits_per_key 一般取 10 */
@@ -91,4 +237,12 @@ const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewCacheLocalBloomFilterPolicy(int bits_per_key) {
+  return new CacheLocalBloomFilterPolicy(bits_per_key);
+}
+
+void BloomTestHelper::SetUseAVX2(bool use_avx2) {
+  g_bloom_use_avx2.store(use_avx2, std::memory_order_relaxed);
+}
+
 }  // namespace leveldb
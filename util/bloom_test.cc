@@ -4,6 +4,7 @@
 
 #include "gtest/gtest.h"
 #include "leveldb/filter_policy.h"
+#include "util/bloom_test_helper.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/testutil.h"
@@ -17,11 +18,22 @@ static Slice Key(int i, char* buffer) {
   return Slice(buffer, sizeof(uint32_t));
 }
 
-class BloomTest : public testing::Test {
+// kCacheLocalBloomScalar probes cache-local filters without AVX2.
+enum BloomType { kStandardBloom, kCacheLocalBloom, kCacheLocalBloomScalar };
+
+class BloomTest : public testing::TestWithParam<BloomType> {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest()
+      : policy_(GetParam() == kStandardBloom
+                    ? NewBloomFilterPolicy(10)
+                    : NewCacheLocalBloomFilterPolicy(10)) {
+    BloomTestHelper::SetUseAVX2(GetParam() != kCacheLocalBloomScalar);
+  }
 
-  ~BloomTest() { delete policy_; }
+  ~BloomTest() {
+    BloomTestHelper::SetUseAVX2(true);
+    delete policy_;
+  }
 
   void Reset() {
     keys_.clear();
@@ -44,6 +56,12 @@ class BloomTest : public testing::Test {
 
   size_t FilterSize() const { return filter_.size(); }
 
+  // Bytes a filter of "n" keys may take beyond 10 bits per key.
+  size_t FilterSlop() const {
+    // A cache-local filter is rounded up to whole 64-byte lines.
+    return GetParam() == kStandardBloom ? 40 : 65;
+  }
+
   void DumpFilter() {
     std::fprintf(stderr, "F(");
     for (size_t i = 0; i + 1 < filter_.size(); i++) {
@@ -62,6 +80,23 @@ class BloomTest : public testing::Test {
     return policy_->KeyMayMatch(s, filter_);
   }
 
+  // Number of 64-byte lines of the filter that "s" depends on, that is,
+  // whose clearing makes it miss.
+  int LinesProbed(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    int lines = 0;
+    for (size_t start = 0; start + 64 < filter_.size(); start += 64) {
+      std::string filter = filter_;
+      filter.replace(start, 64, 64, '\0');
+      if (!policy_->KeyMayMatch(s, filter)) {
+        lines++;
+      }
+    }
+    return lines;
+  }
+
   double FalsePositiveRate() {
     char buffer[sizeof(int)];
     int result = 0;
@@ -79,12 +114,12 @@ class BloomTest : public testing::Test {
   std::vector<std::string> keys_;
 };
 
-TEST_F(BloomTest, EmptyFilter) {
+TEST_P(BloomTest, EmptyFilter) {
   ASSERT_TRUE(!Matches("hello"));
   ASSERT_TRUE(!Matches("world"));
 }
 
-TEST_F(BloomTest, Small) {
+TEST_P(BloomTest, Small) {
   Add("hello");
   Add("world");
   ASSERT_TRUE(Matches("hello"));
@@ -106,7 +141,7 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST_F(BloomTest, VaryingLengths) {
+TEST_P(BloomTest, VaryingLengths) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -120,8 +155,7 @@ TEST_F(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
-        << length;
+    ASSERT_LE(FilterSize(), (length * 10 / 8) + FilterSlop()) << length;
 
     // All added keys must match
     for (int i = 0; i < length; i++) {
@@ -149,6 +183,60 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+TEST_P(BloomTest, CacheLocalProbesOneLine) {
+  if (GetParam() == kStandardBloom) {
+    GTEST_SKIP() << "standard filters spread the probes over the filter";
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    Add(Key(i, buffer));
+  }
+  for (int i = 0; i < 1000; i += 10) {
+    ASSERT_EQ(1, LinesProbed(Key(i, buffer))) << "key " << i;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(BloomTypes, BloomTest,
+                         testing::Values(kStandardBloom, kCacheLocalBloom,
+                                         kCacheLocalBloomScalar));
+
+// Keeping the probes of a key in one line costs some accuracy, which must
+// stay close to that of a standard filter of the same size.  The filters
+// are larger than the CPU caches, as in the tables they are meant for.
+TEST(CacheLocalBloomTest, FalsePositiveRate) {
+  const int kNumKeys = 1000000;
+  const int kNumLookups = 100000;
+  std::vector<std::string> keys(kNumKeys);
+  std::vector<Slice> key_slices(kNumKeys);
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kNumKeys; i++) {
+    keys[i] = Key(i, buffer).ToString();
+    key_slices[i] = keys[i];
+  }
+
+  double rates[2];
+  const FilterPolicy* policies[] = {NewBloomFilterPolicy(10),
+                                    NewCacheLocalBloomFilterPolicy(10)};
+  for (int p = 0; p < 2; p++) {
+    std::string filter;
+    policies[p]->CreateFilter(key_slices.data(), kNumKeys, &filter);
+    int false_positives = 0;
+    for (int i = 0; i < kNumLookups; i++) {
+      if (policies[p]->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+        false_positives++;
+      }
+    }
+    rates[p] = false_positives / static_cast<double>(kNumLookups);
+    delete policies[p];
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "False positives: %5.2f%% standard, %5.2f%% local\n",
+                 rates[0] * 100.0, rates[1] * 100.0);
+  }
+  ASSERT_LE(rates[1], 0.02);
+  ASSERT_LE(rates[1], rates[0] * 1.5);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
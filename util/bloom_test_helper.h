@@ -0,0 +1,24 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_BLOOM_TEST_HELPER_H_
+#define STORAGE_LEVELDB_UTIL_BLOOM_TEST_HELPER_H_
+
+namespace leveldb {
+
+class BloomTest;
+
+// A helper for the Bloom filter policies to facilitate testing.
+class BloomTestHelper {
+ private:
+  friend class BloomTest;
+
+  // If false, cache-local filters are probed by the scalar loop even on
+  // CPUs with AVX2, so that tests cover it everywhere.
+  static void SetUseAVX2(bool use_avx2);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_BLOOM_TEST_HELPER_H_
@@ -26,17 +26,29 @@ namespace {
 // entry being passed to its "deleter" are via Erase(), via Insert() when
 // an element with a duplicate key is inserted, or on destruction of the cache.
 //
-// The cache keeps two linked lists of items in the cache.  All items in the
-// cache are in one list or the other, and never both.  Items still referenced
-// by clients but erased from the cache are in neither list.  The lists are:
+// The cache keeps three linked lists of items in the cache.  All items in the
+// cache are in exactly one of the lists.  Items still referenced by clients
+// but erased from the cache are in none of the lists.  The lists are:
 // - in-use:  contains the items currently referenced by clients, in no
 //   particular order.  (This list is used for invariant checking.  If we
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
-// - LRU:  contains the items not currently referenced by clients, in LRU order
+// - LRU:  contains the low priority items not currently referenced by
+//   clients, in LRU order
+// - high-pri LRU:  contains the high priority items not currently referenced
+//   by clients, in LRU order
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// High priority items are only evicted while there are no low priority items
+// to evict.  When they use more than their share of the capacity, the least
+// recently used ones are demoted to low priority items.
+//
+// With midpoint insertion, items that are looked up again after they were
+// inserted are promoted to high priority items.  New items thus enter the
+// cache halfway down the combined LRU order, and a scan that touches each
+// item once only evicts other items that were not used more than once.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -49,6 +61,7 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool high_pri;     // Whether entry is charged to the high priority pool.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -154,12 +167,18 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t high_pri_capacity,
+                   bool midpoint_insertion) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+    midpoint_insertion_ = midpoint_insertion;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -175,19 +194,28 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DemoteToHighPriCapacity() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void EvictToCapacity() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
+  bool midpoint_insertion_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
-  // Entries have refs==1 and in_cache==true.
+  // Entries have refs==1, in_cache==true and high_pri==false.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of high-pri LRU list.
+  // Entries have refs==1, in_cache==true and high_pri==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -195,10 +223,17 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      midpoint_insertion_(false),
+      usage_(0),
+      high_pri_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
@@ -213,10 +248,18 @@ LRUCache::~LRUCache() {
     Unref(e);
     e = next;
   }
+  for (LRUHandle* e = high_pri_lru_.next; e != &high_pri_lru_;) {
+    LRUHandle* next = e->next;
+    assert(e->in_cache);
+    e->in_cache = false;
+    assert(e->refs == 1);  // Invariant of high_pri_lru_ list.
+    Unref(e);
+    e = next;
+  }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an LRU list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
@@ -231,9 +274,9 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to the LRU list of its priority.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Append(e->high_pri ? &high_pri_lru_ : &lru_, e);
   }
 }
 
@@ -255,6 +298,12 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
     Ref(e);
+    if (midpoint_insertion_ && !e->high_pri && high_pri_capacity_ > 0) {
+      // Second use: promote.  The entry is on in_use_ until released.
+      e->high_pri = true;
+      high_pri_usage_ += e->charge;
+      DemoteToHighPriCapacity();
+    }
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
@@ -262,12 +311,14 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
 void LRUCache::Release(Cache::Handle* handle) {
   MutexLock l(&mutex_);
   Unref(reinterpret_cast<LRUHandle*>(handle));
+  DemoteToHighPriCapacity();
 }
 
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e =
@@ -278,6 +329,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = (priority == Cache::kHighPriority && high_pri_capacity_ > 0);
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -286,21 +338,49 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (e->high_pri) {
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  DemoteToHighPriCapacity();
+  EvictToCapacity();
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void LRUCache::DemoteToHighPriCapacity() {
+  while (high_pri_usage_ > high_pri_capacity_ &&
+         high_pri_lru_.next != &high_pri_lru_) {
+    // Make the oldest high priority entry the newest low priority one.
+    LRUHandle* e = high_pri_lru_.next;
+    assert(e->refs == 1);
+    e->high_pri = false;
+    high_pri_usage_ -= e->charge;
+    LRU_Remove(e);
+    LRU_Append(&lru_, e);
+  }
+}
+
+void LRUCache::EvictToCapacity() {
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (lru_.next != &lru_) {
+      old = lru_.next;
+    } else if (high_pri_lru_.next != &high_pri_lru_) {
+      old = high_pri_lru_.next;
+    } else {
+      break;  // Everything left is in use
+    }
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
     }
   }
-
-  return reinterpret_cast<Cache::Handle*>(e);
 }
 
 // If e != nullptr, finish removing *e from the cache; it has already been
@@ -311,6 +391,9 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->high_pri) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
@@ -323,12 +406,14 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
 }
@@ -349,17 +434,27 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  bool midpoint_insertion)
+      : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    const size_t high_pri_per_shard =
+        static_cast<size_t>(per_shard * high_pri_pool_ratio);
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_per_shard, midpoint_insertion);
     }
   }
   ~ShardedLRUCache() override {}
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return InsertWithPriority(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -396,6 +491,16 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return new ShardedLRUCache(capacity, 0.5, false);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, false);
+}
+
+Cache* NewScanResistantLRUCache(size_t capacity) {
+  return new ShardedLRUCache(capacity, 0.625, true);
+}
 
 }  // namespace leveldb
@@ -4,10 +4,13 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -54,6 +57,12 @@ class CacheTest : public testing::Test {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->InsertWithPriority(
+        EncodeKey(key), EncodeValue(value), charge, &CacheTest::Deleter,
+        Cache::kHighPriority));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -194,6 +203,99 @@ TEST_F(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
 }
 
+TEST_F(CacheTest, HighPriorityEntriesSurviveScans) {
+  for (int i = 0; i < 100; i++) {
+    InsertHighPriority(i, 1000 + i);
+  }
+  // A scan through twice the capacity only evicts low priority entries.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+}
+
+TEST_F(CacheTest, HighPriorityPoolIsBounded) {
+  for (int i = 0; i < kCacheSize; i++) {
+    InsertHighPriority(i, 1000 + i);
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+
+  // High priority entries beyond half the capacity were evicted to make
+  // room for low priority ones.
+  int high_pri_cached = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) >= 0) {
+      high_pri_cached++;
+    }
+  }
+  ASSERT_LE(high_pri_cached, kCacheSize / 2 + kCacheSize / 10);
+  ASSERT_GE(high_pri_cached, kCacheSize / 2 - kCacheSize / 10);
+}
+
+TEST_F(CacheTest, NoHighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0);
+
+  InsertHighPriority(1, 100);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST_F(CacheTest, ScanResistance) {
+  for (bool scan_resistant : {false, true}) {
+    delete cache_;
+    cache_ = scan_resistant ? NewScanResistantLRUCache(kCacheSize)
+                            : NewLRUCache(kCacheSize);
+
+    // A working set that is used over and over again.
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+      ASSERT_EQ(1000 + i, Lookup(i));
+    }
+    // A scan that reads each entry once.
+    for (int i = 0; i < 2 * kCacheSize; i++) {
+      Insert(10000 + i, 20000 + i);
+    }
+    int working_set_cached = 0;
+    for (int i = 0; i < 100; i++) {
+      if (Lookup(i) >= 0) {
+        working_set_cached++;
+      }
+    }
+    ASSERT_EQ(scan_resistant ? 100 : 0, working_set_cached);
+  }
+}
+
+TEST_F(CacheTest, ScanResistantCacheAdmitsNewWorkingSet) {
+  delete cache_;
+  cache_ = NewScanResistantLRUCache(kCacheSize);
+
+  // Entries that are used again replace the hot entries of an older working
+  // set, which are demoted and then evicted.
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+    ASSERT_EQ(20000 + i, Lookup(10000 + i));
+  }
+  int old_cached = 0;
+  int new_cached = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) >= 0) old_cached++;
+    if (Lookup(10000 + i) >= 0) new_cached++;
+  }
+  ASSERT_LT(old_cached, kCacheSize / 10);
+  ASSERT_GT(new_cached, kCacheSize * 8 / 10);
+}
+
 TEST_F(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
@@ -221,6 +323,194 @@ TEST_F(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 1);
+  }
+};
+
+TEST_F(ClockCacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_F(ClockCacheTest, Erase) {
+  Erase(200);
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  Insert(100, 101);
+  Insert(200, 201);
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_F(ClockCacheTest, EntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_F(ClockCacheTest, EvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+  Insert(300, 301);
+  Cache::Handle* h = cache_->Lookup(EncodeKey(300));
+
+  // Frequently used entry must be kept around,
+  // as must things that are still in use.
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(301, Lookup(300));
+  cache_->Release(h);
+}
+
+TEST_F(ClockCacheTest, UseExceedsCacheSize) {
+  // Overfill the cache, keeping handles on all inserted entries.
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+  }
+
+  // Entries that did not fit into the table are not cached, but their
+  // handles stay valid.
+  for (int i = 0; i < h.size(); i++) {
+    ASSERT_EQ(2000 + i, DecodeValue(cache_->Value(h[i])));
+  }
+
+  for (int i = 0; i < h.size(); i++) {
+    cache_->Release(h[i]);
+  }
+  ASSERT_EQ(h.size(), deleted_keys_.size() + cache_->TotalCharge());
+}
+
+TEST_F(ClockCacheTest, LongKeys) {
+  const std::string long_key(100, 'k');
+  cache_->Release(cache_->Insert(long_key, EncodeValue(1), 1,
+                                 [](const Slice& key, void* v) {}));
+  Cache::Handle* h = cache_->Lookup(long_key);
+  ASSERT_TRUE(h != nullptr);
+  ASSERT_EQ(1, DecodeValue(cache_->Value(h)));
+  cache_->Release(h);
+  ASSERT_TRUE(cache_->Lookup(std::string(100, 'x')) == nullptr);
+}
+
+TEST_F(ClockCacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST_F(ClockCacheTest, ZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0, 1);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST(ClockCacheConcurrencyTest, ConcurrentUse) {
+  // Entries own a heap-allocated copy of their key, which lookups compare
+  // against the key they were found by.
+  static std::atomic<int> live(0);
+  struct Deleter {
+    static void Delete(const Slice& key, void* value) {
+      std::string* v = reinterpret_cast<std::string*>(value);
+      EXPECT_EQ(key.ToString(), *v);
+      delete v;
+      live.fetch_sub(1);
+    }
+  };
+
+  const int kKeys = 2000;
+  for (int shard_bits : {0, 2}) {
+    Cache* cache = NewClockCache(kKeys / 2, 1, shard_bits);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+      threads.emplace_back([cache, t]() {
+        Random rnd(301 + t);
+        for (int i = 0; i < 20000; i++) {
+          const std::string key = EncodeKey(rnd.Uniform(kKeys));
+          switch (rnd.Uniform(8)) {
+            case 0: {
+              live.fetch_add(1);
+              cache->Release(cache->Insert(key, new std::string(key), 1,
+                                           &Deleter::Delete));
+              break;
+            }
+            case 1:
+              cache->Erase(key);
+              break;
+            default: {
+              Cache::Handle* h = cache->Lookup(key);
+              if (h != nullptr) {
+                ASSERT_EQ(key,
+                          *reinterpret_cast<std::string*>(cache->Value(h)));
+                cache->Release(h);
+              }
+            }
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    ASSERT_LE(cache->TotalCharge(), kKeys / 2);
+    delete cache;
+    ASSERT_EQ(0, live.load());
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,421 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard is an open-addressing hash table with linear probing whose slots
+// hold the entries themselves.  Slots are never freed while the cache lives,
+// so readers can look at a slot without holding a lock, and all the state
+// that decides who may use a slot is kept in one atomic word per slot:
+// - refs:   the number of references held by clients (plus short-lived
+//           references taken by lookups that probe the slot)
+// - clock:  a countdown that the eviction sweep decrements; lookups reset it
+//           to its maximum, and entries are evicted when it reaches zero
+// - state:  empty, under construction (owned by one thread, which is filling
+//           or freeing it), visible (in the cache), or invisible (erased
+//           from the cache but still referenced)
+//
+// Lookup() and Release() only use atomic operations on the slot.  A slot is
+// only freed by the thread that moves it from visible or invisible with no
+// references to under construction, so a reference keeps an entry alive.
+//
+// Each slot also counts the entries that were inserted beyond it in probe
+// order.  A lookup stops at the first slot that does not match and that no
+// entry was displaced beyond.
+
+constexpr int kRefsBits = 30;
+constexpr uint64_t kRefsMask = (uint64_t{1} << kRefsBits) - 1;
+constexpr int kClockShift = kRefsBits;
+constexpr uint64_t kClockMask = uint64_t{3} << kClockShift;
+constexpr uint64_t kMaxClock = 3;
+constexpr int kStateShift = 32;
+constexpr uint64_t kStateMask = uint64_t{3} << kStateShift;
+
+enum SlotState : uint64_t {
+  kEmpty = 0,
+  kConstruction = 1,
+  kVisible = 2,
+  kInvisible = 3,
+};
+
+inline uint64_t Refs(uint64_t meta) { return meta & kRefsMask; }
+inline uint64_t Clock(uint64_t meta) {
+  return (meta & kClockMask) >> kClockShift;
+}
+inline uint64_t State(uint64_t meta) { return meta >> kStateShift; }
+inline uint64_t WithState(uint64_t meta, uint64_t state) {
+  return (meta & ~kStateMask) | (state << kStateShift);
+}
+
+struct ClockHandle {
+  ClockHandle() : meta(0), displacements(0), hash(0) {}
+
+  std::atomic<uint64_t> meta;
+  std::atomic<uint32_t> displacements;
+  std::atomic<uint32_t> hash;  // Read without a reference to skip slots
+
+  // Only written while the slot is under construction.
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;     // Points at key_buf unless the key is longer
+  char key_buf[16];
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// A single shard of sharded cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard()
+      : capacity_(0),
+        length_(0),
+        max_occupancy_(0),
+        slots_(nullptr),
+        usage_(0),
+        occupancy_(0),
+        clock_pointer_(0) {}
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of shards.
+  void Init(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+
+ private:
+  bool Owns(const ClockHandle* h) const {
+    return h >= slots_ && h < slots_ + length_;
+  }
+  void Unref(ClockHandle* h);
+  void Free(ClockHandle* h);
+  void EvictFor(size_t charge);
+
+  size_t capacity_;
+  uint32_t length_;  // Number of slots, a power of two
+  size_t max_occupancy_;
+  ClockHandle* slots_;
+
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> occupancy_;  // Slots that are not empty
+  std::atomic<uint64_t> clock_pointer_;
+};
+
+void ClockCacheShard::Init(size_t capacity, size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  size_t entries = capacity / (estimated_entry_charge > 0
+                                   ? estimated_entry_charge
+                                   : 1);
+  // Aim for a load factor of about 0.7 when the cache is full.
+  length_ = 16;
+  while (length_ < entries + entries / 2) {
+    length_ *= 2;
+  }
+  max_occupancy_ = length_ - length_ / 8;
+  slots_ = new ClockHandle[length_];
+}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (State(meta) == kVisible || State(meta) == kInvisible) {
+      // Error if caller has an unreleased handle
+      assert(Refs(meta) == 0);
+      (*h->deleter)(h->key(), h->value);
+      if (h->key_data != h->key_buf) {
+        delete[] h->key_data;
+      }
+    }
+  }
+  delete[] slots_;
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  const uint32_t mask = length_ - 1;
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[(hash + i) & mask];
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash) {
+      const uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (State(old) == kVisible && h->key() == key) {
+        if (Clock(old) != kMaxClock) {
+          h->meta.fetch_or(kClockMask, std::memory_order_relaxed);
+        }
+        return reinterpret_cast<Cache::Handle*>(h);
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(Refs(old) > 0);
+  if (Refs(old) == 1 && State(old) == kInvisible) {
+    // Last reference to an erased entry.  If another thread takes and drops
+    // a reference in the meantime, one of us frees it.
+    uint64_t meta = old - 1;
+    if (h->meta.compare_exchange_strong(meta, WithState(meta, kConstruction),
+                                        std::memory_order_acq_rel)) {
+      Free(h);
+    }
+  }
+}
+
+// REQUIRES: *h is under construction and owned by the calling thread.
+void ClockCacheShard::Free(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  if (h->key_data != h->key_buf) {
+    delete[] h->key_data;
+  }
+  if (!Owns(h)) {
+    delete h;  // Was never in the table
+    return;
+  }
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  const uint32_t mask = length_ - 1;
+  const uint32_t index = static_cast<uint32_t>(h - slots_);
+  for (uint32_t i = h->hash.load(std::memory_order_relaxed) & mask;
+       i != index; i = (i + 1) & mask) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  // Keep the references of lookups that are probing the slot.
+  h->meta.fetch_and(~(kStateMask | kClockMask), std::memory_order_release);
+}
+
+void ClockCacheShard::EvictFor(size_t charge) {
+  // Every entry gets kMaxClock chances before it is evicted.  Give up after
+  // that many full sweeps, leaving the cache over its capacity if the
+  // remaining entries are all in use.
+  const uint32_t mask = length_ - 1;
+  for (uint64_t step = 0; step < (kMaxClock + 1) * length_; step++) {
+    if (usage_.load(std::memory_order_relaxed) + charge <= capacity_ &&
+        occupancy_.load(std::memory_order_relaxed) < max_occupancy_) {
+      return;
+    }
+    ClockHandle* h =
+        &slots_[clock_pointer_.fetch_add(1, std::memory_order_relaxed) & mask];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) != kVisible || Refs(meta) != 0) {
+      continue;
+    }
+    if (Clock(meta) > 0) {
+      h->meta.compare_exchange_strong(meta, meta - (uint64_t{1} << kClockShift),
+                                      std::memory_order_relaxed);
+    } else if (h->meta.compare_exchange_strong(
+                   meta, WithState(meta, kConstruction),
+                   std::memory_order_acq_rel)) {
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value),
+                                       Cache::Priority priority) {
+  // Like LRUCache::Insert(), an entry replaces any entry with the same key.
+  // Two threads inserting the same key at once may both succeed; lookups
+  // find one of the entries, and the other one is evicted in due course.
+  Erase(key, hash);
+  if (capacity_ > 0) {
+    EvictFor(charge);
+  }
+
+  ClockHandle* h = nullptr;
+  uint32_t probes = 0;
+  const uint32_t mask = length_ - 1;
+  for (; capacity_ > 0 && probes < length_; probes++) {
+    ClockHandle* slot = &slots_[(hash + probes) & mask];
+    uint64_t meta = slot->meta.load(std::memory_order_relaxed);
+    if (State(meta) == kEmpty &&
+        slot->meta.compare_exchange_strong(meta,
+                                           WithState(meta, kConstruction),
+                                           std::memory_order_acquire)) {
+      h = slot;
+      break;
+    }
+    slot->displacements.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (h == nullptr) {
+    // Don't cache.  (capacity_==0 is supported and turns off caching.)
+    for (uint32_t i = 0; i < probes; i++) {
+      slots_[(hash + i) & mask].displacements.fetch_sub(
+          1, std::memory_order_relaxed);
+    }
+    h = new ClockHandle;
+    h->meta.store(kConstruction << kStateShift, std::memory_order_relaxed);
+  }
+
+  h->hash.store(hash, std::memory_order_relaxed);
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = key.size() <= sizeof(h->key_buf) ? h->key_buf
+                                                 : new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+
+  // Publish the entry with a reference for the returned handle.
+  const uint64_t clock = (priority == Cache::kHighPriority ? kMaxClock : 1);
+  const uint64_t state = (Owns(h) ? kVisible : kInvisible);
+  if (Owns(h)) {
+    usage_.fetch_add(charge, std::memory_order_relaxed);
+    occupancy_.fetch_add(1, std::memory_order_relaxed);
+  }
+  h->meta.fetch_add(((state - kConstruction) << kStateShift) +
+                        (clock << kClockShift) + 1,
+                    std::memory_order_release);
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  const uint32_t mask = length_ - 1;
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[(hash + i) & mask];
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash) {
+      const uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (State(old) == kVisible && h->key() == key) {
+        // Visible -> invisible; freed by the last Unref().
+        h->meta.fetch_or(uint64_t{kInvisible} << kStateShift,
+                         std::memory_order_acq_rel);
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+}
+
+void ClockCacheShard::Prune() {
+  for (uint32_t i = 0; i < length_; i++) {
+    ClockHandle* h = &slots_[i];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible && Refs(meta) == 0 &&
+        h->meta.compare_exchange_strong(meta, WithState(meta, kConstruction),
+                                        std::memory_order_acq_rel)) {
+      Free(h);
+    }
+  }
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  ClockCacheShard* const shards_;
+  std::atomic<uint64_t> last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  ClockCacheShard* Shard(uint32_t hash) const {
+    return &shards_[num_shard_bits_ == 0 ? 0
+                                         : hash >> (32 - num_shard_bits_)];
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge,
+                    int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        shards_(new ClockCacheShard[1 << num_shard_bits]),
+        last_id_(0) {
+    const int num_shards = 1 << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    for (int s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, estimated_entry_charge);
+    }
+  }
+  ~ShardedClockCache() override { delete[] shards_; }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return InsertWithPriority(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return Shard(hash)->Insert(key, hash, value, charge, deleter, priority);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return Shard(hash)->Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    Shard(h->hash.load(std::memory_order_relaxed))->Release(handle);
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    Shard(hash)->Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override {
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge, 4);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                     int num_shard_bits) {
+  assert(num_shard_bits >= 0 && num_shard_bits <= 16);
+  return new ShardedClockCache(capacity, estimated_entry_charge,
+                               num_shard_bits);
+}
+
+}  // namespace leveldb
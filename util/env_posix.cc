@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -33,8 +34,15 @@
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -57,6 +65,27 @@ constexpr const int kOpenBaseFlags = 0;
 
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// The offsets, sizes and memory of reads and writes with O_DIRECT must be
+// multiples of this, which covers the block sizes of common devices.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+constexpr const size_t kDirectWriteBufferSize = 1 << 20;
+
+// Rounds |size| up to a multiple of kDirectIOAlignment.
+size_t RoundUpToDirectIOAlignment(size_t size) {
+  return (size + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+}
+
+// Allocates a buffer for O_DIRECT reads and writes, which must be released
+// with std::free().  Returns nullptr if out of memory.
+char* NewDirectIOBuffer(size_t size) {
+  void* buf = nullptr;
+  if (::posix_memalign(&buf, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return static_cast<char*>(buf);
+}
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -101,6 +130,336 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+// Runs the reads of PosixRandomAccessFile::SubmitReads().  Uses an io_uring
+// instance shared by all files when the kernel allows it, and otherwise a
+// small pool of threads that issue pread() calls.
+//
+// The only instance belongs to the PosixEnv singleton, which is never
+// destroyed.  Like the background threads of the env, the ring and the
+// read threads live for the whole process, so there is no shutdown path.
+//
+// Instances are thread-safe.
+class PosixAsyncReader {
+ public:
+  PosixAsyncReader() : done_cv_(&mu_), work_cv_(&mu_) {}
+
+  PosixAsyncReader(const PosixAsyncReader&) = delete;
+  PosixAsyncReader& operator=(const PosixAsyncReader&) = delete;
+
+  // Starts reading "reqs[0..n-1]" from "fd", which must stay open until
+  // Wait() returns for all of them.
+  void Submit(int fd, const std::string* filename,
+              RandomAccessFile::ReadRequest* reqs, size_t n) {
+    MutexLock lock(&mu_);
+    if (!initialized_) {
+      Initialize();
+    }
+    for (size_t i = 0; i < n; i++) {
+      PendingRead* read = new PendingRead;
+      read->req = &reqs[i];
+      read->filename = filename;
+      read->fd = fd;
+      read->done = false;
+      reqs[i].pending = read;
+#if HAVE_IO_URING
+      if (ring_fd_ >= 0) {
+        if (in_flight_ >= cq_entries_) {
+          // Completions could overflow the ring.
+          Finish(read, Pread(read));
+        } else {
+          QueueOnRing(read);
+        }
+        continue;
+      }
+#endif  // HAVE_IO_URING
+      queue_.push(read);
+      work_cv_.Signal();
+    }
+#if HAVE_IO_URING
+    if (ring_fd_ >= 0) {
+      SubmitToRing();
+    }
+#endif  // HAVE_IO_URING
+  }
+
+  // Waits until the reads "reqs[0..n-1]" passed to Submit() are done.
+  void Wait(RandomAccessFile::ReadRequest* reqs, size_t n) {
+    MutexLock lock(&mu_);
+    for (size_t i = 0; i < n; i++) {
+      PendingRead* read = reinterpret_cast<PendingRead*>(reqs[i].pending);
+      if (read == nullptr) {
+        continue;  // Already waited for
+      }
+      while (!read->done) {
+        WaitForCompletion();
+      }
+      delete read;
+      reqs[i].pending = nullptr;
+    }
+  }
+
+ private:
+  struct PendingRead {
+    RandomAccessFile::ReadRequest* req;
+    const std::string* filename;
+    int fd;
+    bool done;
+#if HAVE_IO_URING
+    struct ::iovec iov;
+#endif  // HAVE_IO_URING
+  };
+
+  // Enough threads to keep a few reads in flight without io_uring.
+  static constexpr int kReadThreads = 4;
+
+  // Size of the submission queue of the ring.
+  static constexpr unsigned kRingEntries = 64;
+
+  static void ReadThreadMain(PosixAsyncReader* reader) {
+    reader->ReadThread();
+  }
+
+  void Initialize() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    initialized_ = true;
+#if HAVE_IO_URING
+    if (SetUpRing()) {
+      return;
+    }
+#endif  // HAVE_IO_URING
+    for (int i = 0; i < kReadThreads; i++) {
+      std::thread read_thread(ReadThreadMain, this);
+      read_thread.detach();
+    }
+  }
+
+  // Reads "read" with pread().  Returns the number of bytes read or a
+  // negated errno value.
+  static ::ssize_t Pread(PendingRead* read) {
+    RandomAccessFile::ReadRequest* req = read->req;
+    ::ssize_t read_size;
+    do {
+      read_size = ::pread(read->fd, req->scratch, req->n,
+                          static_cast<off_t>(req->offset));
+    } while (read_size < 0 && errno == EINTR);
+    return (read_size < 0) ? -errno : read_size;
+  }
+
+  // Sets the result and status of the request of "read" from "result", the
+  // number of bytes read or a negated errno value.
+  static void Finish(PendingRead* read, ::ssize_t result) {
+    RandomAccessFile::ReadRequest* req = read->req;
+    req->result = Slice(req->scratch, (result < 0) ? 0 : result);
+    req->status = (result < 0)
+                      ? PosixError(*read->filename, static_cast<int>(-result))
+                      : Status::OK();
+    read->done = true;
+  }
+
+  void ReadThread() {
+    mu_.Lock();
+    while (true) {
+      while (queue_.empty()) {
+        work_cv_.Wait();
+      }
+      PendingRead* read = queue_.front();
+      queue_.pop();
+      mu_.Unlock();
+      const ::ssize_t result = Pread(read);
+      mu_.Lock();
+      Finish(read, result);
+      done_cv_.SignalAll();
+    }
+  }
+
+  // Waits until at least one read finishes or another thread reaps
+  // completions.
+  void WaitForCompletion() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+#if HAVE_IO_URING
+    if (ring_fd_ >= 0 && !polling_) {
+      if (ReapCompletions() > 0) {
+        done_cv_.SignalAll();
+        return;
+      }
+      // Become the thread that waits in the kernel.
+      polling_ = true;
+      mu_.Unlock();
+      int r;
+      do {
+        r = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+                                       IORING_ENTER_GETEVENTS, nullptr, 0));
+      } while (r < 0 && errno == EINTR);
+      mu_.Lock();
+      polling_ = false;
+      ReapCompletions();
+      done_cv_.SignalAll();
+      return;
+    }
+#endif  // HAVE_IO_URING
+    done_cv_.Wait();
+  }
+
+#if HAVE_IO_URING
+  bool SetUpRing() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    struct ::io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const int fd =
+        static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if (fd < 0) {
+      return false;  // Not supported by the kernel or not allowed
+    }
+    size_t sq_size =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+    char* sq = static_cast<char*>(
+        ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING));
+    char* cq = sq;
+    if (sq != MAP_FAILED && !single_mmap) {
+      cq = static_cast<char*>(
+          ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING));
+    }
+    void* sqes = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED) {
+      sqes = ::mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                    IORING_OFF_SQES);
+    }
+    if (sqes == MAP_FAILED) {
+      if (sq != MAP_FAILED) {
+        if (cq != MAP_FAILED && cq != sq) {
+          ::munmap(cq, cq_size);
+        }
+        ::munmap(sq, sq_size);
+      }
+      ::close(fd);
+      return false;
+    }
+    ring_fd_ = fd;
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    cq_entries_ = params.cq_entries;
+    return true;
+  }
+
+  void QueueOnRing(PendingRead* read) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+      SubmitToRing();  // Make room
+      tail = *sq_tail_;
+    }
+    const unsigned index = tail & sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    read->iov.iov_base = read->req->scratch;
+    read->iov.iov_len = read->req->n;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = read->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&read->iov);
+    sqe->len = 1;
+    sqe->off = read->req->offset;
+    sqe->user_data = reinterpret_cast<uint64_t>(read);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+    in_flight_++;
+  }
+
+  // Hands the queued submission queue entries to the kernel.
+  void SubmitToRing() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    while (to_submit_ > 0) {
+      const int r = static_cast<int>(
+          ::syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 0, 0,
+                    nullptr, 0));
+      if (r >= 0) {
+        to_submit_ -= r;
+      } else if (errno == EAGAIN || errno == EBUSY) {
+        // Out of resources until some reads finish.
+        if (in_flight_ > to_submit_) {
+          WaitForCompletion();
+        } else {
+          mu_.Unlock();
+          std::this_thread::yield();
+          mu_.Lock();
+        }
+      } else if (errno != EINTR) {
+        FailUnsubmitted(errno);
+      }
+    }
+  }
+
+  // Fails the reads that the kernel has not taken from the submission
+  // queue with "error_number", and removes them from the queue.
+  void FailUnsubmitted(int error_number) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    // Without SQPOLL, the kernel only takes entries during io_uring_enter()
+    // calls that submit them, which are all made with mu_ held.
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    for (unsigned i = head; i != *sq_tail_; i++) {
+      const struct io_uring_sqe* sqe = &sqes_[sq_array_[i & sq_mask_]];
+      Finish(reinterpret_cast<PendingRead*>(sqe->user_data), -error_number);
+      in_flight_--;
+    }
+    __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+    to_submit_ = 0;
+    done_cv_.SignalAll();
+  }
+
+  // Finishes the reads of the completion queue, and returns their number.
+  unsigned ReapCompletions() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    const unsigned reaped = tail - head;
+    while (head != tail) {
+      const struct io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+      Finish(reinterpret_cast<PendingRead*>(cqe->user_data), cqe->res);
+      in_flight_--;
+      head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+  }
+#endif  // HAVE_IO_URING
+
+  port::Mutex mu_;
+  port::CondVar done_cv_;
+  bool initialized_ GUARDED_BY(mu_) = false;
+
+  // Thread pool, used if the ring could not be set up.
+  port::CondVar work_cv_;
+  std::queue<PendingRead*> queue_ GUARDED_BY(mu_);
+
+#if HAVE_IO_URING
+  int ring_fd_ = -1;  // -1 if the thread pool is used
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned sq_entries_;
+  struct io_uring_sqe* sqes_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+  unsigned cq_entries_;
+  unsigned to_submit_ GUARDED_BY(mu_) = 0;  // Queued, not yet submitted
+  unsigned in_flight_ GUARDED_BY(mu_) = 0;  // Queued or submitted
+  bool polling_ GUARDED_BY(mu_) = false;    // A thread waits in the kernel
+#endif  // HAVE_IO_URING
+};
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -140,7 +499,8 @@ class PosixSequentialFile final : public SequentialFile {
   const std::string filename_;
 };
 
-// Implements random read access in a file using pread().
+// Implements random read access in a file using pread(), and asynchronous
+// reads using |async_reader|.
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
 // API. Instances are immutable and Read() only calls thread-safe library
@@ -148,11 +508,14 @@ class PosixSequentialFile final : public SequentialFile {
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
-  // instance, and will be used to determine if .
-  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  // instance, and will be used to determine if . |async_reader| runs
+  // the reads of SubmitReads() and must outlive this instance.
+  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        PosixAsyncReader* async_reader)
       : has_permanent_fd_(fd_limiter->Acquire()),
         fd_(has_permanent_fd_ ? fd : -1),
         fd_limiter_(fd_limiter),
+        async_reader_(async_reader),
         filename_(std::move(filename)) {
     if (!has_permanent_fd_) {
       assert(fd_ == -1);
@@ -195,10 +558,26 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+  void SubmitReads(ReadRequest* reqs, size_t n) const override {
+    if (!has_permanent_fd_) {
+      // Without a file descriptor that outlives the reads, read them now.
+      RandomAccessFile::SubmitReads(reqs, n);
+      return;
+    }
+    async_reader_->Submit(fd_, &filename_, reqs, n);
+  }
+
+  void WaitForReads(ReadRequest* reqs, size_t n) const override {
+    if (has_permanent_fd_) {
+      async_reader_->Wait(reqs, n);
+    }
+  }
+
  private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
+  PosixAsyncReader* const async_reader_;
   const std::string filename_;
 };
 
@@ -246,6 +625,57 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+// Implements random read access in a file opened with O_DIRECT.  Each read
+// covers the aligned extent around the requested bytes, in a buffer aligned
+// to kDirectIOAlignment, and copies them out to the caller's buffer.
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API. Instances are immutable and Read() only calls thread-safe library
+// functions.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|.
+  PosixDirectRandomAccessFile(std::string filename, int fd)
+      : fd_(fd), filename_(std::move(filename)) {}
+
+  ~PosixDirectRandomAccessFile() override { ::close(fd_); }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const uint64_t aligned_offset =
+        offset & ~static_cast<uint64_t>(kDirectIOAlignment - 1);
+    const size_t skip = static_cast<size_t>(offset - aligned_offset);
+    const size_t aligned_size = RoundUpToDirectIOAlignment(skip + n);
+    char* buf = NewDirectIOBuffer(aligned_size);
+    if (buf == nullptr) {
+      *result = Slice();
+      return PosixError(filename_, ENOMEM);
+    }
+
+    Status status;
+    ssize_t read_size =
+        ::pread(fd_, buf, aligned_size, static_cast<off_t>(aligned_offset));
+    if (read_size < 0) {
+      // An error: return a non-ok status.
+      *result = Slice();
+      status = PosixError(filename_, errno);
+    } else {
+      // Reads at the end of the file return less.
+      const size_t available =
+          (static_cast<size_t>(read_size) > skip ? read_size - skip : 0);
+      const size_t result_size = std::min(n, available);
+      std::memcpy(scratch, buf + skip, result_size);
+      *result = Slice(scratch, result_size);
+    }
+    std::free(buf);
+    return status;
+  }
+
+ private:
+  const int fd_;
+  const std::string filename_;
+};
+
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
@@ -426,6 +856,8 @@ class PosixWritableFile final : public WritableFile {
     return Basename(filename).starts_with("MANIFEST");
   }
 
+  friend class PosixDirectWritableFile;
+
   // buf_[0, pos_ - 1] contains data to be written to fd_.
   char buf_[kWritableFileBufferSize];
   size_t pos_;
@@ -436,6 +868,130 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+// Implements writes to a file opened with O_DIRECT.  The data is gathered in
+// a buffer aligned to kDirectIOAlignment and written out in aligned blocks.
+// The last, partial block is written padded with zeros, and written again
+// once it fills up; Close() truncates the padding away.
+//
+// Flush() writes the buffer out only for log files, whose records have to
+// survive a crash of the process.  Other files are written when the buffer
+// fills up, and by Sync() and Close().
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // The new instance takes ownership of |fd| and of |buf|, a buffer of
+  // kDirectWriteBufferSize bytes allocated by NewDirectIOBuffer().
+  PosixDirectWritableFile(std::string filename, int fd, char* buf)
+      : buf_(buf),
+        pos_(0),
+        written_(0),
+        file_offset_(0),
+        fd_(fd),
+        is_log_(IsLog(filename)),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      const size_t copy_size =
+          std::min(write_size, kDirectWriteBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kDirectWriteBufferSize) {
+        Status status = WriteBuffer();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteBuffer();
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(file_offset_ + pos_)) < 0) {
+      status = PosixError(filename_, errno);
+    }
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  Status Flush() override { return is_log_ ? WriteBuffer() : Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+    return PosixWritableFile::SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Writes buf_[written_, pos_ - 1] out, along with the start of its first
+  // aligned block and the padding of its last one, and then keeps only the
+  // last partial block in buf_.
+  Status WriteBuffer() {
+    if (pos_ == written_) {
+      return Status::OK();
+    }
+    const size_t start = written_ & ~(kDirectIOAlignment - 1);
+    const size_t end = RoundUpToDirectIOAlignment(pos_);
+    std::memset(buf_ + pos_, 0, end - pos_);
+    size_t offset = start;
+    while (offset < end) {
+      ssize_t write_result =
+          ::pwrite(fd_, buf_ + offset, end - offset,
+                   static_cast<off_t>(file_offset_ + offset));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      offset += write_result;
+    }
+
+    const size_t full_size = pos_ & ~(kDirectIOAlignment - 1);
+    std::memmove(buf_, buf_ + full_size, pos_ - full_size);
+    file_offset_ += full_size;
+    pos_ -= full_size;
+    written_ = pos_;
+    return Status::OK();
+  }
+
+  // True if the given file is a log file.
+  static bool IsLog(const std::string& filename) {
+    return filename.size() >= 4 &&
+           filename.compare(filename.size() - 4, 4, ".log") == 0;
+  }
+
+  // buf_[0, pos_ - 1] contains the data of the file from file_offset_ on,
+  // of which buf_[0, written_ - 1] is in the file.
+  char* const buf_;
+  size_t pos_;
+  size_t written_;
+  uint64_t file_offset_;
+  int fd_;
+
+  const bool is_log_;  // True if the file's name ends with .log.
+  const std::string filename_;
+};
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -518,7 +1074,8 @@ class PosixEnv : public Env {
     }
 
     if (!mmap_limiter_.Acquire()) {
-      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+      *result =
+          new PosixRandomAccessFile(filename, fd, &fd_limiter_, &async_reader_);
       return Status::OK();
     }
 
@@ -568,6 +1125,54 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+#if defined(O_DIRECT)
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+    if (fd < 0 && errno == EINVAL) {
+      // The file system does not support direct I/O.
+      return NewRandomAccessFile(filename, result);
+    }
+    if (fd < 0) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixDirectRandomAccessFile(filename, fd);
+    return Status::OK();
+#else
+    return NewRandomAccessFile(filename, result);
+#endif  // defined(O_DIRECT)
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if defined(O_DIRECT)
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd < 0 && errno == EINVAL) {
+      // The file system does not support direct I/O.
+      return NewWritableFile(filename, result);
+    }
+    if (fd < 0) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    char* buf = NewDirectIOBuffer(kDirectWriteBufferSize);
+    if (buf == nullptr) {
+      ::close(fd);
+      *result = nullptr;
+      return PosixError(filename, ENOMEM);
+    }
+    *result = new PosixDirectWritableFile(filename, fd, buf);
+    return Status::OK();
+#else
+    return NewWritableFile(filename, result);
+#endif  // defined(O_DIRECT)
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -661,7 +1266,14 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    Schedule(background_work_function, background_work_arg, kLow);
+  }
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg, Priority pri) override;
+
+  void IncBackgroundThreadsIfNeeded(int number, Priority pri) override;
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -717,12 +1329,6 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -737,16 +1343,36 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The threads and work queue serving one Priority.  Threads are started
+  // lazily by Schedule(), up to max_threads.
+  struct BackgroundPool {
+    explicit BackgroundPool(port::Mutex* mu)
+        : work_cv(mu), started_threads(0), max_threads(1) {}
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+    port::CondVar work_cv;
+    int started_threads;
+    int max_threads;
+    std::queue<BackgroundWorkItem> work_queue;
+  };
+
+  BackgroundPool* pool(Priority pri) {
+    return (pri == kHigh) ? &high_pool_ : &low_pool_;
+  }
+
+  void BackgroundThreadMain(BackgroundPool* pool);
+
+  static void BackgroundThreadEntryPoint(PosixEnv* env, BackgroundPool* pool) {
+    env->BackgroundThreadMain(pool);
+  }
+
+  port::Mutex background_work_mutex_;
+  BackgroundPool low_pool_ GUARDED_BY(background_work_mutex_);
+  BackgroundPool high_pool_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
   Limiter fd_limiter_;    // Thread-safe.
+  PosixAsyncReader async_reader_;  // Thread-safe.
 };
 
 // Return the maximum number of concurrent mmaps.
@@ -773,8 +1399,8 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : low_pool_(&background_work_mutex_),
+      high_pool_(&background_work_mutex_),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
@@ -782,42 +1408,51 @@ PosixEnv::PosixEnv()
  * 方法取出任务并执行 */
 void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
+    void* background_work_arg, Priority pri) {
   background_work_mutex_.Lock();
+  BackgroundPool* p = pool(pri);
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
+  // Start another background thread, if the pool is allowed to grow.
+  if (p->started_threads < p->max_threads) {
+    p->started_threads++;
     /* 启动 Entry Point 线程，本质上就是一个死循环，从任务队列中取出任务并执行 */
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  p);
     /* 线程要么调用 detach() 和当前线程分离，要么调用 join() 方法等待其执行完毕 */
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Any idle thread of the pool may pick up the new item.  Signal on every
+  // call: with several threads a non-empty queue does not mean that nobody
+  // is waiting.
+  p->work_queue.emplace(background_work_function, background_work_arg);
+  p->work_cv.Signal();
+  background_work_mutex_.Unlock();
+}
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+void PosixEnv::IncBackgroundThreadsIfNeeded(int number, Priority pri) {
+  background_work_mutex_.Lock();
+  BackgroundPool* p = pool(pri);
+  if (number > p->max_threads) {
+    p->max_threads = number;
+  }
   background_work_mutex_.Unlock();
 }
 
-/* 从 background_work_queue_ 中取出一个任务并执行，由于任务队列并没有最大数量限制，所以不需要
- * 在取出数据以后 notify 其它线程，一个很简易的实现 */
-void PosixEnv::BackgroundThreadMain() {
+/* 从 pool 的任务队列中取出一个任务并执行，同一个 pool 中的多个线程共享同一个任务队列 */
+void PosixEnv::BackgroundThreadMain(BackgroundPool* pool) {
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (pool->work_queue.empty()) {
+      pool->work_cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->work_queue.empty());
+    auto background_work_function = pool->work_queue.front().function;
+    void* background_work_arg = pool->work_queue.front().arg;
+    pool->work_queue.pop();
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
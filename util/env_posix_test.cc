@@ -6,6 +6,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -212,6 +213,122 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestSubmitReads) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/submit_reads.txt";
+
+  // Each 4-byte word of the file holds its index.
+  const int kNumWords = 4096;
+  std::string data;
+  for (int i = 0; i < kNumWords; i++) {
+    char word[5];
+    std::snprintf(word, sizeof(word), "%04d", i % 10000);
+    data.append(word, 4);
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Memory-mapped files, files with a permanent file descriptor, and files
+  // opened on every read.
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 5;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+
+  // More reads per file than an io_uring submission queue holds, plus one
+  // past the end of the file.
+  const int kReadsPerFile = 200;
+  std::vector<RandomAccessFile::ReadRequest> reqs(kNumFiles * kReadsPerFile);
+  std::vector<std::string> scratch(reqs.size(), std::string(8, '\0'));
+  for (size_t r = 0; r < reqs.size(); r++) {
+    const int word = static_cast<int>((r * 7919) % kNumWords);
+    reqs[r].offset = (r % kReadsPerFile == 0) ? data.size() - 4 : word * 4;
+    reqs[r].n = 8;
+    reqs[r].scratch = &scratch[r][0];
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->SubmitReads(&reqs[i * kReadsPerFile], kReadsPerFile);
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    files[i]->WaitForReads(&reqs[i * kReadsPerFile], kReadsPerFile);
+  }
+  for (size_t r = 0; r < reqs.size(); r++) {
+    if (r % kReadsPerFile == 0 && reqs[r].result.size() != 8) {
+      // Short read at the end of the file, or an error for mmap-ed files.
+      ASSERT_TRUE(!reqs[r].status.ok() || reqs[r].result.size() == 4);
+      continue;
+    }
+    ASSERT_LEVELDB_OK(reqs[r].status);
+    ASSERT_EQ(data.substr(reqs[r].offset, 8), reqs[r].result.ToString());
+  }
+
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, TestDirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+
+  // Appends of odd sizes that cross the 4KB blocks and the write buffer.
+  std::string data;
+  Random rnd(301);
+  while (data.size() < 3 * 1024 * 1024) {
+    data.append(rnd.Uniform(10000), static_cast<char>('a' + rnd.Uniform(26)));
+  }
+
+  for (const char* name : {"/direct_io.ldb", "/direct_io.log"}) {
+    const std::string test_file = test_dir + name;
+    const bool is_log = (std::strstr(name, ".log") != nullptr);
+    WritableFile* writable_file;
+    ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+    size_t appended = 0;
+    int flushes = 0;
+    while (appended < data.size()) {
+      const size_t n = std::min<size_t>(data.size() - appended,
+                                        1 + rnd.Uniform(20000));
+      ASSERT_LEVELDB_OK(
+          writable_file->Append(Slice(data.data() + appended, n)));
+      appended += n;
+      ASSERT_LEVELDB_OK(writable_file->Flush());
+      if (is_log && ++flushes % 64 == 0) {
+        // Log records are in the file once flushed.
+        std::string contents;
+        ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file, &contents));
+        ASSERT_GE(contents.size(), appended);
+        ASSERT_EQ(Slice(data.data(), appended),
+                  Slice(contents.data(), appended));
+      }
+    }
+    ASSERT_LEVELDB_OK(writable_file->Sync());
+    ASSERT_LEVELDB_OK(writable_file->Close());
+    delete writable_file;
+
+    uint64_t file_size;
+    ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+    ASSERT_EQ(data.size(), file_size);
+
+    RandomAccessFile* file;
+    ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+    std::string scratch(300000, '\0');
+    for (int i = 0; i < 100; i++) {
+      const uint64_t offset = rnd.Uniform(static_cast<int>(data.size()));
+      const size_t n = rnd.Uniform(static_cast<int>(scratch.size()));
+      Slice result;
+      ASSERT_LEVELDB_OK(file->Read(offset, n, &result, &scratch[0]));
+      // Reads past the end of the file return what there is.
+      ASSERT_EQ(Slice(data.data() + offset,
+                      std::min<size_t>(n, data.size() - offset)),
+                result);
+    }
+    delete file;
+    ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+  }
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -134,6 +134,43 @@ TEST_F(EnvTest, RunMany) {
   }
 }
 
+TEST_F(EnvTest, RunHighPriorityWhileLowIsBusy) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool high_ran = false;
+    bool low_done = false;
+
+    static void RunLow(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      // Occupy the low priority pool until the high priority item ran.
+      while (!state->high_ran) {
+        state->cvar.Wait();
+      }
+      state->low_done = true;
+      state->cvar.SignalAll();
+    }
+
+    static void RunHigh(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_ran = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->Schedule(&RunState::RunLow, &state, Env::kLow);
+  env_->Schedule(&RunState::RunHigh, &state, Env::kHigh);
+
+  MutexLock l(&state.mu);
+  while (!state.low_done) {
+    state.cvar.Wait();
+  }
+  ASSERT_TRUE(state.high_ran);
+}
+
 struct State {
   port::Mutex mu;
   port::CondVar cvar{&mu};
@@ -0,0 +1,42 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
+
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+// A WritableFile that asks a RateLimiter for the bytes of each append.
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  // Takes ownership of "file".  "rate_limiter" must outlive this object.
+  RateLimitedWritableFile(WritableFile* file, RateLimiter* rate_limiter,
+                          Env::Priority priority)
+      : file_(file), rate_limiter_(rate_limiter), priority_(priority) {}
+
+  RateLimitedWritableFile(const RateLimitedWritableFile&) = delete;
+  RateLimitedWritableFile& operator=(const RateLimitedWritableFile&) = delete;
+
+  ~RateLimitedWritableFile() override { delete file_; }
+
+  Status Append(const Slice& data) override {
+    rate_limiter_->Request(static_cast<int64_t>(data.size()), priority_);
+    return file_->Append(data);
+  }
+  Status Close() override { return file_->Close(); }
+  Status Flush() override { return file_->Flush(); }
+  Status Sync() override { return file_->Sync(); }
+
+ private:
+  WritableFile* const file_;
+  RateLimiter* const rate_limiter_;
+  const Env::Priority priority_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITED_FILE_H_
@@ -0,0 +1,218 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {}
+
+namespace {
+
+// Auto-tuning looks at the backlog over this many refill periods at a time.
+constexpr const int kAutoTunePeriods = 100;
+
+// The limit rises if requests waited in this percentage of the periods or
+// more, and drops if they waited in less than kLowWatermarkPercent.
+constexpr const int kHighWatermarkPercent = 90;
+constexpr const int kLowWatermarkPercent = 50;
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t rate_bytes_per_sec, int64_t refill_period_micros,
+                     bool auto_tuned, Env* env)
+      : env_(env),
+        refill_period_micros_(refill_period_micros),
+        max_bytes_per_sec_(rate_bytes_per_sec),
+        auto_tuned_(auto_tuned),
+        cv_(&mu_),
+        bytes_per_sec_(auto_tuned ? rate_bytes_per_sec / 2
+                                  : rate_bytes_per_sec),
+        available_bytes_(0),
+        next_refill_micros_(env_->NowMicros()),
+        refilling_(false),
+        waited_in_period_(false),
+        periods_(0),
+        waited_periods_(0),
+        total_bytes_{0, 0},
+        total_wait_micros_{0, 0} {
+    assert(rate_bytes_per_sec > 0);
+    assert(refill_period_micros > 0);
+  }
+
+  void Request(int64_t bytes, Env::Priority priority) override {
+    MutexLock l(&mu_);
+    total_bytes_[priority] += bytes;
+    // Requests larger than a refill are granted a refill at a time.
+    while (bytes > 0) {
+      const int64_t n = std::min(bytes, RefillBytes());
+      Grant(n, priority);
+      bytes -= n;
+    }
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_sec_;
+  }
+
+  int64_t GetTotalBytesThrough(Env::Priority priority) const override {
+    MutexLock l(&mu_);
+    return total_bytes_[priority];
+  }
+
+  int64_t GetTotalWaitMicros(Env::Priority priority) const override {
+    MutexLock l(&mu_);
+    return total_wait_micros_[priority];
+  }
+
+ private:
+  struct Waiter {
+    explicit Waiter(int64_t n) : bytes(n), granted(false) {}
+
+    const int64_t bytes;
+    bool granted;
+  };
+
+  int64_t RefillBytes() const EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return std::max<int64_t>(1,
+                             bytes_per_sec_ * refill_period_micros_ / 1000000);
+  }
+
+  // Takes "bytes" from the bucket, waiting for refills behind the requests
+  // already waiting if there are not enough.  One of the waiting threads
+  // sleeps until the next refill and does it; the others wait on cv_.
+  void Grant(int64_t bytes, Env::Priority priority)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    RefillIfDue(env_->NowMicros());
+    if (queues_[Env::kLow].empty() && queues_[Env::kHigh].empty() &&
+        available_bytes_ >= bytes) {
+      available_bytes_ -= bytes;
+      return;
+    }
+
+    const uint64_t start_micros = env_->NowMicros();
+    waited_in_period_ = true;
+    Waiter waiter(bytes);
+    queues_[priority].push_back(&waiter);
+    while (!waiter.granted) {
+      if (refilling_) {
+        cv_.Wait();
+        continue;
+      }
+      refilling_ = true;
+      const uint64_t now = env_->NowMicros();
+      if (now < next_refill_micros_) {
+        mu_.Unlock();
+        env_->SleepForMicroseconds(
+            static_cast<int>(next_refill_micros_ - now));
+        mu_.Lock();
+      }
+      RefillIfDue(env_->NowMicros());
+      refilling_ = false;
+      cv_.SignalAll();
+    }
+    total_wait_micros_[priority] += env_->NowMicros() - start_micros;
+  }
+
+  // Refills the bucket if a refill period has passed, and grants the
+  // waiting requests that fit, those of high priority first.
+  void RefillIfDue(uint64_t now) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (now < next_refill_micros_) {
+      return;
+    }
+    const int64_t periods =
+        1 + static_cast<int64_t>(now - next_refill_micros_) /
+                refill_period_micros_;
+    next_refill_micros_ = now + refill_period_micros_;
+    if (auto_tuned_) {
+      Tune(periods);
+    }
+    // Bytes left over from the last period are lost.
+    available_bytes_ = RefillBytes();
+    waited_in_period_ = false;
+
+    for (Env::Priority priority : {Env::kHigh, Env::kLow}) {
+      std::deque<Waiter*>* queue = &queues_[priority];
+      while (!queue->empty()) {
+        Waiter* waiter = queue->front();
+        // Requests made before the limit dropped may not fit in a refill.
+        if (waiter->bytes > available_bytes_ &&
+            available_bytes_ < RefillBytes()) {
+          return;
+        }
+        available_bytes_ =
+            std::max<int64_t>(0, available_bytes_ - waiter->bytes);
+        waiter->granted = true;
+        queue->pop_front();
+      }
+    }
+  }
+
+  // Accounts for "periods" refill periods, the last of which ends now, and
+  // adjusts the limit once enough of them passed.
+  void Tune(int64_t periods) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    periods_ += periods;
+    if (waited_in_period_) {
+      waited_periods_++;
+    }
+    if (periods_ < kAutoTunePeriods) {
+      return;
+    }
+    const int64_t waited_percent = waited_periods_ * 100 / periods_;
+    if (waited_percent >= kHighWatermarkPercent) {
+      bytes_per_sec_ =
+          std::min(max_bytes_per_sec_, bytes_per_sec_ * 105 / 100);
+    } else if (waited_percent < kLowWatermarkPercent) {
+      bytes_per_sec_ =
+          std::max(max_bytes_per_sec_ / 20, bytes_per_sec_ * 100 / 105);
+    }
+    periods_ = 0;
+    waited_periods_ = 0;
+  }
+
+  Env* const env_;
+  const int64_t refill_period_micros_;
+  const int64_t max_bytes_per_sec_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  int64_t bytes_per_sec_ GUARDED_BY(mu_);
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+  bool refilling_ GUARDED_BY(mu_);  // True while a waiter sleeps to refill
+
+  // Waiting requests, indexed by priority.
+  std::deque<Waiter*> queues_[2] GUARDED_BY(mu_);
+
+  // Backlog since the last adjustment, for auto-tuning.
+  bool waited_in_period_ GUARDED_BY(mu_);
+  int64_t periods_ GUARDED_BY(mu_);
+  int64_t waited_periods_ GUARDED_BY(mu_);
+
+  // Statistics, indexed by priority.
+  int64_t total_bytes_[2] GUARDED_BY(mu_);
+  int64_t total_wait_micros_[2] GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_micros,
+                                   bool auto_tuned, Env* env) {
+  return new GenericRateLimiter(rate_bytes_per_sec, refill_period_micros,
+                                auto_tuned,
+                                env != nullptr ? env : Env::Default());
+}
+
+}  // namespace leveldb
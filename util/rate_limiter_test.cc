@@ -0,0 +1,186 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// An Env whose clock only moves when the test advances it.  Sleeps block
+// until the clock reaches their end.  A thread that read the clock but has
+// not started sleeping yet would sleep past an Advance(), so tests wait for
+// the sleeper first.
+class FakeClockEnv : public EnvWrapper {
+ public:
+  FakeClockEnv()
+      : EnvWrapper(Env::Default()),
+        cv_(&mu_),
+        now_(0),
+        sleepers_(0),
+        last_sleep_end_(0) {}
+
+  uint64_t NowMicros() override {
+    MutexLock l(&mu_);
+    return now_;
+  }
+
+  void SleepForMicroseconds(int micros) override {
+    MutexLock l(&mu_);
+    const uint64_t end = now_ + micros;
+    sleepers_++;
+    last_sleep_end_ = std::max(last_sleep_end_, end);
+    cv_.SignalAll();
+    while (now_ < end) {
+      cv_.Wait();
+    }
+    sleepers_--;
+  }
+
+  void Advance(uint64_t micros) {
+    MutexLock l(&mu_);
+    now_ += micros;
+    cv_.SignalAll();
+  }
+
+  // Waits until a thread sleeps past the current time.  Threads woken by
+  // the last Advance() but not yet running do not count.
+  void WaitForSleeper() {
+    MutexLock l(&mu_);
+    while (sleepers_ == 0 || last_sleep_end_ <= now_) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  uint64_t now_ GUARDED_BY(mu_);
+  int sleepers_ GUARDED_BY(mu_);
+  uint64_t last_sleep_end_ GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+TEST(RateLimiterTest, Rate) {
+  Env* env = Env::Default();
+  // 10KB per refill of 10ms.
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(1 << 20, 10 * 1000));
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 30; i++) {
+    limiter->Request(10 * 1024, Env::kLow);
+  }
+  // The first refill is free, the other 29 take a period each.
+  ASSERT_GE(env->NowMicros() - start, 250 * 1000);
+  ASSERT_EQ(30 * 10 * 1024, limiter->GetTotalBytesThrough(Env::kLow));
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(Env::kHigh));
+  ASSERT_GT(limiter->GetTotalWaitMicros(Env::kLow), 0);
+
+  // Requests larger than a refill take several periods.
+  const uint64_t large_start = env->NowMicros();
+  limiter->Request(50 * 1024, Env::kHigh);
+  ASSERT_GE(env->NowMicros() - large_start, 40 * 1000);
+  ASSERT_EQ(50 * 1024, limiter->GetTotalBytesThrough(Env::kHigh));
+}
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  FakeClockEnv env;
+  const int64_t kPeriod = 10 * 1000;
+  const int64_t kRefill = (1 << 20) / 100;  // Bytes per 10ms at 1MB/s
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(1 << 20, kPeriod, false, &env));
+
+  // Empty the bucket, then queue a low priority request, which sleeps
+  // until the next refill, and a high priority request behind it.
+  limiter->Request(kRefill, Env::kLow);
+  std::atomic<bool> low_done(false);
+  std::thread low([&]() {
+    limiter->Request(kRefill, Env::kLow);
+    low_done.store(true);
+  });
+  env.WaitForSleeper();
+  std::thread high([&]() { limiter->Request(kRefill, Env::kHigh); });
+  // The high priority request is counted and queued under the same lock.
+  while (limiter->GetTotalBytesThrough(Env::kHigh) == 0) {
+    std::this_thread::yield();
+  }
+
+  // The next refill goes to the high priority request, although the low
+  // priority one waited longer.  The low priority one needs another
+  // refill, for which the clock has not moved yet.
+  env.Advance(kPeriod);
+  high.join();
+  const bool low_done_before_high = low_done.load();
+  env.WaitForSleeper();
+  env.Advance(kPeriod);
+  low.join();
+
+  ASSERT_TRUE(!low_done_before_high);
+  ASSERT_EQ(kPeriod, limiter->GetTotalWaitMicros(Env::kHigh));
+  ASSERT_EQ(2 * kPeriod, limiter->GetTotalWaitMicros(Env::kLow));
+}
+
+TEST(RateLimiterTest, AutoTuned) {
+  FakeClockEnv env;
+  const int64_t kPeriod = 10 * 1000;
+  const int64_t kMaxRate = 10 << 20;
+  // The limit is adjusted once per this many refill periods.
+  const int kTunePeriods = 100;
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(kMaxRate, kPeriod, /*auto_tuned=*/true, &env));
+  const int64_t initial_rate = limiter->GetBytesPerSecond();
+  ASSERT_EQ(kMaxRate / 2, initial_rate);
+
+  // A request for a full refill is pending in every period, so the limit
+  // rises by 5% once.
+  std::atomic<bool> stop(false);
+  std::thread backlog([&]() {
+    while (!stop.load()) {
+      limiter->Request(limiter->GetBytesPerSecond() * kPeriod / 1000000,
+                       Env::kLow);
+    }
+  });
+  for (int i = 0; i < kTunePeriods; i++) {
+    env.WaitForSleeper();
+    if (i == kTunePeriods - 1) {
+      stop.store(true);
+    }
+    env.Advance(kPeriod);
+  }
+  backlog.join();
+  const int64_t raised_rate = limiter->GetBytesPerSecond();
+  ASSERT_EQ(initial_rate * 105 / 100, raised_rate);
+
+  // Periods in which nobody waited lower it by 5% at a time, down to a
+  // twentieth of the maximum.
+  env.Advance(kTunePeriods * kPeriod);
+  limiter->Request(1, Env::kLow);
+  ASSERT_EQ(raised_rate * 100 / 105, limiter->GetBytesPerSecond());
+  for (int i = 0; i < 100; i++) {
+    env.Advance(kTunePeriods * kPeriod);
+    limiter->Request(1, Env::kLow);
+  }
+  ASSERT_EQ(kMaxRate / 20, limiter->GetBytesPerSecond());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,300 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Ribbon filter [Dillinger, Walzer 2021] is a static filter that stores
+// an r-bit fingerprint per key in about r * (1 + epsilon) bits per key,
+// where a Bloom filter with the same false positive rate of 2^-r needs
+// about 1.44 * r bits per key.
+//
+// Each key hashes to a start slot s, a 64-bit coefficient row c with its
+// lowest bit set, and an r-bit result.  Building the filter solves the
+// linear system over GF(2) in which every key contributes the equation
+//
+//   XOR of S[s + j] for all bits j set in c  ==  result
+//
+// for an m-slot solution S of r-bit values.  A key may be in the set if
+// its equation holds; for other keys it holds with probability 2^-r.  The
+// system is in band form (each row only spans 64 slots starting at s), so
+// it is solved with on-the-fly Gaussian elimination in near-linear time.
+// Elimination fails with a small probability, in which case the filter is
+// rebuilt with another hash seed.
+//
+// The solution is stored in blocks of 64 slots, so a filter of a few keys
+// would be larger than a Bloom filter with the same false positive rate.
+// Such key sets get a Bloom filter instead, told apart by the last byte.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static uint32_t RibbonHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x5a0bd4a3);
+}
+
+// The splitmix64 finalizer.
+static uint64_t Mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint32_t Parity(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<uint32_t>(__builtin_parityll(x));
+#else
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  x ^= x >> 4;
+  x ^= x >> 2;
+  x ^= x >> 1;
+  return static_cast<uint32_t>(x & 1);
+#endif
+}
+
+// REQUIRES: x != 0
+static int CountTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// The equation of a key for a given seed and number of start slots.
+struct Equation {
+  Equation(uint32_t h, uint32_t seed, uint32_t num_starts,
+           uint32_t result_mask) {
+    const uint64_t a = Mix64(h + seed * 0x9e3779b97f4a7c15ull);
+    start = static_cast<uint32_t>(((a >> 32) * num_starts) >> 32);
+    coeff = Mix64(a) | 1;
+    result = static_cast<uint32_t>(a) & result_mask;
+  }
+
+  uint32_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+class RibbonFilterPolicy : public FilterPolicy {
+ public:
+  static const uint32_t kCoeffBits = 64;
+  static const uint32_t kMaxSeeds = 256;
+
+  // Last byte of a Ribbon filter.  Bloom filters end with their number of
+  // probes, which is at most 30.
+  static const char kRibbonMarker = static_cast<char>(0xff);
+
+  explicit RibbonFilterPolicy(int bloom_equivalent_bits_per_key)
+      : bloom_(NewBloomFilterPolicy(bloom_equivalent_bits_per_key)),
+        bloom_bits_per_key_(bloom_equivalent_bits_per_key) {
+    // A Bloom filter with b bits per key has a false positive rate of
+    // about 0.6185^b = 2^(-0.69 * b).
+    int r = static_cast<int>(bloom_equivalent_bits_per_key * 0.69 + 0.5);
+    if (r < 1) r = 1;
+    if (r > 24) r = 24;
+    result_bits_ = r;
+  }
+
+  ~RibbonFilterPolicy() override { delete bloom_; }
+
+  const char* Name() const override { return "leveldb.RibbonFilter"; }
+
+  // Filter layout: for each block of 64 slots, result_bits 64-bit words,
+  // where bit i of word b is bit b of the solution of slot i of the block
+  // (an "interleaved column-major" layout, so that a query reads each
+  // result bit of its 64 slots with one or two word loads).  The solution
+  // words are followed by the seed byte, the result_bits byte and
+  // kRibbonMarker.
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // With 64-bit coefficient rows, elimination fails more often as the
+    // number of keys grows.  About 8% of extra slots keeps the chance of a
+    // failure low up to 64K keys; add more for every doubling past that.
+    // Grow the table if several seeds fail anyway.
+    int divisor = 12;
+    for (int k = n; k > 65536 && divisor > 7; k /= 2) {
+      divisor--;
+    }
+    size_t num_slots = n + n / divisor;
+    const size_t ribbon_bytes =
+        (num_slots + kCoeffBits - 1) / kCoeffBits * result_bits_ * 8 + 3;
+    const size_t bloom_bytes =
+        (std::max<size_t>(n * bloom_bits_per_key_, 64) + 7) / 8 + 1;
+    if (ribbon_bytes > bloom_bytes) {
+      bloom_->CreateFilter(keys, n, dst);
+      return;
+    }
+
+    if (n == 0) {
+      // No solution words: matches nothing.
+      AppendTrailer(0, result_bits_, dst);
+      return;
+    }
+
+    std::vector<uint32_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = RibbonHash(keys[i]);
+    }
+
+    uint32_t seed = 0;
+    std::vector<uint64_t> solution;
+    while (!Solve(hashes, num_slots, seed, &solution)) {
+      seed++;
+      if (seed == kMaxSeeds) {
+        // Cannot happen unless the hash is badly broken.
+        bloom_->CreateFilter(keys, n, dst);
+        return;
+      }
+      if (seed % 16 == 0) {
+        num_slots += num_slots / 16;
+      }
+    }
+
+    for (uint64_t word : solution) {
+      PutFixed64(dst, word);
+    }
+    AppendTrailer(seed, result_bits_, dst);
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len < 3 || filter[len - 1] != kRibbonMarker) {
+      return bloom_->KeyMayMatch(key, filter);
+    }
+
+    const uint32_t seed = static_cast<uint8_t>(filter[len - 3]);
+    const uint32_t r = static_cast<uint8_t>(filter[len - 2]);
+    if (r == 0 || (len - 3) % (8 * r) != 0) {
+      // Reserved for new encodings.
+      return true;
+    }
+    const size_t num_blocks = (len - 3) / (8 * r);
+    if (num_blocks == 0) return false;  // Empty set
+
+    const uint32_t num_slots = static_cast<uint32_t>(num_blocks * kCoeffBits);
+    const Equation eq(RibbonHash(key), seed, num_slots - kCoeffBits + 1,
+                      ResultMask(r));
+    const size_t block = eq.start / kCoeffBits;
+    const uint32_t offset = eq.start % kCoeffBits;
+    const char* words = filter.data() + block * r * 8;
+    for (uint32_t b = 0; b < r; b++) {
+      uint64_t window = DecodeFixed64(words + b * 8) >> offset;
+      if (offset != 0) {
+        window |= DecodeFixed64(words + (r + b) * 8) << (kCoeffBits - offset);
+      }
+      if (Parity(window & eq.coeff) != ((eq.result >> b) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static uint32_t ResultMask(uint32_t r) {
+    return static_cast<uint32_t>((uint64_t{1} << r) - 1);
+  }
+
+  static void AppendTrailer(uint32_t seed, uint32_t r, std::string* dst) {
+    dst->push_back(static_cast<char>(seed));
+    dst->push_back(static_cast<char>(r));
+    dst->push_back(kRibbonMarker);
+  }
+
+  // Band the equations of all keys into an m-slot system and solve it by
+  // back substitution.  Returns false if the equations are inconsistent.
+  bool Solve(const std::vector<uint32_t>& hashes, size_t num_slots,
+             uint32_t seed, std::vector<uint64_t>* solution) const {
+    const size_t num_blocks = (num_slots + kCoeffBits - 1) / kCoeffBits;
+    const uint32_t m = static_cast<uint32_t>(num_blocks * kCoeffBits);
+    const uint32_t mask = ResultMask(result_bits_);
+
+    // Banding the equations in order of their start slot keeps the rows
+    // being eliminated against in cache.
+    std::vector<Equation> equations;
+    equations.reserve(hashes.size());
+    for (uint32_t h : hashes) {
+      equations.emplace_back(h, seed, m - kCoeffBits + 1, mask);
+    }
+    std::sort(equations.begin(), equations.end(),
+              [](const Equation& a, const Equation& b) {
+                return a.start < b.start;
+              });
+
+    // Row i, if non-zero, has its lowest coefficient bit at slot i.
+    std::vector<uint64_t> coeffs(m, 0);
+    std::vector<uint32_t> results(m, 0);
+    for (const Equation& eq : equations) {
+      uint32_t i = eq.start;
+      uint64_t c = eq.coeff;
+      uint32_t result = eq.result;
+      for (;;) {
+        if (coeffs[i] == 0) {
+          coeffs[i] = c;
+          results[i] = result;
+          break;
+        }
+        c ^= coeffs[i];
+        result ^= results[i];
+        if (c == 0) {
+          if (result != 0) {
+            return false;  // Inconsistent
+          }
+          break;  // Redundant, e.g. a duplicate key
+        }
+        const int tz = CountTrailingZeros(c);
+        i += tz;
+        c >>= tz;
+      }
+    }
+
+    // Back substitution from the last slot, keeping the solution bits of
+    // slots i..i+63 of each result bit in state[b] (slot i in bit 0).
+    // Slots without a row are free variables and are set to 0.
+    const uint32_t r = result_bits_;
+    solution->assign(num_blocks * r, 0);
+    std::vector<uint64_t> state(r, 0);
+    for (uint32_t i = m; i-- > 0;) {
+      const uint64_t c = coeffs[i];
+      const uint32_t result = results[i];
+      uint64_t* words = &(*solution)[(i / kCoeffBits) * r];
+      for (uint32_t b = 0; b < r; b++) {
+        state[b] <<= 1;
+        const uint64_t bit = ((result >> b) & 1) ^ Parity(c & state[b]);
+        state[b] |= bit;
+        words[b] |= bit << (i % kCoeffBits);
+      }
+    }
+    return true;
+  }
+
+  const FilterPolicy* const bloom_;  // For small key sets
+  const int bloom_bits_per_key_;
+  uint32_t result_bits_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(int bloom_equivalent_bits_per_key) {
+  return new RibbonFilterPolicy(bloom_equivalent_bits_per_key);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,187 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/logging.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static const int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class RibbonTest : public testing::Test {
+ public:
+  RibbonTest() : policy_(NewRibbonFilterPolicy(10)) {}
+
+  ~RibbonTest() { delete policy_; }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      key_slices.push_back(Slice(keys_[i]));
+    }
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  double FalsePositiveRate() {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / 10000.0;
+  }
+
+ private:
+  const FilterPolicy* policy_;
+  std::string filter_;
+  std::vector<std::string> keys_;
+};
+
+TEST_F(RibbonTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(RibbonTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(RibbonTest, DuplicateKeys) {
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 2000; i++) {
+    Add(Key(i % 1000, buffer));
+  }
+  Build();
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << i;
+  }
+  ASSERT_LE(FalsePositiveRate(), 0.02);
+}
+
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else if (length < 10000) {
+    length += 1000;
+  } else {
+    length += 10000;
+  }
+  return length;
+}
+
+TEST_F(RibbonTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 100000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Never larger than a bloom filter of 10 bits per key, and at least
+    // 20% smaller once the rounding to 64-slot blocks does not matter.
+    ASSERT_LE(FilterSize(), (length * 10 / 8) + 40) << length;
+    if (length >= 1000) {
+      ASSERT_LE(FilterSize(), length * 10 / 8 * 4 / 5) << length;
+    }
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);  // Must not be over 2%
+  }
+}
+
+// A ribbon filter is meant to reach the false positive rate of a bloom
+// filter with the same bits per key in less space.
+TEST_F(RibbonTest, SmallerThanBloomAtSameRate) {
+  const int kNumKeys = 1000000;
+  std::vector<std::string> keys(kNumKeys);
+  std::vector<Slice> key_slices(kNumKeys);
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kNumKeys; i++) {
+    keys[i] = Key(i, buffer).ToString();
+    key_slices[i] = keys[i];
+    Add(key_slices[i]);
+  }
+  Build();
+
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  std::string bloom_filter;
+  bloom->CreateFilter(key_slices.data(), kNumKeys, &bloom_filter);
+  int false_positives = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (bloom->KeyMayMatch(Key(i + 1000000000, buffer), bloom_filter)) {
+      false_positives++;
+    }
+  }
+  delete bloom;
+  const double bloom_rate = false_positives / 10000.0;
+
+  const double rate = FalsePositiveRate();
+  if (kVerbose >= 1) {
+    std::fprintf(stderr,
+                 "Bloom: %5.2f%% in %d bytes ; ribbon: %5.2f%% in %d bytes\n",
+                 bloom_rate * 100.0, static_cast<int>(bloom_filter.size()),
+                 rate * 100.0, static_cast<int>(FilterSize()));
+  }
+  ASSERT_LE(rate, bloom_rate * 1.2);
+  ASSERT_LE(FilterSize(), bloom_filter.size() * 4 / 5);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
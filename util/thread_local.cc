@@ -0,0 +1,196 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <atomic>
+#include <cassert>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+// One slot of a thread's values.  The copy constructor lets the slots
+// live in a std::vector; it is only used while the owning thread grows the
+// vector under StaticMeta::mutex_.
+struct Entry {
+  Entry() : ptr(nullptr) {}
+  Entry(const Entry& e) : ptr(e.ptr.load(std::memory_order_relaxed)) {}
+
+  std::atomic<void*> ptr;
+};
+
+// The values of one thread for all ThreadLocalPtr instances, indexed by
+// instance id.  Threads are kept in a circular list so that Scrape() and
+// instance destruction can reach the values of every thread.
+struct ThreadData {
+  ThreadData() : next(nullptr), prev(nullptr) {}
+
+  std::vector<Entry> entries;
+  ThreadData* next;
+  ThreadData* prev;
+};
+
+}  // namespace
+
+// Keeps track of instance ids and of the threads that hold values.
+class ThreadLocalPtr::StaticMeta {
+ public:
+  StaticMeta() : next_id_(0) {
+    head_.next = &head_;
+    head_.prev = &head_;
+  }
+
+  uint32_t AcquireId(UnrefHandler handler) {
+    MutexLock l(&mutex_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = next_id_++;
+      handlers_.resize(next_id_);
+    }
+    handlers_[id] = handler;
+    return id;
+  }
+
+  // Clear the values of "id" in all threads, running its UnrefHandler on
+  // the non-null ones, and make the id available for reuse.  Waits for
+  // exiting threads that are running the handler.
+  void ReleaseId(uint32_t id) {
+    MutexLock l(&mutex_);
+    UnrefHandler handler = handlers_[id];
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr = t->entries[id].ptr.exchange(nullptr);
+        if (ptr != nullptr && handler != nullptr) {
+          (*handler)(ptr);
+        }
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  void* Get(uint32_t id) {
+    ThreadData* t = GetThreadData();
+    if (id >= t->entries.size()) {
+      return nullptr;
+    }
+    return t->entries[id].ptr.load(std::memory_order_acquire);
+  }
+
+  // Return the calling thread's slot for "id", growing its vector of
+  // slots if needed.
+  std::atomic<void*>* GetSlot(uint32_t id) {
+    ThreadData* t = GetThreadData();
+    if (id >= t->entries.size()) {
+      // Scrape() may be walking the vector; only resize it under mutex_.
+      MutexLock l(&mutex_);
+      t->entries.resize(id + 1);
+    }
+    return &t->entries[id].ptr;
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mutex_);
+    for (ThreadData* t = head_.next; t != &head_; t = t->next) {
+      if (id < t->entries.size()) {
+        void* ptr = t->entries[id].ptr.exchange(replacement,
+                                                std::memory_order_acquire);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+ private:
+  // Unlinks a thread's data when the thread exits.
+  struct ThreadDataHolder {
+    ThreadDataHolder() : data(nullptr) {}
+    ~ThreadDataHolder() {
+      if (data != nullptr) {
+        ThreadLocalPtr::Instance()->OnThreadExit(data);
+      }
+    }
+
+    ThreadData* data;
+  };
+
+  ThreadData* GetThreadData() {
+    static thread_local ThreadDataHolder holder;
+    if (holder.data == nullptr) {
+      ThreadData* t = new ThreadData;
+      MutexLock l(&mutex_);
+      t->next = &head_;
+      t->prev = head_.prev;
+      head_.prev->next = t;
+      head_.prev = t;
+      holder.data = t;
+    }
+    return holder.data;
+  }
+
+  // Runs the handlers with mutex_ held, so that Scrape() and ReleaseId()
+  // wait for them: the objects that the values point to may belong to the
+  // owner of the ThreadLocalPtr, which may be going away.
+  void OnThreadExit(ThreadData* t) {
+    {
+      MutexLock l(&mutex_);
+      t->prev->next = t->next;
+      t->next->prev = t->prev;
+      for (uint32_t id = 0; id < t->entries.size(); id++) {
+        void* ptr = t->entries[id].ptr.load(std::memory_order_relaxed);
+        if (ptr != nullptr && handlers_[id] != nullptr) {
+          (*handlers_[id])(ptr);
+        }
+      }
+    }
+    delete t;
+  }
+
+  port::Mutex mutex_;
+  uint32_t next_id_ GUARDED_BY(mutex_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mutex_);
+  std::vector<UnrefHandler> handlers_ GUARDED_BY(mutex_);
+  ThreadData head_ GUARDED_BY(mutex_);  // Dummy head of the thread list
+};
+
+ThreadLocalPtr::StaticMeta* ThreadLocalPtr::Instance() {
+  static NoDestructor<StaticMeta> instance;
+  return instance.get();
+}
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(Instance()->AcquireId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { Instance()->ReleaseId(id_); }
+
+void* ThreadLocalPtr::Get() const { return Instance()->Get(id_); }
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Instance()->GetSlot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Instance()->GetSlot(id_)->exchange(ptr, std::memory_order_acquire);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void*& expected) {
+  return Instance()->GetSlot(id_)->compare_exchange_strong(
+      expected, ptr, std::memory_order_release, std::memory_order_relaxed);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Instance()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A pointer with one value per thread.  Unlike a thread_local variable, a
+// ThreadLocalPtr can be a member of an object (every instance has its own
+// set of values), and the values of all threads can be collected with
+// Scrape().  All values start out as nullptr.
+//
+// Thread-safe: Get(), Reset(), Swap() and CompareAndSwap() act on the
+// calling thread's value; Scrape() may be called from any thread.
+class ThreadLocalPtr {
+ public:
+  // Called with a thread's non-null value when that thread exits or when
+  // the ThreadLocalPtr is destroyed.  It runs with a lock held that
+  // Scrape() and the destructor also take, so that they wait for exiting
+  // threads to finish with their values.  It must therefore not call
+  // ThreadLocalPtr methods, nor wait for a lock that is held across a call
+  // to Scrape() or to the destructor.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's value.
+  void* Get() const;
+
+  // Set the calling thread's value to "ptr".
+  void Reset(void* ptr);
+
+  // Set the calling thread's value to "ptr" and return the old value.
+  void* Swap(void* ptr);
+
+  // If the calling thread's value is "expected", replace it with "ptr" and
+  // return true.  Otherwise store the current value in "expected" and
+  // return false.
+  bool CompareAndSwap(void* ptr, void*& expected);
+
+  // Replace the value of every thread with "replacement" and append the
+  // old non-null values to *ptrs.  The UnrefHandler is not called for them.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  class StaticMeta;
+
+  static StaticMeta* Instance();
+
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
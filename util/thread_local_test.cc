@@ -0,0 +1,206 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+int unref_count = 0;
+port::Mutex unref_mu;
+
+void CountUnref(void* ptr) {
+  MutexLock l(&unref_mu);
+  unref_count++;
+}
+
+struct ThreadState {
+  ThreadState(ThreadLocalPtr* tls, port::Mutex* mu, port::CondVar* cv)
+      : tls(tls), mu(mu), cv(cv), value(0), stored(false), release(false),
+        done(false) {}
+
+  ThreadLocalPtr* const tls;
+  port::Mutex* const mu;
+  port::CondVar* const cv;
+  int value;
+  bool stored;
+  bool release;
+  bool done;
+};
+
+// Stores a pointer to its own value, then waits to be released.
+void StoreAndWait(void* arg) {
+  ThreadState* state = reinterpret_cast<ThreadState*>(arg);
+  state->tls->Reset(&state->value);
+  MutexLock l(state->mu);
+  state->stored = true;
+  state->cv->SignalAll();
+  while (!state->release) {
+    state->cv->Wait();
+  }
+  state->done = true;
+  state->cv->SignalAll();
+}
+
+// State of BlockingUnref(), which waits to be released.
+port::Mutex exit_mu;
+port::CondVar exit_cv(&exit_mu);
+bool exit_handler_entered = false;
+bool exit_handler_release = false;
+bool exit_handler_done = false;
+
+void BlockingUnref(void* ptr) {
+  MutexLock l(&exit_mu);
+  exit_handler_entered = true;
+  exit_cv.SignalAll();
+  while (!exit_handler_release) {
+    exit_cv.Wait();
+  }
+  exit_handler_done = true;
+  exit_cv.SignalAll();
+}
+
+// Stores a value, then exits.
+void StoreAndExit(void* arg) {
+  ThreadLocalPtr* tls = reinterpret_cast<ThreadLocalPtr*>(arg);
+  tls->Reset(tls);
+}
+
+struct DestroyState {
+  ThreadLocalPtr* tls;
+  bool destroyed;
+  bool handler_done_first;
+};
+
+void Destroy(void* arg) {
+  DestroyState* state = reinterpret_cast<DestroyState*>(arg);
+  delete state->tls;
+  MutexLock l(&exit_mu);
+  state->destroyed = true;
+  state->handler_done_first = exit_handler_done;
+  exit_cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(ThreadLocalTest, SingleThread) {
+  ThreadLocalPtr tls;
+  int a = 1, b = 2;
+  ASSERT_EQ(nullptr, tls.Get());
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_TRUE(!tls.CompareAndSwap(nullptr, expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(nullptr, expected));
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+TEST(ThreadLocalTest, InstancesAreIndependent) {
+  ThreadLocalPtr tls1;
+  ThreadLocalPtr tls2;
+  int a = 1;
+  tls1.Reset(&a);
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(nullptr, tls2.Get());
+}
+
+TEST(ThreadLocalTest, ScrapeAndUnrefOnDestruction) {
+  const int kNumThreads = 4;
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  ThreadLocalPtr* tls = new ThreadLocalPtr(&CountUnref);
+  std::vector<ThreadState*> states;
+  for (int i = 0; i < kNumThreads; i++) {
+    states.push_back(new ThreadState(tls, &mu, &cv));
+    Env::Default()->StartThread(&StoreAndWait, states[i]);
+  }
+  {
+    MutexLock l(&mu);
+    for (int i = 0; i < kNumThreads; i++) {
+      while (!states[i]->stored) {
+        cv.Wait();
+      }
+    }
+  }
+
+  // Every thread has its own value, and the calling thread has none.
+  int mine = 0;
+  tls->Reset(&mine);
+  std::vector<void*> ptrs;
+  tls->Scrape(&ptrs, nullptr);
+  ASSERT_EQ(kNumThreads + 1, ptrs.size());
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_TRUE(std::find(ptrs.begin(), ptrs.end(), &states[i]->value) !=
+                ptrs.end());
+  }
+  ASSERT_EQ(nullptr, tls->Get());
+
+  // Values still set when the ThreadLocalPtr goes away are handed to the
+  // UnrefHandler.
+  tls->Reset(&mine);
+  delete tls;
+  {
+    MutexLock l(&unref_mu);
+    ASSERT_EQ(1, unref_count);
+  }
+
+  MutexLock l(&mu);
+  for (int i = 0; i < kNumThreads; i++) {
+    states[i]->release = true;
+  }
+  cv.SignalAll();
+  for (int i = 0; i < kNumThreads; i++) {
+    while (!states[i]->done) {
+      cv.Wait();
+    }
+  }
+  for (int i = 0; i < kNumThreads; i++) {
+    delete states[i];
+  }
+}
+
+TEST(ThreadLocalTest, DestructionWaitsForExitingThreads) {
+  DestroyState state = {new ThreadLocalPtr(&BlockingUnref), false, false};
+  Env::Default()->StartThread(&StoreAndExit, state.tls);
+  {
+    MutexLock l(&exit_mu);
+    while (!exit_handler_entered) {
+      exit_cv.Wait();
+    }
+  }
+
+  // The exiting thread is in its handler.  Destroying the ThreadLocalPtr
+  // meanwhile must wait for the handler, which the owner of the value may
+  // need to outlive.
+  Env::Default()->StartThread(&Destroy, &state);
+  Env::Default()->SleepForMicroseconds(10 * 1000);
+  MutexLock l(&exit_mu);
+  exit_handler_release = true;
+  exit_cv.SignalAll();
+  while (!state.destroyed) {
+    exit_cv.Wait();
+  }
+  ASSERT_TRUE(state.handler_done_first);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}